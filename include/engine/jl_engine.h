@@ -4,6 +4,7 @@
 #pragma once
 #include "defines.h"
 
+#include <cstdint>
 #include <filesystem>
 #include <string>
 
@@ -28,4 +29,49 @@ public:
   JLEngine_API static path toolsDir;
   JLEngine_API static path shadersDir;
   JLEngine_API static path compiledShadersDir;
+};
+
+class JlEngineSettings
+{
+public:
+  // LowLatency uses FIFO and paces frames on present wait, Throughput
+  // prefers mailbox and Uncapped immediate, for benchmarks.
+  enum PresentPolicy { LowLatency, Throughput, Uncapped };
+
+  // Frames the CPU may record ahead of the GPU, clamped to [1, 3].
+  JLEngine_API static uint32_t framesInFlight;
+  // Stops the update loop after this many frames, 0 runs until closed.
+  JLEngine_API static uint64_t maxFrames;
+  // Most threads the recording benchmark spreads secondary command buffers
+  // over, 0 picks one per spare core.
+  JLEngine_API static uint32_t recordWorkers;
+  // Threads compiling and validating shaders at startup, 0 picks one per
+  // spare core.
+  JLEngine_API static uint32_t shaderWorkers;
+  JLEngine_API static PresentPolicy presentPolicy;
+  // Swap chain images, 0 lets the present policy decide.
+  JLEngine_API static uint32_t swapChainImages;
+  // Keeps render pass and framebuffer objects even where dynamic rendering
+  // is supported, to compare both paths.
+  JLEngine_API static bool legacyRenderPasses;
+  // Fast-links pipelines from shared parts where the device supports
+  // pipeline libraries, off compiles every pipeline whole.
+  JLEngine_API static bool pipelineLibraries;
+  // Runs the renderer microbenchmarks once after initialization.
+  JLEngine_API static bool runBenchmarks;
+  // Times every render graph pass on the GPU and reports at shutdown.
+  JLEngine_API static bool gpuProfiling;
+  // Chrome trace of the GPU and CPU timelines, relative to the app
+  // directory. Empty disables the export.
+  JLEngine_API static string gpuTraceFile;
+  // Picks this GPU over the ranking, matched against part of the device
+  // name or its full UUID. Empty lets the ranking decide.
+  JLEngine_API static string gpuOverride;
+  // Renders offscreen without a window or surface, as fast as possible.
+  JLEngine_API static bool headless;
+  JLEngine_API static uint32_t headlessWidth;
+  JLEngine_API static uint32_t headlessHeight;
+  // Headless only, writes every Nth frame to the app's frames directory.
+  // 0 never reads back.
+  JLEngine_API static uint32_t readbackInterval;
 };
\ No newline at end of file
@@ -0,0 +1,31 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+// FNV-1a, for cache keys and change detection, never for anything that has
+// to resist collisions on purpose. Fields are folded in one after the other,
+// starting from offsetBasis.
+class JlHash
+{
+public:
+  static constexpr uint64_t offsetBasis = 14695981039346656037ull;
+
+  static uint64_t bytes(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* input = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+      hash ^= input[i];
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+  template <typename T>
+  static uint64_t value(uint64_t hash, const T& field) {
+    return bytes(hash, &field, sizeof(field));
+  }
+};
@@ -0,0 +1,60 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+class JlWorkerPool
+{
+public:
+  explicit JlWorkerPool(uint32_t workerCount);
+  ~JlWorkerPool();
+
+  JlWorkerPool(const JlWorkerPool&) = delete;
+  JlWorkerPool& operator=(const JlWorkerPool&) = delete;
+
+  // Runs job once per index across the workers and returns when all are done.
+  // The worker index lets jobs use per-thread state without locking.
+  void parallelFor(uint32_t count,
+                   const function<void(uint32_t index, uint32_t worker)>& job);
+
+  // Queues a task and returns right away, idle workers pick tasks up in
+  // order. Tasks still queued when the pool is destroyed never run.
+  void submit(function<void(uint32_t worker)> task);
+  // Queued and running tasks.
+  uint32_t getPendingTasks();
+  // Blocks until every submitted task has finished.
+  void waitIdle();
+
+  uint32_t getWorkerCount() const;
+
+  static uint32_t getDefaultWorkerCount();
+
+private:
+  void workerLoop(uint32_t worker);
+
+  vector<thread> threads_;
+  mutex mutex_;
+  condition_variable wake_;
+  condition_variable done_;
+  condition_variable idle_;
+
+  const function<void(uint32_t, uint32_t)>* job_ = nullptr;
+  uint32_t jobCount_ = 0;
+  atomic<uint32_t> nextIndex_{ 0 };
+  uint32_t busyWorkers_ = 0;
+  uint64_t generation_ = 0;
+  bool stopping_ = false;
+
+  deque<function<void(uint32_t)>> tasks_;
+  uint32_t runningTasks_ = 0;
+};
@@ -10,5 +10,6 @@ public:
   enum JlGraphicsAPI { Vulkan, OpenGL, DX12 };
 
   static bool initGraphicsAPI(GLFWwindow* window, JlGraphicsAPI type);
+  static void drawFrame();
   static void shutdownGraphicsAPI();
 };
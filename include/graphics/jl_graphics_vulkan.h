@@ -2,6 +2,8 @@
 //-----------------------------------
 
 #pragma once
+#include "graphics/jl_vulkan_memory.h"
+
 #include <vulkan/vk_platform.h>
 #include <vulkan/vulkan_core.h>
 
@@ -9,6 +11,7 @@
 
 #include <cstdint>
 #include <optional>
+#include <string>
 #include <vector>
 
 using namespace std;
@@ -16,29 +19,98 @@ using namespace std;
 class JlVulkanGraphics
 {
 public:
+  // A null window renders headless into offscreen targets.
   static bool initVulkan(GLFWwindow* window);
+  static void drawFrame();
   static void shutdownVulkan();
 
+  struct FrameData
+  {
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkSemaphore imageAvailable = VK_NULL_HANDLE;
+    VkFence inFlight = VK_NULL_HANDLE;
+    uint64_t timelineValue = 0;
+
+    // Headless readback, written to disk once the fence has passed.
+    VkBuffer readbackBuffer = VK_NULL_HANDLE;
+    JlVulkanMemory::Allocation readbackAllocation;
+    uint64_t readbackFrame = 0;
+    bool readbackPending = false;
+  };
+
+  struct FrameStats
+  {
+    uint64_t frames = 0;
+    double frameMs = 0.0;
+    double fenceWaitMs = 0.0;
+    double recordMs = 0.0;
+    uint64_t swapChainRecreations = 0;
+  };
+
+  struct DeviceCandidate
+  {
+    VkPhysicalDevice device = VK_NULL_HANDLE;
+    string name;
+    string type;
+    VkDeviceSize localMemory = 0;
+    int score = 0;
+  };
+
+  struct RetiredSwapChain
+  {
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+    vector<VkImageView> imageViews;
+    vector<VkFramebuffer> framebuffers;
+    vector<VkSemaphore> presentSemaphores;
+    uint64_t retiredAtFrame = 0;
+  };
+
 private:
   static bool createInstance();
   static bool setupDebugMessenger();
   static bool createSurface();
   static bool pickPhysicalDevice();
   static bool createLogicalDevice();
-  static void createSwapChain();
+  static bool createSwapChain();
+  static bool createOffscreenTargets();
+  static void recreateSwapChain();
+  // Signals the fence and timeline value of a frame whose submit failed.
+  static void releaseFailedSubmit(FrameData& frame, bool waitImageAvailable);
+  static void destroyRetiredSwapChains(bool force);
   static bool createImageViews();
-  static void createGraphicsPipeline();
+  static bool createRenderPass();
+  static bool createGraphicsPipeline();
+  static bool createFramebuffers();
+  static bool createPresentSemaphores();
+  static bool createCommandPool();
+  static bool createFrameResources();
+  static bool createFrameGraph();
+  static void writeReadback(FrameData& frame);
+
+  static void recordCommandBuffer(VkCommandBuffer commandBuffer,
+                                  uint32_t imageIndex);
+
+  static VkShaderModule createShaderModule(const vector<char>& code);
+  static vector<char> readFile(const string& filename);
 
   static vector<const char*> getRequiredExtensions();
 
   static bool isDeviceSuitable(VkPhysicalDevice device);
   static bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+  // 0 for devices that can't run the engine at all.
   static int pickBestDevice(VkPhysicalDevice device);
+  static bool matchesDeviceOverride(VkPhysicalDevice device,
+                                    const string& deviceOverride);
 
   struct QueueFamilyIndices
   {
     optional<uint32_t> graphicsFamily;
     optional<uint32_t> presentFamily;
+    // A family without graphics, preferably transfer-only (DMA engines).
+    optional<uint32_t> transferFamily;
+    // Compute without graphics, for async compute. Preferably not the
+    // transfer family, otherwise both share its first queue.
+    optional<uint32_t> computeFamily;
 
     bool isComplete() const {
       return graphicsFamily.has_value() && presentFamily.has_value();
@@ -54,6 +126,21 @@ private:
     vector<VkPresentModeKHR> presentModes;
   };
 
+  static void reportFrameStats();
+
+  static void runBenchmarks();
+  static void benchmarkCommandRecording();
+  static void benchmarkRenderGraph();
+  static void benchmarkRenderPaths();
+  static void benchmarkGpuCulling();
+  static void benchmarkAsyncCompute();
+  static void benchmarkPipelineCompiler();
+  static void benchmarkDescriptorAllocation();
+  static void benchmarkDispatch();
+
+  static void framebufferResizeCallback(GLFWwindow* window, int width,
+                                        int height);
+
   static SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
   static VkSurfaceFormatKHR chooseSwapSurfaceFormat(const vector<VkSurfaceFormatKHR>& availableFormats);
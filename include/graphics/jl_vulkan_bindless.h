@@ -0,0 +1,87 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#pragma once
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// One update-after-bind descriptor set holding every sampled image, storage
+// buffer and sampler the renderer uses. It's bound once per command buffer
+// and shaders index into it with the 32-bit slots handed out here.
+class JlVulkanBindless
+{
+public:
+  static const uint32_t invalidIndex = UINT32_MAX;
+
+  // Binding numbers inside the set, shaders declare the same.
+  enum Binding
+  {
+    SampledImages = 0,
+    StorageBuffers = 1,
+    Samplers = 2,
+    BindingCount = 3
+  };
+
+  // Pushed per draw so materials and draws only carry indices.
+  struct DrawIndices
+  {
+    uint32_t indices[4];
+  };
+
+  struct Stats
+  {
+    uint32_t capacity = 0;
+    uint32_t used = 0;
+    uint32_t peakUsed = 0;
+    uint64_t updates = 0;
+  };
+
+  static bool init(VkPhysicalDevice physicalDevice, VkDevice device);
+  static void shutdown();
+  static bool isAvailable();
+
+  static uint32_t registerSampledImage(VkImageView imageView,
+                                       VkImageLayout layout);
+  static uint32_t registerStorageBuffer(VkBuffer buffer, VkDeviceSize offset,
+                                        VkDeviceSize range);
+  static uint32_t registerSampler(VkSampler sampler);
+
+  static void updateSampledImage(uint32_t index, VkImageView imageView,
+                                 VkImageLayout layout);
+  static void updateStorageBuffer(uint32_t index, VkBuffer buffer,
+                                  VkDeviceSize offset, VkDeviceSize range);
+
+  // The slot is only reused once the GPU timeline has passed every frame
+  // that could still read it.
+  static void release(Binding binding, uint32_t index);
+
+  static VkDescriptorSetLayout getSetLayout();
+  static VkDescriptorSet getSet();
+  static VkPushConstantRange getPushConstantRange();
+  static void bind(VkCommandBuffer commandBuffer,
+                   VkPipelineBindPoint bindPoint, VkPipelineLayout layout);
+
+  static Stats getStats(Binding binding);
+  static void reportStats();
+
+  struct SlotTable
+  {
+    uint32_t capacity = 0;
+    uint32_t next = 0;
+    vector<uint32_t> freeSlots;
+    uint32_t used = 0;
+    uint32_t peakUsed = 0;
+    uint64_t updates = 0;
+  };
+
+private:
+  static uint32_t allocateSlot(Binding binding);
+  static void writeDescriptor(Binding binding, uint32_t index,
+                              const VkDescriptorImageInfo* imageInfo,
+                              const VkDescriptorBufferInfo* bufferInfo);
+};
@@ -0,0 +1,57 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#pragma once
+#include "engine/jl_worker_pool.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+using namespace std;
+
+class JlVulkanCommandRecorder
+{
+public:
+  using RecordTask = function<void(VkCommandBuffer commandBuffer)>;
+
+  JlVulkanCommandRecorder(VkDevice device, uint32_t queueFamily,
+                          uint32_t framesInFlight, uint32_t workerCount);
+  ~JlVulkanCommandRecorder();
+
+  JlVulkanCommandRecorder(const JlVulkanCommandRecorder&) = delete;
+  JlVulkanCommandRecorder& operator=(const JlVulkanCommandRecorder&) = delete;
+
+  // Must only be called once the frame's fence has signaled.
+  void resetFrame(uint32_t frameIndex);
+
+  // Records every task into its own secondary command buffer on the worker
+  // threads. The result is in task order regardless of which worker ran it,
+  // ready for vkCmdExecuteCommands.
+  vector<VkCommandBuffer> recordSecondary(
+    uint32_t frameIndex, const VkCommandBufferInheritanceInfo& inheritance,
+    const vector<RecordTask>& tasks);
+
+  static void executeSecondary(VkCommandBuffer primary,
+                               const vector<VkCommandBuffer>& secondaries);
+
+  uint32_t getWorkerCount() const;
+
+private:
+  struct ThreadCommandPool
+  {
+    VkCommandPool pool = VK_NULL_HANDLE;
+    vector<VkCommandBuffer> buffers;
+    uint32_t used = 0;
+  };
+
+  VkCommandBuffer acquireBuffer(ThreadCommandPool& threadPool);
+
+  VkDevice device_;
+  // Indexed [frame][worker], a pool is only ever touched by its own worker.
+  vector<vector<ThreadCommandPool>> pools_;
+  JlWorkerPool workers_;
+};
@@ -0,0 +1,107 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#pragma once
+#include "graphics/jl_vulkan_memory.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+using namespace std;
+using namespace filesystem;
+
+// Frustum culls instance bounds in a compute pass and compacts the
+// survivors into indexed indirect draws, so recording a scene costs the
+// same handful of commands however many instances it holds. Without
+// drawIndirectCount every instance keeps its draw and culled ones draw
+// nothing.
+class JlVulkanCulling
+{
+public:
+  // Mirrors the shaders' Instance, 32 bytes.
+  struct Instance
+  {
+    glm::vec3 center;
+    float radius;
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t padding;
+  };
+
+  JlVulkanCulling(VkDevice device, bool drawIndirectCount);
+  ~JlVulkanCulling();
+
+  // The draw pipeline renders into one color attachment of that format,
+  // through the render pass or, when it's null, dynamic rendering.
+  bool init(const path& shaderDir, VkFormat colorFormat,
+            VkRenderPass renderPass);
+  bool setInstances(const vector<Instance>& instances);
+  uint32_t getInstanceCount() const;
+
+  // A cube around each instance's bounds, bound by recordDraw().
+  static uint32_t getCubeIndexCount();
+
+  // Transfer, zeroes the draw count ahead of recordCull().
+  void recordReset(VkCommandBuffer commandBuffer);
+  // Compute, writes the draws and their count.
+  void recordCull(VkCommandBuffer commandBuffer,
+                  const glm::mat4& viewProjection);
+  // Inside the render pass, reads the draws as indirect commands.
+  void recordDraw(VkCommandBuffer commandBuffer,
+                  const glm::mat4& viewProjection);
+
+  VkBuffer getDrawBuffer() const;
+  VkBuffer getCountBuffer() const;
+
+  struct CullConstants
+  {
+    glm::vec4 planes[6];
+    uint32_t instanceCount;
+    uint32_t compact;
+  };
+
+private:
+  bool createDescriptors();
+  bool createPipelines(const path& shaderDir, VkFormat colorFormat,
+                       VkRenderPass renderPass);
+  bool createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                    VkMemoryPropertyFlags requiredFlags,
+                    VkMemoryPropertyFlags preferredFlags, VkBuffer* buffer,
+                    JlVulkanMemory::Allocation& allocation);
+  void destroyInstanceBuffers();
+  void writeDescriptors();
+
+  VkShaderModule loadShader(const path& file);
+
+  VkDevice device_;
+  bool drawIndirectCount_;
+
+  VkDescriptorSetLayout setLayout_ = VK_NULL_HANDLE;
+  VkDescriptorPool descriptorPool_ = VK_NULL_HANDLE;
+  VkDescriptorSet descriptorSet_ = VK_NULL_HANDLE;
+
+  VkPipelineLayout cullLayout_ = VK_NULL_HANDLE;
+  VkPipelineLayout drawLayout_ = VK_NULL_HANDLE;
+  VkPipeline cullPipeline_ = VK_NULL_HANDLE;
+  VkPipeline drawPipeline_ = VK_NULL_HANDLE;
+
+  VkBuffer indexBuffer_ = VK_NULL_HANDLE;
+  JlVulkanMemory::Allocation indexAllocation_;
+  VkBuffer countBuffer_ = VK_NULL_HANDLE;
+  JlVulkanMemory::Allocation countAllocation_;
+
+  // Sized for instanceCapacity_, only ever grown.
+  VkBuffer instanceBuffer_ = VK_NULL_HANDLE;
+  JlVulkanMemory::Allocation instanceAllocation_;
+  VkBuffer drawBuffer_ = VK_NULL_HANDLE;
+  JlVulkanMemory::Allocation drawAllocation_;
+  uint32_t instanceCapacity_ = 0;
+  uint32_t instanceCount_ = 0;
+};
@@ -0,0 +1,131 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#pragma once
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Descriptor sets that only live for one frame. Every frame slot has pools
+// for each recording thread, sets are never freed one by one and a single
+// vkResetDescriptorPool per used pool recycles all of them once the slot's
+// fence has signaled. Pools are added when the current one runs out and
+// kept, so a steady scene stops creating pools after its first frames.
+class JlVulkanDescriptorAllocator
+{
+public:
+  JlVulkanDescriptorAllocator(VkDevice device, uint32_t framesInFlight,
+                              uint32_t threadCount,
+                              uint32_t setsPerPool = 64);
+  ~JlVulkanDescriptorAllocator();
+
+  JlVulkanDescriptorAllocator(const JlVulkanDescriptorAllocator&) = delete;
+  JlVulkanDescriptorAllocator& operator=(
+    const JlVulkanDescriptorAllocator&) = delete;
+
+  // Must only be called once the frame's fence has signaled.
+  void resetFrame(uint32_t frameIndex);
+
+  // A thread only ever passes its own index. VK_NULL_HANDLE when the set
+  // doesn't fit even an empty pool.
+  VkDescriptorSet allocate(uint32_t frameIndex, uint32_t thread,
+                           VkDescriptorSetLayout layout);
+
+  struct Stats
+  {
+    uint64_t frames = 0;
+    uint64_t sets = 0;
+    uint64_t failed = 0;
+    uint32_t pools = 0;
+    // High-water marks between two resets of a frame slot, for pre-sizing.
+    uint32_t maxSetsPerFrame = 0;
+    uint32_t maxSetsPerThread = 0;
+    uint32_t maxPoolsPerThread = 0;
+  };
+
+  Stats getStats() const;
+  void reportStats(const char* name) const;
+
+private:
+  struct ThreadPools
+  {
+    // Every pool created so far, reused after each reset.
+    vector<VkDescriptorPool> pools;
+    uint32_t current = 0;
+    uint32_t sets = 0;
+    uint32_t failed = 0;
+  };
+
+  VkDescriptorPool createPool();
+
+  VkDevice device_;
+  uint32_t setsPerPool_;
+  // Indexed [frame][thread], pools are only ever touched by their thread.
+  vector<vector<ThreadPools>> pools_;
+  Stats stats_;
+};
+
+// Set layouts and long-lived descriptor sets, looked up by what they are
+// made of. Sets come from pools sized for their layout and stay until
+// shutdown(), only the render thread may call in.
+class JlVulkanDescriptorCache
+{
+public:
+  static void init(VkDevice device);
+  static void shutdown();
+
+  // The same bindings give the same layout. Owned until shutdown().
+  static VkDescriptorSetLayout getLayout(
+    const vector<VkDescriptorSetLayoutBinding>& bindings);
+
+  struct Write
+  {
+    uint32_t binding = 0;
+    VkDescriptorType type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    VkDescriptorBufferInfo buffer{};
+    VkDescriptorImageInfo image{};
+  };
+
+  // Allocated and written the first time, the layout must come from
+  // getLayout(). Sets still reference their resources after these are
+  // destroyed, so only resources living as long as the cache belong here.
+  static VkDescriptorSet getSet(VkDescriptorSetLayout layout,
+                                const vector<Write>& writes);
+
+  struct Stats
+  {
+    uint64_t layouts = 0;
+    uint64_t sets = 0;
+    uint64_t hits = 0;
+    // Different sets with the same hash, each still gets its own.
+    uint64_t collisions = 0;
+    uint64_t pools = 0;
+    uint32_t maxSetsPerLayout = 0;
+  };
+
+  static Stats getStats();
+  static void reportStats();
+
+  // The writes are kept to tell sets with the same hash apart.
+  struct CachedSet
+  {
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    vector<Write> writes;
+    VkDescriptorSet set = VK_NULL_HANDLE;
+  };
+
+  struct LayoutPools
+  {
+    vector<VkDescriptorPoolSize> setSizes;
+    vector<VkDescriptorPool> pools;
+    uint32_t sets = 0;
+    uint32_t capacity = 0;
+  };
+
+private:
+  static bool growPool(LayoutPools& layoutPools);
+};
@@ -0,0 +1,153 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#pragma once
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+// Every Vulkan entry point the renderer calls, by the level it is loaded
+// from. A function missing here has to be added before it can be called.
+#define JL_VULKAN_GLOBAL_FUNCTIONS(X)                                        \
+  X(vkCreateInstance)                                                        \
+  X(vkEnumerateInstanceExtensionProperties)                                  \
+  X(vkEnumerateInstanceLayerProperties)
+
+#define JL_VULKAN_INSTANCE_FUNCTIONS(X)                                      \
+  X(vkCreateDebugUtilsMessengerEXT)                                          \
+  X(vkCreateDevice)                                                          \
+  X(vkDestroyDebugUtilsMessengerEXT)                                         \
+  X(vkDestroyInstance)                                                       \
+  X(vkDestroySurfaceKHR)                                                     \
+  X(vkEnumerateDeviceExtensionProperties)                                    \
+  X(vkEnumeratePhysicalDevices)                                              \
+  X(vkGetDeviceProcAddr)                                                     \
+  X(vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)                          \
+  X(vkGetPhysicalDeviceFeatures)                                             \
+  X(vkGetPhysicalDeviceFeatures2)                                            \
+  X(vkGetPhysicalDeviceMemoryProperties)                                     \
+  X(vkGetPhysicalDeviceMemoryProperties2)                                    \
+  X(vkGetPhysicalDeviceProperties)                                           \
+  X(vkGetPhysicalDeviceProperties2)                                          \
+  X(vkGetPhysicalDeviceQueueFamilyProperties)                                \
+  X(vkGetPhysicalDeviceSurfaceCapabilitiesKHR)                               \
+  X(vkGetPhysicalDeviceSurfaceFormatsKHR)                                    \
+  X(vkGetPhysicalDeviceSurfacePresentModesKHR)                               \
+  X(vkGetPhysicalDeviceSurfaceSupportKHR)
+
+#define JL_VULKAN_DEVICE_FUNCTIONS(X)                                        \
+  X(vkAcquireNextImageKHR)                                                   \
+  X(vkAllocateCommandBuffers)                                                \
+  X(vkAllocateDescriptorSets)                                                \
+  X(vkAllocateMemory)                                                        \
+  X(vkBeginCommandBuffer)                                                    \
+  X(vkBindBufferMemory)                                                      \
+  X(vkBindImageMemory)                                                       \
+  X(vkCmdBeginRenderPass)                                                    \
+  X(vkCmdBeginRendering)                                                     \
+  X(vkCmdBindDescriptorSets)                                                 \
+  X(vkCmdBindIndexBuffer)                                                    \
+  X(vkCmdBindPipeline)                                                       \
+  X(vkCmdClearColorImage)                                                    \
+  X(vkCmdCopyBuffer)                                                         \
+  X(vkCmdCopyBufferToImage)                                                  \
+  X(vkCmdCopyImageToBuffer)                                                  \
+  X(vkCmdDispatch)                                                           \
+  X(vkCmdDraw)                                                               \
+  X(vkCmdDrawIndexed)                                                        \
+  X(vkCmdDrawIndexedIndirect)                                                \
+  X(vkCmdDrawIndexedIndirectCount)                                           \
+  X(vkCmdEndRenderPass)                                                      \
+  X(vkCmdEndRendering)                                                       \
+  X(vkCmdExecuteCommands)                                                    \
+  X(vkCmdFillBuffer)                                                         \
+  X(vkCmdPipelineBarrier)                                                    \
+  X(vkCmdPipelineBarrier2)                                                   \
+  X(vkCmdPushConstants)                                                      \
+  X(vkCmdResetQueryPool)                                                     \
+  X(vkCmdSetScissor)                                                         \
+  X(vkCmdSetViewport)                                                        \
+  X(vkCmdWriteTimestamp)                                                     \
+  X(vkCreateBuffer)                                                          \
+  X(vkCreateCommandPool)                                                     \
+  X(vkCreateComputePipelines)                                                \
+  X(vkCreateDescriptorPool)                                                  \
+  X(vkCreateDescriptorSetLayout)                                             \
+  X(vkCreateFence)                                                           \
+  X(vkCreateFramebuffer)                                                     \
+  X(vkCreateGraphicsPipelines)                                               \
+  X(vkCreateImage)                                                           \
+  X(vkCreateImageView)                                                       \
+  X(vkCreatePipelineCache)                                                   \
+  X(vkCreatePipelineLayout)                                                  \
+  X(vkCreateQueryPool)                                                       \
+  X(vkCreateRenderPass)                                                      \
+  X(vkCreateSemaphore)                                                       \
+  X(vkCreateShaderModule)                                                    \
+  X(vkCreateSwapchainKHR)                                                    \
+  X(vkDestroyBuffer)                                                         \
+  X(vkDestroyCommandPool)                                                    \
+  X(vkDestroyDescriptorPool)                                                 \
+  X(vkDestroyDescriptorSetLayout)                                            \
+  X(vkDestroyDevice)                                                         \
+  X(vkDestroyFence)                                                          \
+  X(vkDestroyFramebuffer)                                                    \
+  X(vkDestroyImage)                                                          \
+  X(vkDestroyImageView)                                                      \
+  X(vkDestroyPipeline)                                                       \
+  X(vkDestroyPipelineCache)                                                  \
+  X(vkDestroyPipelineLayout)                                                 \
+  X(vkDestroyQueryPool)                                                      \
+  X(vkDestroyRenderPass)                                                     \
+  X(vkDestroySampler)                                                        \
+  X(vkDestroySemaphore)                                                      \
+  X(vkDestroyShaderModule)                                                   \
+  X(vkDestroySwapchainKHR)                                                   \
+  X(vkDeviceWaitIdle)                                                        \
+  X(vkEndCommandBuffer)                                                      \
+  X(vkFreeCommandBuffers)                                                    \
+  X(vkFreeDescriptorSets)                                                    \
+  X(vkFreeMemory)                                                            \
+  X(vkGetBufferMemoryRequirements)                                           \
+  X(vkGetCalibratedTimestampsEXT)                                            \
+  X(vkGetDeviceQueue)                                                        \
+  X(vkGetImageMemoryRequirements)                                            \
+  X(vkGetPipelineCacheData)                                                  \
+  X(vkGetQueryPoolResults)                                                   \
+  X(vkGetSemaphoreCounterValue)                                              \
+  X(vkGetSwapchainImagesKHR)                                                 \
+  X(vkMapMemory)                                                             \
+  X(vkQueuePresentKHR)                                                       \
+  X(vkQueueSubmit)                                                           \
+  X(vkQueueSubmit2)                                                          \
+  X(vkResetCommandBuffer)                                                    \
+  X(vkResetCommandPool)                                                      \
+  X(vkResetDescriptorPool)                                                   \
+  X(vkResetFences)                                                           \
+  X(vkUnmapMemory)                                                           \
+  X(vkUpdateDescriptorSets)                                                  \
+  X(vkWaitForFences)                                                         \
+  X(vkWaitForPresentKHR)                                                     \
+  X(vkWaitSemaphores)
+
+// Function pointers the renderer calls Vulkan through. Only
+// vkGetInstanceProcAddr comes from the linked loader, instance functions
+// are looked up once the instance exists and device functions straight
+// from the driver with vkGetDeviceProcAddr, so vkCmd* calls skip the
+// loader's trampoline. Entry points the device doesn't have stay null,
+// callers check the capability that goes with them.
+class JlVulkanDispatch
+{
+public:
+#define JL_VULKAN_DECLARE_FUNCTION(name) PFN_##name name = nullptr;
+  JL_VULKAN_GLOBAL_FUNCTIONS(JL_VULKAN_DECLARE_FUNCTION)
+  JL_VULKAN_INSTANCE_FUNCTIONS(JL_VULKAN_DECLARE_FUNCTION)
+  JL_VULKAN_DEVICE_FUNCTIONS(JL_VULKAN_DECLARE_FUNCTION)
+#undef JL_VULKAN_DECLARE_FUNCTION
+
+  // Before the first Vulkan call.
+  static bool loadGlobal();
+  static bool loadInstance(VkInstance instance);
+  static bool loadDevice(VkDevice device);
+
+  static const JlVulkanDispatch& get();
+};
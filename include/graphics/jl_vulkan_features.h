@@ -0,0 +1,77 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#pragma once
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Decides what the logical device is created with. The whole features2
+// chain and the extension list are queried once, every optional fast path
+// the device supports is switched on, and which of them ended up active is
+// recorded in one place for the rest of the renderer to branch on.
+class JlVulkanFeatures
+{
+public:
+  struct Capabilities
+  {
+    uint32_t apiVersion = 0;
+
+    // GPU driven draws, with drawIndirectFirstInstance.
+    bool multiDrawIndirect = false;
+    bool drawIndirectCount = false;
+    bool timelineSemaphore = false;
+    bool synchronization2 = false;
+    // Without render pass or framebuffer objects.
+    bool dynamicRendering = false;
+    // Everything the bindless table needs.
+    bool descriptorIndexing = false;
+    bool bufferDeviceAddress = false;
+    // 8 and 16 bit types in storage buffers and shaders.
+    bool storage8Bit = false;
+    bool storage16Bit = false;
+    bool shaderInt8 = false;
+    bool shaderInt16 = false;
+    bool shaderFloat16 = false;
+    bool pipelineCreationFeedback = false;
+
+    bool memoryBudget = false;
+    bool calibratedTimestamps = false;
+    bool presentWait = false;
+    bool graphicsPipelineLibrary = false;
+  };
+
+  // What vkCreateDevice points into, has to stay where it is until the
+  // device was created.
+  struct DeviceSetup
+  {
+    VkPhysicalDeviceFeatures2 features{};
+    VkPhysicalDeviceVulkan11Features features11{};
+    VkPhysicalDeviceVulkan12Features features12{};
+    VkPhysicalDeviceVulkan13Features features13{};
+    VkPhysicalDevicePresentIdFeaturesKHR presentId{};
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWait{};
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipelineLibrary{};
+    vector<const char*> extensions;
+
+    DeviceSetup() = default;
+    DeviceSetup(const DeviceSetup&) = delete;
+    DeviceSetup& operator=(const DeviceSetup&) = delete;
+  };
+
+  // Fills in the features and extensions of createInfo. Required
+  // extensions are passed on as they are, optional ones are only added
+  // when supported. Present wait is only considered when presenting.
+  static void negotiate(VkPhysicalDevice physicalDevice,
+                        const vector<const char*>& requiredExtensions,
+                        bool presenting, DeviceSetup& setup,
+                        VkDeviceCreateInfo& createInfo);
+
+  // Valid once negotiate() was called.
+  static const Capabilities& get();
+  static void reportCapabilities();
+};
@@ -0,0 +1,70 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#pragma once
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+using namespace std;
+
+// Measures when presented frames reach the display through
+// VK_KHR_present_wait and, when pacing, holds back the start of the next
+// frame so at most one frame waits in the present queue. The start is
+// then pushed later while frames keep making their vblank and pulled back
+// as soon as one misses. Without present wait nothing is measured or paced.
+class JlVulkanFramePacer
+{
+public:
+  static void init(VkDevice device, bool presentWait);
+  static void shutdown();
+  static bool hasPresentWait();
+
+  // Present ids restart with every swap chain, presents still pending on
+  // the old one are dropped.
+  static void setSwapChain(VkSwapchainKHR swapChain, bool pacing);
+
+  // Before the frame's fence wait, blocks until the frame should start.
+  static void beginFrame();
+  // Right before the frame is submitted. Returns the present id to chain
+  // onto VkPresentInfoKHR, 0 without present wait.
+  static uint64_t markSubmit();
+  // The present with that id was rejected, it will never complete.
+  static void cancelPresent(uint64_t presentId);
+
+  struct Latency
+  {
+    uint32_t samples = 0;
+    double lastMs = 0.0;
+    double averageMs = 0.0;
+    double p50Ms = 0.0;
+    double p95Ms = 0.0;
+    double p99Ms = 0.0;
+  };
+
+  // Submit to present, over the last few hundred presented frames.
+  static Latency getLatency();
+  static void reportStats();
+
+  struct PendingPresent
+  {
+    uint64_t id;
+    double submitUs;
+  };
+
+  struct Stats
+  {
+    uint64_t presented = 0;
+    uint64_t missed = 0;
+    uint64_t pacedFrames = 0;
+    double delayMs = 0.0;
+    double waitMs = 0.0;
+  };
+
+private:
+  static void completePresent(const PendingPresent& present, double nowUs);
+  static double nowUs();
+};
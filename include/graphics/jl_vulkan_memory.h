@@ -0,0 +1,143 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#pragma once
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+class JlVulkanMemory
+{
+public:
+  // Buddy serves general purpose resources that are freed in any order.
+  // Linear bumps through a block and rewinds once all of its allocations are
+  // freed, which suits transient per-frame data.
+  enum Strategy { Buddy, Linear };
+
+  // Buffers and linear images never share a block with optimal images, so
+  // bufferImageGranularity can't be violated between neighbours.
+  enum ResourceClass { LinearResource, OptimalImage };
+
+  struct Block;
+
+  struct Allocation
+  {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* mapped = nullptr;
+    uint32_t memoryType = 0;
+    Block* block = nullptr;
+  };
+
+  struct Stats
+  {
+    uint32_t deviceAllocations = 0;
+    uint32_t blocks = 0;
+    uint32_t dedicatedAllocations = 0;
+    uint64_t allocations = 0;
+    VkDeviceSize blockBytes = 0;
+    VkDeviceSize usedBytes = 0;
+    VkDeviceSize reservedBytes = 0;
+    VkDeviceSize largestFreeRange = 0;
+    double fragmentation = 0.0;
+  };
+
+  struct HostStats
+  {
+    uint64_t allocations = 0;
+    uint64_t liveAllocations = 0;
+    size_t liveBytes = 0;
+    size_t peakBytes = 0;
+  };
+
+  static bool init(VkPhysicalDevice physicalDevice, VkDevice device);
+  static void shutdown();
+
+  static bool allocate(const VkMemoryRequirements& requirements,
+                       VkMemoryPropertyFlags requiredFlags,
+                       VkMemoryPropertyFlags preferredFlags,
+                       ResourceClass resourceClass, Strategy strategy,
+                       Allocation& allocation);
+  static void free(Allocation& allocation);
+
+  static VkResult createBuffer(const VkBufferCreateInfo& createInfo,
+                               VkMemoryPropertyFlags requiredFlags,
+                               VkMemoryPropertyFlags preferredFlags,
+                               Strategy strategy, VkBuffer* buffer,
+                               Allocation& allocation);
+  static void destroyBuffer(VkBuffer buffer, Allocation& allocation);
+
+  static VkResult createImage(const VkImageCreateInfo& createInfo,
+                              VkMemoryPropertyFlags requiredFlags,
+                              Strategy strategy, VkImage* image,
+                              Allocation& allocation);
+  static void destroyImage(VkImage image, Allocation& allocation);
+
+  static Stats getStats(uint32_t memoryType);
+  static Stats getTotalStats();
+  static void reportStats();
+
+  // Routes the driver's host allocations through engine tracked allocators.
+  // Pass it to every vkCreate*/vkDestroy* pair.
+  static const VkAllocationCallbacks* getAllocationCallbacks();
+  static HostStats getHostStats(VkSystemAllocationScope scope);
+
+  struct Block
+  {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    void* mapped = nullptr;
+    uint32_t memoryType = 0;
+    ResourceClass resourceClass = LinearResource;
+    Strategy strategy = Buddy;
+    bool dedicated = false;
+
+    // Buddy, free node offsets per level, level 0 is the whole block.
+    vector<set<VkDeviceSize>> freeNodes;
+    // Bytes reserved by each allocation, by offset.
+    unordered_map<VkDeviceSize, VkDeviceSize> usedNodes;
+
+    // Linear.
+    VkDeviceSize linearOffset = 0;
+
+    uint32_t allocations = 0;
+    VkDeviceSize usedBytes = 0;
+    VkDeviceSize reservedBytes = 0;
+  };
+
+private:
+  static uint32_t findMemoryType(uint32_t typeBits,
+                                 VkMemoryPropertyFlags requiredFlags,
+                                 VkMemoryPropertyFlags preferredFlags);
+  static VkDeviceSize getBlockSize(uint32_t memoryType);
+
+  static Block* createBlock(uint32_t memoryType, VkDeviceSize size,
+                            ResourceClass resourceClass, Strategy strategy,
+                            bool dedicated);
+  static void destroyBlock(Block* block);
+
+  static bool allocateFromBlock(Block& block, VkDeviceSize size,
+                                VkDeviceSize alignment, VkDeviceSize& offset,
+                                VkDeviceSize& reserved);
+  static void freeFromBlock(Block& block, VkDeviceSize offset);
+
+  static uint32_t getBuddyLevelCount(VkDeviceSize blockSize);
+  static VkDeviceSize getLargestFreeRange(const Block& block);
+
+  static void* VKAPI_CALL hostAllocate(void* userData, size_t size,
+                                       size_t alignment,
+                                       VkSystemAllocationScope scope);
+  static void* VKAPI_CALL hostReallocate(void* userData, void* original,
+                                         size_t size, size_t alignment,
+                                         VkSystemAllocationScope scope);
+  static void VKAPI_CALL hostFree(void* userData, void* memory);
+};
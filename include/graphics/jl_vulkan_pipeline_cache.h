@@ -0,0 +1,62 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#pragma once
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class JlVulkanPipelineCache
+{
+public:
+  static bool load(VkPhysicalDevice physicalDevice, VkDevice device);
+  static void save();
+  static void destroy();
+
+  static VkPipelineCache get();
+
+  static VkResult createGraphicsPipeline(
+    const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline* pipeline);
+  static VkResult createComputePipeline(
+    const VkComputePipelineCreateInfo& createInfo, VkPipeline* pipeline);
+
+  struct Stats
+  {
+    bool warmStart = false;
+    size_t loadedBytes = 0;
+    double loadMs = 0.0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    double createMs = 0.0;
+  };
+
+  static const Stats& getStats();
+  static void reportStats();
+
+private:
+  // Prefixed to the driver blob on disk. The driver's own header carries no
+  // driver version, so a driver update would otherwise go unnoticed.
+  struct FileHeader
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+    uint64_t dataHash;
+  };
+
+  static void countFeedback(const VkPipelineCreationFeedback& feedback);
+  static string getCachePath();
+  static bool readCacheFile(const string& filename, vector<char>& data);
+  static bool isHeaderValid(const FileHeader& header,
+                            const vector<char>& data);
+  static uint64_t hashData(const void* data, size_t size);
+};
@@ -0,0 +1,160 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#pragma once
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Graphics pipelines looked up by a hash of the state they are built from.
+// A state seen for the first time is compiled on worker threads while the
+// render thread carries on, its draws use a registered fallback pipeline
+// or are skipped until the pipeline is ready. Only the render thread may
+// call anything but the workers' own compile tasks.
+//
+// With VK_EXT_graphics_pipeline_library the vertex input, pre-rasterization,
+// fragment shader and fragment output parts are compiled once each and
+// shared between states. A state whose parts are all known is fast-linked
+// on the spot, and the link time optimized pipeline replaces it once a
+// worker has built it.
+class JlVulkanPipelineCompiler
+{
+public:
+  using Key = uint64_t;
+
+  // Everything that goes into a pipeline. Viewport and scissor are always
+  // dynamic, without a render pass the pipeline is for dynamic rendering
+  // into the given formats.
+  struct GraphicsState
+  {
+    VkShaderModule vertexShader = VK_NULL_HANDLE;
+    VkShaderModule fragmentShader = VK_NULL_HANDLE;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+
+    vector<VkVertexInputBindingDescription> vertexBindings;
+    vector<VkVertexInputAttributeDescription> vertexAttributes;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+    bool depthTest = false;
+    bool depthWrite = false;
+    VkCompareOp depthCompare = VK_COMPARE_OP_LESS;
+
+    bool blend = false;
+    VkBlendFactor srcColorFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    VkBlendFactor dstColorFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    VkBlendOp colorOp = VK_BLEND_OP_ADD;
+
+    vector<VkFormat> colorFormats;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+  };
+
+  static void init(VkDevice device, uint32_t workerCount,
+                   bool pipelineLibrary);
+  // Waits for compiles still running, then destroys every pipeline and
+  // shader module.
+  static void shutdown();
+
+  // Identical code gives the same module, so module handles can stand in
+  // for their code in the hash. Owned until shutdown().
+  static VkShaderModule loadShader(const vector<char>& code);
+
+  static Key getKey(const GraphicsState& state);
+
+  // Compiled right away, for draws whose own pipeline isn't ready yet.
+  static Key registerFallback(const GraphicsState& state);
+
+  // The pipeline if it is ready. Otherwise its compile is queued and the
+  // fallback is returned, or VK_NULL_HANDLE to skip the draw.
+  static VkPipeline getPipeline(const GraphicsState& state, Key fallback = 0);
+  static bool isReady(const GraphicsState& state);
+  static bool usesPipelineLibrary();
+
+  // Once per frame on the render thread, picks up finished compiles.
+  static void beginFrame();
+
+  struct Stats
+  {
+    uint64_t requests = 0;
+    uint64_t queued = 0;
+    uint64_t compiled = 0;
+    uint64_t failed = 0;
+    double compileMs = 0.0;
+    double maxCompileMs = 0.0;
+    uint32_t queueDepth = 0;
+    uint32_t maxQueueDepth = 0;
+    uint64_t fallbackDraws = 0;
+    uint64_t skippedDraws = 0;
+    uint64_t frames = 0;
+    uint64_t fallbackFrames = 0;
+    // Pipeline library path only.
+    uint64_t libraryParts = 0;
+    uint64_t fastLinks = 0;
+    double fastLinkMs = 0.0;
+    double maxFastLinkMs = 0.0;
+    uint64_t optimizedLinks = 0;
+    double optimizedLinkMs = 0.0;
+    uint32_t pendingOptimizations = 0;
+  };
+
+  static Stats getStats();
+  static void reportStats();
+
+  enum Status
+  {
+    Compiling,
+    Ready,
+    Failed
+  };
+
+  struct Entry
+  {
+    Status status = Compiling;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    // False while a fast-linked pipeline waits for its optimized link.
+    bool optimized = true;
+  };
+
+  struct Compiled
+  {
+    Key key;
+    VkPipeline pipeline;
+    double compileMs;
+    bool optimized;
+  };
+
+  enum LibraryPart
+  {
+    VertexInputPart,
+    PreRasterizationPart,
+    FragmentShaderPart,
+    FragmentOutputPart,
+    LibraryPartCount
+  };
+
+private:
+  static void collectCompiled();
+  // Given parts, builds a pipeline library of only those parts.
+  static VkResult buildPipeline(const GraphicsState& state,
+                                VkPipeline* pipeline,
+                                VkGraphicsPipelineLibraryFlagsEXT parts = 0);
+
+  static Key getLibraryKey(LibraryPart part, const GraphicsState& state);
+  // Looks up the parts of a state, building missing ones if asked to.
+  static bool findLibraries(const GraphicsState& state, bool build,
+                            VkPipeline libraries[LibraryPartCount]);
+  static VkResult linkLibraries(const GraphicsState& state,
+                                const VkPipeline libraries[LibraryPartCount],
+                                bool optimized, VkPipeline* pipeline);
+  // On a worker, hands the link time optimized pipeline to beginFrame().
+  static void linkOptimized(Key key, const GraphicsState& state,
+                            const VkPipeline libraries[LibraryPartCount]);
+};
@@ -0,0 +1,100 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#pragma once
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace filesystem;
+
+// GPU timestamps around named scopes of the frame's primary command buffer.
+// Every frame gets its own query pool from a ring, results are read back
+// without waiting once the ring comes around again, at least two frames
+// later. Only the render thread may record scopes.
+class JlVulkanProfiler
+{
+public:
+  static bool init(VkPhysicalDevice physicalDevice, VkDevice device,
+                   uint32_t queueFamily, uint32_t framesInFlight,
+                   bool calibratedTimestamps);
+  static void shutdown();
+  static bool isEnabled();
+
+  // Right after vkBeginCommandBuffer, before any scope.
+  static void beginFrame(VkCommandBuffer commandBuffer);
+  // Right after the frame was submitted.
+  static void endFrame();
+
+  static uint32_t beginScope(VkCommandBuffer commandBuffer, const string& name);
+  static void endScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+  class Scope
+  {
+  public:
+    Scope(VkCommandBuffer commandBuffer, const string& name);
+    ~Scope();
+
+  private:
+    VkCommandBuffer commandBuffer_;
+    uint32_t scope_;
+  };
+
+  struct Timings
+  {
+    uint32_t samples = 0;
+    double averageMs = 0.0;
+    double p50Ms = 0.0;
+    double p95Ms = 0.0;
+    double p99Ms = 0.0;
+  };
+
+  // Over the last few hundred frames the scope was recorded in.
+  static bool getTimings(const string& name, Timings& timings);
+  static void reportStats();
+  // Keeps every resolved scope for exportTrace(), off by default.
+  static void setTracing(bool enabled);
+  static bool exportTrace(const path& file);
+
+  struct ScopeRecord
+  {
+    uint32_t name;
+    uint32_t beginQuery;
+    uint32_t endQuery;
+  };
+
+  struct FrameQueries
+  {
+    VkQueryPool pool = VK_NULL_HANDLE;
+    vector<ScopeRecord> scopes;
+    uint32_t queryCount = 0;
+    bool pending = false;
+    double cpuBeginUs = 0.0;
+    double cpuSubmitUs = 0.0;
+  };
+
+  struct History
+  {
+    string name;
+    vector<double> samples;
+    uint32_t next = 0;
+  };
+
+  struct TraceEvent
+  {
+    uint32_t name;
+    double startUs;
+    double durationUs;
+    uint32_t thread;
+  };
+
+private:
+  static void resolve(FrameQueries& frame);
+  static void calibrate();
+  static double nowUs();
+};
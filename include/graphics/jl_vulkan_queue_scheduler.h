@@ -0,0 +1,85 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#pragma once
+#include "graphics/jl_vulkan_render_graph.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Submits the batches of a compiled render graph to the graphics and async
+// compute queues in schedule order. Every queue has a timeline semaphore,
+// batches another queue waits on signal the next value and the wait turns
+// into a timeline wait. Each batch is bracketed by timestamps so the busy
+// time of each queue can be reported. Timestamps of different queues aren't
+// comparable, overlap is only seen in the frame time.
+// Without a separate compute family nothing is created and graphs compile
+// to a single batch the caller submits itself.
+class JlVulkanQueueScheduler
+{
+public:
+  static bool init(VkPhysicalDevice physicalDevice, VkDevice device,
+                   uint32_t graphicsFamily, VkQueue graphicsQueue,
+                   uint32_t computeFamily, VkQueue computeQueue,
+                   uint32_t framesInFlight, bool synchronization2);
+  static void shutdown();
+  static bool isEnabled();
+  // VK_QUEUE_FAMILY_IGNORED while disabled, for
+  // JlVulkanRenderGraph::setQueueFamilies().
+  static uint32_t getComputeFamily();
+
+  struct FrameSubmit
+  {
+    // Begun, with whatever precedes the graph recorded. Takes the first
+    // graphics batch and is ended here.
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    // Waited on by the first graphics batch. Timeline waits, the ones with
+    // a value, also by the first compute batch. Signaled by the last batch.
+    vector<VkSemaphoreSubmitInfo> waits;
+    vector<VkSemaphoreSubmitInfo> signals;
+    VkFence fence = VK_NULL_HANDLE;
+    // Set by submit(), whether the graphics batch with the binary waits
+    // reached the queue before a failure.
+    bool waitsSubmitted = false;
+  };
+
+  // Once the frame slot's fence was waited on. Reads back the slot's
+  // timestamps and recycles its command buffers.
+  static void beginFrame(uint32_t frame);
+  static VkResult submit(JlVulkanRenderGraph& graph, uint32_t frame,
+                         FrameSubmit& frameSubmit);
+
+  struct Stats
+  {
+    uint64_t frames = 0;
+    double graphicsMs = 0.0;
+    double computeMs = 0.0;
+  };
+
+  static Stats getStats();
+  static void resetStats();
+  static void reportStats();
+
+  struct QueueFrame
+  {
+    VkCommandPool commandPools[2] = {};
+    vector<VkCommandBuffer> commandBuffers[2];
+    uint32_t usedCommandBuffers[2] = {};
+    VkQueryPool queryPools[2] = {};
+    uint32_t queryCounts[2] = {};
+    // Compute timeline value of the slot's last compute batch.
+    uint64_t computeValue = 0;
+    bool pending = false;
+  };
+
+private:
+  static VkCommandBuffer nextCommandBuffer(QueueFrame& frame, uint32_t queue);
+  static VkResult submitBatch(uint32_t queue, VkCommandBuffer commandBuffer,
+                              VkFence fence);
+  static void resolve(QueueFrame& frame);
+};
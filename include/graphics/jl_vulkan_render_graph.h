@@ -0,0 +1,275 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#pragma once
+#include "graphics/jl_vulkan_memory.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Passes are declared in submission order together with the resources they
+// read and write. compile() culls passes whose results are never consumed,
+// works out the barriers between the survivors and places transient
+// resources with disjoint lifetimes in the same memory. Passes put on the
+// async compute queue are split into batches, and the semaphore waits and
+// queue family ownership transfers between them are derived from the same
+// resource uses.
+class JlVulkanRenderGraph
+{
+public:
+  using ResourceHandle = uint32_t;
+  using ExecuteCallback = function<void(VkCommandBuffer commandBuffer)>;
+
+  enum Access
+  {
+    ColorAttachment,
+    DepthAttachment,
+    DepthRead,
+    SampledGraphics,
+    SampledCompute,
+    StorageRead,
+    StorageWrite,
+    TransferSrc,
+    TransferDst,
+    VertexBuffer,
+    IndexBuffer,
+    IndirectBuffer,
+    UniformBuffer
+  };
+
+  enum Queue
+  {
+    GraphicsQueue,
+    ComputeQueue
+  };
+
+  struct ImageDesc
+  {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent = { 0, 0 };
+    VkImageUsageFlags usage = 0;
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+  };
+
+  struct Stats
+  {
+    uint32_t passes = 0;
+    uint32_t culledPasses = 0;
+    uint32_t barriers = 0;
+    uint32_t barrierBatches = 0;
+    // One barrier per resource use, what a graph-less renderer would emit.
+    uint32_t naiveBarriers = 0;
+    uint32_t transientResources = 0;
+    uint32_t aliasSlots = 0;
+    VkDeviceSize transientBytes = 0;
+    VkDeviceSize aliasedBytes = 0;
+    uint32_t batches = 0;
+    uint32_t queueTransfers = 0;
+    uint32_t crossQueueWaits = 0;
+  };
+
+  // Consecutive scheduled passes on the same queue, submitted together.
+  struct Batch
+  {
+    Queue queue = GraphicsQueue;
+    uint32_t firstPass = 0;
+    uint32_t passCount = 0;
+    // Earlier batch on the other queue that has to finish first, UINT32_MAX
+    // when there is none. Waiting on the latest one covers everything the
+    // other queue was given before it.
+    uint32_t waitBatch = UINT32_MAX;
+    VkPipelineStageFlags2 waitStages = VK_PIPELINE_STAGE_2_NONE;
+    // A later batch waits on this one.
+    bool signals = false;
+  };
+
+  JlVulkanRenderGraph(VkDevice device, bool synchronization2);
+  ~JlVulkanRenderGraph();
+
+  JlVulkanRenderGraph(const JlVulkanRenderGraph&) = delete;
+  JlVulkanRenderGraph& operator=(const JlVulkanRenderGraph&) = delete;
+
+  // Transient resources live only inside the graph and may share memory.
+  ResourceHandle createImage(const string& name, const ImageDesc& desc);
+  ResourceHandle createBuffer(const string& name, VkDeviceSize size,
+                              VkBufferUsageFlags usage);
+
+  // Imported resources outlive the graph, anything writing them is kept.
+  // The handle can be swapped every frame without recompiling.
+  ResourceHandle importImage(const string& name, VkImageAspectFlags aspect,
+                             VkImageLayout initialLayout,
+                             VkPipelineStageFlags2 initialStages,
+                             VkImageLayout finalLayout);
+  ResourceHandle importBuffer(const string& name, VkBuffer buffer);
+  void setImportedImage(ResourceHandle resource, VkImage image);
+  void setImportedBuffer(ResourceHandle resource, VkBuffer buffer);
+
+  uint32_t addPass(const string& name, ExecuteCallback execute);
+  void read(uint32_t pass, ResourceHandle resource, Access access);
+  void write(uint32_t pass, ResourceHandle resource, Access access);
+  // Keeps a pass even though nothing in the graph consumes its output.
+  void setSideEffects(uint32_t pass);
+  // Compute passes only, they stay on the graphics queue unless the device
+  // has a separate compute family. Imported resources an async pass touches
+  // first carry nothing over from before the graph, whatever the graph hands
+  // over between queues keeps its contents.
+  void setQueue(uint32_t pass, Queue queue);
+  // Without a compute family, or the same one as graphics, every pass
+  // runs on the graphics queue.
+  void setQueueFamilies(uint32_t graphicsFamily, uint32_t computeFamily);
+  bool hasAsyncCompute() const;
+  uint32_t getQueueFamily(Queue queue) const;
+
+  bool compile();
+  // Records every batch into one command buffer, only valid while the
+  // graph has a single batch.
+  void execute(VkCommandBuffer commandBuffer);
+  // Each batch goes to a command buffer of its own queue, the last one
+  // also returns imported resources to their final layout and queue.
+  void executeBatch(uint32_t batch, VkCommandBuffer commandBuffer);
+  const vector<Batch>& getBatches() const;
+  // Drops every pass and resource, transient memory is released through
+  // the GPU timeline so in flight frames can still use it.
+  void reset();
+
+  VkImage getImage(ResourceHandle resource) const;
+  VkImageView getImageView(ResourceHandle resource) const;
+  VkBuffer getBuffer(ResourceHandle resource) const;
+
+  Stats getStats() const;
+  void dumpSchedule() const;
+
+private:
+  struct AccessInfo
+  {
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+    VkImageLayout layout;
+  };
+
+  struct ResourceUse
+  {
+    ResourceHandle resource;
+    AccessInfo info;
+    bool write;
+  };
+
+  struct Barrier
+  {
+    ResourceHandle resource;
+    VkPipelineStageFlags2 srcStages;
+    VkAccessFlags2 srcAccess;
+    VkPipelineStageFlags2 dstStages;
+    VkAccessFlags2 dstAccess;
+    VkImageLayout oldLayout;
+    VkImageLayout newLayout;
+    uint32_t srcFamily = VK_QUEUE_FAMILY_IGNORED;
+    uint32_t dstFamily = VK_QUEUE_FAMILY_IGNORED;
+  };
+
+  struct Pass
+  {
+    string name;
+    ExecuteCallback execute;
+    vector<ResourceUse> uses;
+    vector<Barrier> barriers;
+    // Ownership releases recorded after the pass, to the other queue.
+    vector<Barrier> releases;
+    Queue queue = GraphicsQueue;
+    uint32_t batch = 0;
+    bool sideEffects = false;
+    bool culled = false;
+  };
+
+  struct Resource
+  {
+    string name;
+    bool isImage = true;
+    bool imported = false;
+
+    ImageDesc imageDesc;
+    VkDeviceSize bufferSize = 0;
+    VkBufferUsageFlags bufferUsage = 0;
+
+    VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags2 initialStages = VK_PIPELINE_STAGE_2_NONE;
+    VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView imageView = VK_NULL_HANDLE;
+    VkBuffer buffer = VK_NULL_HANDLE;
+
+    VkMemoryRequirements requirements{};
+    uint32_t firstUse = UINT32_MAX;
+    uint32_t lastUse = 0;
+    uint32_t aliasSlot = UINT32_MAX;
+    // Resource that occupied the same memory right before this one.
+    ResourceHandle aliasPrevious = UINT32_MAX;
+  };
+
+  struct AliasSlot
+  {
+    JlVulkanMemory::Allocation allocation;
+    VkMemoryRequirements requirements{};
+    bool isImage = true;
+    vector<ResourceHandle> resources;
+  };
+
+  // Synchronization state of a resource while walking the schedule.
+  struct ResourceState
+  {
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags2 writeStages = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+    VkPipelineStageFlags2 readStages = VK_PIPELINE_STAGE_2_NONE;
+    // Stages the last write has already been made visible to.
+    VkPipelineStageFlags2 visibleStages = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 visibleAccess = VK_ACCESS_2_NONE;
+    bool used = false;
+    // Where the resource was last touched. Without a last pass the
+    // contents don't matter, only the memory has to be free.
+    Queue queue = GraphicsQueue;
+    uint32_t batch = 0;
+    uint32_t lastPass = UINT32_MAX;
+  };
+
+  static AccessInfo getAccessInfo(Access access, bool isImage);
+
+  void addUse(uint32_t pass, ResourceHandle resource, Access access,
+              bool write);
+  void cullPasses();
+  void buildBatches();
+  void computeLifetimes();
+  void computeBarriers();
+  bool allocateTransients();
+  void destroyTransients();
+  void recordBarriers(VkCommandBuffer commandBuffer,
+                      const vector<Barrier>& barriers);
+
+  VkDevice device_;
+  bool synchronization2_;
+  bool compiled_ = false;
+  uint32_t graphicsFamily_ = VK_QUEUE_FAMILY_IGNORED;
+  uint32_t computeFamily_ = VK_QUEUE_FAMILY_IGNORED;
+
+  vector<Resource> resources_;
+  vector<Pass> passes_;
+  vector<uint32_t> schedule_;
+  vector<Batch> batches_;
+  vector<Barrier> finalBarriers_;
+  vector<AliasSlot> aliasSlots_;
+  Stats stats_;
+
+  // Reused between frames so execute() doesn't allocate.
+  vector<VkImageMemoryBarrier2> imageBarriers_;
+  vector<VkBufferMemoryBarrier2> bufferBarriers_;
+  vector<VkImageMemoryBarrier> legacyImageBarriers_;
+  vector<VkBufferMemoryBarrier> legacyBufferBarriers_;
+};
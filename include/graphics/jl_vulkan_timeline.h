@@ -0,0 +1,84 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#pragma once
+#include "graphics/jl_vulkan_memory.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <functional>
+
+using namespace std;
+
+// Tracks graphics queue progress as a monotonically increasing value and
+// defers resource destruction until the GPU has moved past it. Without
+// timeline semaphore support progress is only learned from frame fences.
+class JlVulkanTimeline
+{
+public:
+  static bool init(VkDevice device, bool timelineSemaphores);
+  // Destroys everything still queued, the device must be idle.
+  static void shutdown();
+
+  static VkSemaphore getSemaphore();
+
+  // Value the next graphics submission will signal. Resources referenced
+  // by commands being recorded now are safe to destroy once it completes.
+  static uint64_t getPendingValue();
+  // Claims the pending value for a submission and returns it.
+  static uint64_t advance();
+
+  static uint64_t getCompletedValue();
+  static void markCompleted(uint64_t value);
+  static bool wait(uint64_t value, uint64_t timeout = UINT64_MAX);
+
+  static void destroyBuffer(VkBuffer buffer,
+                            JlVulkanMemory::Allocation& allocation);
+  static void destroyImage(VkImage image,
+                           JlVulkanMemory::Allocation& allocation);
+  static void destroyImageView(VkImageView imageView);
+  static void destroyFramebuffer(VkFramebuffer framebuffer);
+  static void destroySampler(VkSampler sampler);
+  static void destroyPipeline(VkPipeline pipeline);
+  static void destroyPipelineLayout(VkPipelineLayout pipelineLayout);
+  static void destroyLater(function<void()> destroy);
+
+  // Destroys everything whose timeline value has completed.
+  static void collect();
+  static void reportStats();
+
+  enum ResourceType
+  {
+    Buffer,
+    Image,
+    ImageView,
+    Framebuffer,
+    Sampler,
+    Pipeline,
+    PipelineLayout,
+    Callback
+  };
+
+  struct PendingDestroy
+  {
+    ResourceType type;
+    uint64_t handle;
+    JlVulkanMemory::Allocation allocation;
+    function<void()> callback;
+    uint64_t value;
+  };
+
+  struct Stats
+  {
+    uint64_t deferred = 0;
+    uint64_t destroyed = 0;
+    uint64_t peakQueued = 0;
+    uint64_t cpuWaits = 0;
+  };
+
+private:
+  static void enqueue(PendingDestroy&& pending);
+  static void destroy(PendingDestroy& pending);
+};
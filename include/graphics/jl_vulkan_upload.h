@@ -0,0 +1,83 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#pragma once
+#include "graphics/jl_vulkan_memory.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+using namespace std;
+
+// Streams data to device local resources through a persistently mapped
+// staging ring. Copies are batched and only submitted on flush(), which is
+// expected to be called from the render thread once per frame.
+class JlVulkanUploader
+{
+public:
+  static bool init(VkDevice device, VkQueue transferQueue,
+                   uint32_t transferFamily, uint32_t graphicsFamily,
+                   VkDeviceSize ringSize);
+  static void shutdown();
+
+  // Returns the timeline value that signals once the copy is done, 0 on
+  // failure. The data is copied into the ring before returning.
+  static uint64_t uploadBuffer(VkBuffer buffer, VkDeviceSize offset,
+                               const void* data, VkDeviceSize size);
+  static uint64_t uploadImage(VkImage image, VkImageAspectFlags aspect,
+                              VkExtent3D extent, VkImageLayout finalLayout,
+                              const void* data, VkDeviceSize size);
+
+  static uint64_t flush();
+
+  // Records the queue family acquire half of every ownership transfer
+  // flushed so far into a graphics command buffer, and returns the timeline
+  // value the graphics submit must wait on (0 when there is nothing new).
+  static uint64_t recordGraphicsAcquire(VkCommandBuffer commandBuffer);
+
+  static bool isComplete(uint64_t value);
+  static void wait(uint64_t value);
+
+  static VkSemaphore getTimeline();
+  static bool hasDedicatedQueue();
+  static void reportStats();
+
+  struct Stats
+  {
+    uint64_t bytes = 0;
+    uint64_t copies = 0;
+    uint64_t submissions = 0;
+    uint64_t ringStalls = 0;
+  };
+
+  struct BufferCopy
+  {
+    VkBuffer buffer;
+    VkBufferCopy region;
+  };
+
+  struct ImageCopy
+  {
+    VkImage image;
+    VkImageAspectFlags aspect;
+    VkImageLayout finalLayout;
+    VkBufferImageCopy region;
+  };
+
+  struct Batch
+  {
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkDeviceSize ringEnd = 0;
+    uint64_t value = 0;
+  };
+
+private:
+  static bool reserve(VkDeviceSize size, VkDeviceSize alignment,
+                      VkDeviceSize& offset);
+  static void reclaim(bool waitForOldest);
+  static VkCommandBuffer getCommandBuffer();
+};
@@ -4,8 +4,61 @@
 #pragma once
 #include "defines.h"
 
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace filesystem;
+
 class JlVulkanShaders
 {
 public:
+  enum Stage
+  {
+    Vertex,
+    TessControl,
+    TessEvaluation,
+    Geometry,
+    Fragment,
+    Compute,
+    UnknownStage
+  };
+
+  // One message from the compiler or the validator.
+  struct Diagnostic
+  {
+    enum Severity { Error, Warning };
+
+    Severity severity = Error;
+    string file;
+    // 0 when the message isn't tied to a source line.
+    uint32_t line = 0;
+    string message;
+  };
+
+  // Compiles every shader in the shaders directory whose source or
+  // includes changed since it was last compiled, then validates the
+  // binaries that weren't validated yet. Files without a stage extension
+  // are headers, only compiled as part of the shaders including them.
   JLEngine_API static bool compile();
-};
\ No newline at end of file
+
+  // GLSL from memory to validated SPIR-V, in-process. #include is resolved
+  // against the shaders directory, relative to name, and every file pulled
+  // in is added to includes, sorted and relative to the shaders directory.
+  JLEngine_API static bool compileSource(const string& source,
+                                         const string& name, Stage stage,
+                                         vector<uint32_t>& spirv,
+                                         vector<Diagnostic>& diagnostics,
+                                         vector<string>* includes = nullptr);
+  JLEngine_API static bool validate(const vector<uint32_t>& spirv,
+                                    const string& name,
+                                    vector<Diagnostic>& diagnostics);
+
+  // From the file extension, .vert, .frag, .comp and so on. Anything else
+  // is a header.
+  JLEngine_API static Stage getStage(const path& file);
+  JLEngine_API static void reportDiagnostics(
+    const vector<Diagnostic>& diagnostics);
+};
@@ -0,0 +1,32 @@
+#version 450
+
+struct Instance {
+    vec4 sphere;
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint padding;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances {
+    Instance instances[];
+};
+
+layout(push_constant) uniform Draw {
+    mat4 viewProjection;
+};
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    Instance instance = instances[gl_InstanceIndex];
+
+    // Unit cube corners from the vertex index, bit n picks the axis side.
+    vec3 corner = vec3(gl_VertexIndex & 1, (gl_VertexIndex >> 1) & 1,
+                       (gl_VertexIndex >> 2) & 1);
+    vec3 position = instance.sphere.xyz +
+                    (corner * 2.0 - 1.0) * instance.sphere.w * 0.57735;
+
+    gl_Position = viewProjection * vec4(position, 1.0);
+    fragColor = mix(vec3(0.2, 0.4, 0.8), vec3(1.0, 0.6, 0.2), corner);
+}
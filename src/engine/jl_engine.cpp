@@ -14,6 +14,20 @@
 void JlEngine::Init() {
   bool shaderCompile = JlVulkanShaders::compile();
 
+  if (JlEngineSettings::headless) {
+    bool result = JlGraphics::initGraphicsAPI(
+      nullptr, JlGraphics::JlGraphicsAPI::Vulkan);
+
+    for (uint64_t frame = 0;
+         result && (JlEngineSettings::maxFrames == 0 ||
+                    frame < JlEngineSettings::maxFrames);
+         frame++)
+      JlGraphics::drawFrame();
+
+    JlGraphics::shutdownGraphicsAPI();
+    return;
+  }
+
   JlWindow* window = new JlWindow(1280, 720, "JLE_APP");
   bool result = JlGraphics::initGraphicsAPI(
     window->getWindowPtr(), JlGraphics::JlGraphicsAPI::Vulkan);
@@ -35,6 +49,24 @@ path JlEngineDirectories::toolsDir = "";
 path JlEngineDirectories::shadersDir = "";
 path JlEngineDirectories::compiledShadersDir = "";
 
+uint32_t JlEngineSettings::framesInFlight = 2;
+uint64_t JlEngineSettings::maxFrames = 0;
+uint32_t JlEngineSettings::recordWorkers = 0;
+uint32_t JlEngineSettings::shaderWorkers = 0;
+bool JlEngineSettings::runBenchmarks = false;
+bool JlEngineSettings::gpuProfiling = true;
+string JlEngineSettings::gpuTraceFile = "";
+JlEngineSettings::PresentPolicy JlEngineSettings::presentPolicy =
+  JlEngineSettings::LowLatency;
+uint32_t JlEngineSettings::swapChainImages = 0;
+bool JlEngineSettings::legacyRenderPasses = false;
+bool JlEngineSettings::pipelineLibraries = true;
+string JlEngineSettings::gpuOverride = "";
+bool JlEngineSettings::headless = false;
+uint32_t JlEngineSettings::headlessWidth = 1280;
+uint32_t JlEngineSettings::headlessHeight = 720;
+uint32_t JlEngineSettings::readbackInterval = 0;
+
 void JlEngineDirectories::setEngineDirectory(const string& path) {
   engineDir = path;
   toolsDir = path + "/tools/";
@@ -2,7 +2,9 @@
 //-----------------------------------
 
 #include "defines.h"
+#include "engine/jl_engine.h"
 #include "engine/jl_window.h"
+#include "graphics/jl_graphics.h"
 
 #include <GLFW/glfw3.h>
 
@@ -16,7 +18,7 @@ JlWindow::JlWindow(uint32_t width, uint32_t height, string title) {
   glfwInit();
 
   glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-  glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+  glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
   width_ = width;
   height_ = height;
@@ -44,8 +46,21 @@ void JlWindow::startUpdates() {
   cout << JlEngineReports::jlWindow
     << "Window started updates." << endl;
 
+  uint64_t frameCount = 0;
   while (!glfwWindowShouldClose(window_)) {
+    // Nothing is drawn while minimized, sleep until something happens.
+    if (glfwGetWindowAttrib(window_, GLFW_ICONIFIED)) {
+      glfwWaitEvents();
+      continue;
+    }
+
     glfwPollEvents();
+    JlGraphics::drawFrame();
+
+    frameCount++;
+    if (JlEngineSettings::maxFrames > 0 &&
+        frameCount >= JlEngineSettings::maxFrames)
+      glfwSetWindowShouldClose(window_, GLFW_TRUE);
   }
 }
 
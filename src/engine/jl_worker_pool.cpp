@@ -0,0 +1,120 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#include "engine/jl_worker_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+JlWorkerPool::JlWorkerPool(uint32_t workerCount) {
+  workerCount = max(workerCount, 1u);
+
+  threads_.reserve(workerCount);
+  for (uint32_t i = 0; i < workerCount; i++)
+    threads_.emplace_back(&JlWorkerPool::workerLoop, this, i);
+}
+
+JlWorkerPool::~JlWorkerPool() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+
+  for (thread& worker : threads_) worker.join();
+}
+
+void JlWorkerPool::parallelFor(
+  uint32_t count, const function<void(uint32_t index, uint32_t worker)>& job) {
+  if (count == 0) return;
+
+  unique_lock<mutex> lock(mutex_);
+  job_ = &job;
+  jobCount_ = count;
+  nextIndex_ = 0;
+  busyWorkers_ = static_cast<uint32_t>(threads_.size());
+  generation_++;
+  wake_.notify_all();
+
+  done_.wait(lock, [this] { return busyWorkers_ == 0; });
+  job_ = nullptr;
+}
+
+void JlWorkerPool::submit(function<void(uint32_t worker)> task) {
+  {
+    lock_guard<mutex> lock(mutex_);
+    tasks_.push_back(move(task));
+  }
+  wake_.notify_one();
+}
+
+uint32_t JlWorkerPool::getPendingTasks() {
+  lock_guard<mutex> lock(mutex_);
+  return static_cast<uint32_t>(tasks_.size()) + runningTasks_;
+}
+
+void JlWorkerPool::waitIdle() {
+  unique_lock<mutex> lock(mutex_);
+  idle_.wait(lock, [this] { return tasks_.empty() && runningTasks_ == 0; });
+}
+
+uint32_t JlWorkerPool::getWorkerCount() const {
+  return static_cast<uint32_t>(threads_.size());
+}
+
+uint32_t JlWorkerPool::getDefaultWorkerCount() {
+  uint32_t hardwareThreads = thread::hardware_concurrency();
+  // Leave a core for the thread that submits the work.
+  return hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+}
+
+void JlWorkerPool::workerLoop(uint32_t worker) {
+  uint64_t seenGeneration = 0;
+
+  while (true) {
+    const function<void(uint32_t, uint32_t)>* job;
+    uint32_t jobCount;
+    {
+      unique_lock<mutex> lock(mutex_);
+      wake_.wait(lock, [&] {
+        return stopping_ || generation_ != seenGeneration || !tasks_.empty();
+      });
+      if (stopping_) return;
+
+      // A parallelFor() waits on every worker, it goes ahead of tasks.
+      if (generation_ == seenGeneration) {
+        function<void(uint32_t)> task = move(tasks_.front());
+        tasks_.pop_front();
+        runningTasks_++;
+        lock.unlock();
+
+        task(worker);
+
+        lock.lock();
+        runningTasks_--;
+        if (tasks_.empty() && runningTasks_ == 0) idle_.notify_all();
+        continue;
+      }
+
+      seenGeneration = generation_;
+      job = job_;
+      jobCount = jobCount_;
+    }
+
+    for (uint32_t index = nextIndex_++; index < jobCount;
+         index = nextIndex_++)
+      (*job)(index, worker);
+
+    {
+      lock_guard<mutex> lock(mutex_);
+      busyWorkers_--;
+      if (busyWorkers_ == 0) done_.notify_one();
+    }
+  }
+}
@@ -34,6 +34,20 @@ bool JlGraphics::initGraphicsAPI(GLFWwindow* window, JlGraphicsAPI type) {
   }
 }
 
+void JlGraphics::drawFrame() {
+  switch (activeAPI_) {
+    case JlGraphics::Vulkan:
+      JlVulkanGraphics::drawFrame();
+      break;
+    case JlGraphics::OpenGL:
+      break;
+    case JlGraphics::DX12:
+      break;
+    default:
+      break;
+  }
+}
+
 void JlGraphics::shutdownGraphicsAPI() {
   switch (activeAPI_) {
     case JlGraphics::Vulkan:
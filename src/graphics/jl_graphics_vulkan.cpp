@@ -2,18 +2,43 @@
 //-----------------------------------
 
 #include "graphics/jl_graphics_vulkan.h"
+#include "graphics/jl_vulkan_bindless.h"
+#include "graphics/jl_vulkan_commands.h"
+#include "graphics/jl_vulkan_culling.h"
+#include "graphics/jl_vulkan_descriptors.h"
+#include "graphics/jl_vulkan_dispatch.h"
+#include "graphics/jl_vulkan_features.h"
+#include "graphics/jl_vulkan_frame_pacer.h"
+#include "graphics/jl_vulkan_memory.h"
+#include "graphics/jl_vulkan_pipeline_cache.h"
+#include "graphics/jl_vulkan_pipeline_compiler.h"
+#include "graphics/jl_vulkan_profiler.h"
+#include "graphics/jl_vulkan_queue_scheduler.h"
+#include "graphics/jl_vulkan_render_graph.h"
+#include "graphics/jl_vulkan_timeline.h"
+#include "graphics/jl_vulkan_upload.h"
+#include "engine/jl_worker_pool.h"
 
 #include <GLFW/glfw3.h>
 #include <string.h>
 #include <vulkan/vk_platform.h>
 #include <vulkan/vulkan_core.h>
 
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
 #include <cstdint>
 #include <iostream>
 #include "defines.h"
+#include "engine/jl_engine.h"
 #include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <limits>
+#include <memory>
+#include <random>
 #include <set>
+#include <thread>
 #include <string>
 #include <vector>
 #include <stdexcept>
@@ -29,75 +54,471 @@ const bool enableValidationLayers_ = true;
 const vector<const char*> validationLayers_ = { "VK_LAYER_KHRONOS_validation" };
 const vector<const char*> deviceExtensions_ = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
+const VkAllocationCallbacks* const allocator_ =
+  JlVulkanMemory::getAllocationCallbacks();
+const JlVulkanDispatch* const vk_ = &JlVulkanDispatch::get();
+
+const VkDeviceSize uploadRingSize_ = 32ull * 1024 * 1024;
+
 GLFWwindow* window_;
 
 VkInstance instance_;
 VkDebugUtilsMessengerEXT debugMessenger_;
 VkPhysicalDevice physicalDevice_ = VK_NULL_HANDLE;
 VkPhysicalDeviceProperties deviceProperties_;
-VkPhysicalDeviceFeatures deviceFeatures_;
 VkDevice device_;
 
 VkSurfaceKHR surface_;
 
 VkQueue graphicsQueue_;
 VkQueue presentQueue_;
-
-VkSwapchainKHR swapChain_;
+VkQueue transferQueue_ = VK_NULL_HANDLE;
+VkQueue computeQueue_ = VK_NULL_HANDLE;
+// Which fast paths the device was created with, see createLogicalDevice().
+const JlVulkanFeatures::Capabilities& features_ = JlVulkanFeatures::get();
+
+// Headless frames render into these instead of swap chain images.
+bool headless_ = false;
+vector<JlVulkanMemory::Allocation> offscreenAllocations_;
+const uint32_t offscreenTargetCount_ = 3;
+uint64_t frameUploadWait_ = 0;
+
+VkSwapchainKHR swapChain_ = VK_NULL_HANDLE;
 vector<VkImage> swapChainImages_;
 VkFormat swapChainImageFormat_;
 VkExtent2D swapChainExtent_;
 
 vector<VkImageView> swapChainImageViews_;
+vector<VkFramebuffer> swapChainFramebuffers_;
+vector<VkSemaphore> renderFinishedSemaphores_;
+
+VkRenderPass renderPass_ = VK_NULL_HANDLE;
+VkPipelineLayout pipelineLayout_ = VK_NULL_HANDLE;
+VkPipeline graphicsPipeline_ = VK_NULL_HANDLE;
+
+VkCommandPool commandPool_ = VK_NULL_HANDLE;
+unique_ptr<JlVulkanDescriptorAllocator> frameDescriptors_;
+// Referenced by the descriptor benchmark's cached sets, so it lives as long
+// as the descriptor cache.
+VkBuffer cachedSetBuffer_ = VK_NULL_HANDLE;
+JlVulkanMemory::Allocation cachedSetAllocation_;
+
+unique_ptr<JlVulkanRenderGraph> frameGraph_;
+JlVulkanRenderGraph::ResourceHandle backbuffer_ = 0;
+uint32_t frameImageIndex_ = 0;
+
+uint32_t framesInFlight_ = 2;
+uint32_t currentFrame_ = 0;
+vector<JlVulkanGraphics::FrameData> frames_;
+JlVulkanGraphics::FrameStats frameStats_;
+uint64_t frameNumber_ = 0;
+
+bool framebufferResized_ = false;
+vector<JlVulkanGraphics::RetiredSwapChain> retiredSwapChains_;
 
 bool JlVulkanGraphics::initVulkan(GLFWwindow* window) {
   cout << JlEngineReports::jlGraphicsVulkan
     << "Initializing Graphics API..." << endl;
 
   window_ = window;
+  headless_ = window_ == nullptr;
+  if (!headless_)
+    glfwSetFramebufferSizeCallback(window_, framebufferResizeCallback);
 
   if (!createInstance()) return false;
   setupDebugMessenger();
   if (!createSurface()) return false;
   if (!pickPhysicalDevice()) return false;
   if (!createLogicalDevice()) return false;
-  createSwapChain();
+  if (!JlVulkanMemory::init(physicalDevice_, device_)) return false;
+  JlVulkanPipelineCache::load(physicalDevice_, device_);
+  JlVulkanPipelineCompiler::init(
+    device_, max(JlWorkerPool::getDefaultWorkerCount() / 2, 1u),
+    features_.graphicsPipelineLibrary);
+  JlVulkanDescriptorCache::init(device_);
+  if (!JlVulkanTimeline::init(device_, features_.timelineSemaphore))
+    return false;
+  if (!headless_) JlVulkanFramePacer::init(device_, features_.presentWait);
+  if (features_.descriptorIndexing)
+    JlVulkanBindless::init(physicalDevice_, device_);
+  if (features_.timelineSemaphore) {
+    QueueFamilyIndices indices = findQueueFamilies(physicalDevice_);
+    JlVulkanUploader::init(
+      device_, transferQueue_,
+      indices.transferFamily.value_or(indices.graphicsFamily.value()),
+      indices.graphicsFamily.value(), uploadRingSize_);
+  }
+  if (!(headless_ ? createOffscreenTargets() : createSwapChain()))
+    return false;
   if (!createImageViews()) return false;
+  if (!createRenderPass()) return false;
+  if (!createGraphicsPipeline()) return false;
+  if (!createFramebuffers()) return false;
+  if (!createPresentSemaphores()) return false;
+  if (!createCommandPool()) return false;
+  if (!createFrameResources()) return false;
+
+  // Async compute batches wait on each other through timeline semaphores.
+  QueueFamilyIndices indices = findQueueFamilies(physicalDevice_);
+  if (features_.timelineSemaphore && indices.computeFamily.has_value())
+    JlVulkanQueueScheduler::init(
+      physicalDevice_, device_, indices.graphicsFamily.value(),
+      graphicsQueue_, indices.computeFamily.value(), computeQueue_,
+      framesInFlight_, features_.synchronization2);
+
+  if (!createFrameGraph()) return false;
+
+  if (JlEngineSettings::gpuProfiling) {
+    JlVulkanProfiler::init(
+      physicalDevice_, device_,
+      findQueueFamilies(physicalDevice_).graphicsFamily.value(),
+      framesInFlight_, features_.calibratedTimestamps);
+    JlVulkanProfiler::setTracing(!JlEngineSettings::gpuTraceFile.empty());
+  }
+
+  if (JlEngineSettings::runBenchmarks) runBenchmarks();
   return true;
 }
 
+void JlVulkanGraphics::drawFrame() {
+  if (frames_.empty()) return;
+
+  if (!headless_) JlVulkanFramePacer::beginFrame();
+
+  using clock = chrono::steady_clock;
+  clock::time_point frameStart = clock::now();
+
+  FrameData& frame = frames_[currentFrame_];
+  vk_->vkWaitForFences(device_, 1, &frame.inFlight, VK_TRUE, UINT64_MAX);
+
+  clock::time_point waitEnd = clock::now();
+
+  // The fence proves this slot's last submit finished, which lets the
+  // timeline advance even when timeline semaphores are unavailable.
+  JlVulkanTimeline::markCompleted(frame.timelineValue);
+  JlVulkanTimeline::collect();
+  destroyRetiredSwapChains(false);
+  frameDescriptors_->resetFrame(currentFrame_);
+  JlVulkanQueueScheduler::beginFrame(currentFrame_);
+  JlVulkanPipelineCompiler::beginFrame();
+  if (frame.readbackPending) writeReadback(frame);
+
+  // Headless, each frame slot owns one offscreen target.
+  uint32_t imageIndex = currentFrame_;
+  VkResult result = VK_SUCCESS;
+  if (!headless_) {
+    // A recreation that failed left no swap chain, or nothing to render to.
+    if (swapChain_ == VK_NULL_HANDLE || swapChainImageViews_.empty()) {
+      recreateSwapChain();
+      return;
+    }
+
+    result = vk_->vkAcquireNextImageKHR(device_, swapChain_, UINT64_MAX,
+                                        frame.imageAvailable, VK_NULL_HANDLE,
+                                        &imageIndex);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+      recreateSwapChain();
+      return;
+    }
+    if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+      cerr << JlEngineReports::jlGraphicsVulkan
+        << "Failed to acquire swap chain image (" << result << ")." << endl;
+      return;
+    }
+  }
+
+  // Uploads queued since the last frame go out ahead of the frame itself.
+  JlVulkanUploader::flush();
+
+  vk_->vkResetCommandBuffer(frame.commandBuffer, 0);
+  recordCommandBuffer(frame.commandBuffer, imageIndex);
+
+  clock::time_point recordEnd = clock::now();
+
+  VkSemaphore waitSemaphores[2];
+  VkPipelineStageFlags waitStages[2];
+  uint64_t waitValues[2];
+  uint32_t waitCount = 0;
+  if (!headless_) {
+    waitSemaphores[waitCount] = frame.imageAvailable;
+    waitStages[waitCount] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    waitValues[waitCount++] = 0;
+  }
+  if (frameUploadWait_ > 0) {
+    waitSemaphores[waitCount] = JlVulkanUploader::getTimeline();
+    waitStages[waitCount] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    waitValues[waitCount++] = frameUploadWait_;
+  }
+
+  // The frame signals the GPU timeline so deferred destruction and CPU
+  // waits can track it, the fence is still used to pace the frame slots.
+  frame.timelineValue = JlVulkanTimeline::advance();
+  VkSemaphore gpuTimeline = JlVulkanTimeline::getSemaphore();
+
+  VkSemaphore signalSemaphores[2];
+  uint64_t signalValues[2];
+  uint32_t signalCount = 0;
+  if (!headless_) {
+    signalSemaphores[signalCount] = renderFinishedSemaphores_[imageIndex];
+    signalValues[signalCount++] = 0;
+  }
+  if (gpuTimeline != VK_NULL_HANDLE) {
+    signalSemaphores[signalCount] = gpuTimeline;
+    signalValues[signalCount++] = frame.timelineValue;
+  }
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo{};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.waitSemaphoreValueCount = waitCount;
+  timelineInfo.pWaitSemaphoreValues = waitValues;
+  timelineInfo.signalSemaphoreValueCount = signalCount;
+  timelineInfo.pSignalSemaphoreValues = signalValues;
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  uint64_t presentId = headless_ ? 0 : JlVulkanFramePacer::markSubmit();
+
+  submitInfo.pNext = frameUploadWait_ > 0 || gpuTimeline != VK_NULL_HANDLE
+                      ? &timelineInfo
+                      : nullptr;
+  submitInfo.waitSemaphoreCount = waitCount;
+  submitInfo.pWaitSemaphores = waitSemaphores;
+  submitInfo.pWaitDstStageMask = waitStages;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &frame.commandBuffer;
+  submitInfo.signalSemaphoreCount = signalCount;
+  submitInfo.pSignalSemaphores = signalSemaphores;
+
+  // Synchronization2 carries the timeline values and stages per semaphore,
+  // the legacy stage bits have the same values as their 2 counterparts.
+  VkSemaphoreSubmitInfo waitInfos[2]{};
+  VkSemaphoreSubmitInfo signalInfos[2]{};
+  for (uint32_t i = 0; i < waitCount; i++) {
+    waitInfos[i].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    waitInfos[i].semaphore = waitSemaphores[i];
+    waitInfos[i].value = waitValues[i];
+    waitInfos[i].stageMask = waitStages[i];
+  }
+  for (uint32_t i = 0; i < signalCount; i++) {
+    signalInfos[i].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    signalInfos[i].semaphore = signalSemaphores[i];
+    signalInfos[i].value = signalValues[i];
+    signalInfos[i].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+  }
+
+  VkCommandBufferSubmitInfo commandBufferInfo{};
+  commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+  commandBufferInfo.commandBuffer = frame.commandBuffer;
+
+  VkSubmitInfo2 submitInfo2{};
+  submitInfo2.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+  submitInfo2.waitSemaphoreInfoCount = waitCount;
+  submitInfo2.pWaitSemaphoreInfos = waitInfos;
+  submitInfo2.commandBufferInfoCount = 1;
+  submitInfo2.pCommandBufferInfos = &commandBufferInfo;
+  submitInfo2.signalSemaphoreInfoCount = signalCount;
+  submitInfo2.pSignalSemaphoreInfos = signalInfos;
+
+  // A graph with async compute passes is split over several submits, the
+  // frame's waits go on the first batch of each queue and its signals on
+  // the last.
+  bool scheduled = frameGraph_->getBatches().size() > 1;
+  JlVulkanQueueScheduler::FrameSubmit frameSubmit;
+  if (scheduled) {
+    frameSubmit.commandBuffer = frame.commandBuffer;
+    frameSubmit.waits.assign(waitInfos, waitInfos + waitCount);
+    frameSubmit.signals.assign(signalInfos, signalInfos + signalCount);
+    frameSubmit.fence = frame.inFlight;
+  }
+
+  // Reset right before the submit. If it fails, releaseFailedSubmit()
+  // signals the fence and the timeline value in its place, otherwise the
+  // next wait on this slot would never return.
+  vk_->vkResetFences(device_, 1, &frame.inFlight);
+
+  try {
+    VkResult submitResult =
+      scheduled
+        ? JlVulkanQueueScheduler::submit(*frameGraph_, currentFrame_,
+                                         frameSubmit)
+      : features_.synchronization2
+        ? vk_->vkQueueSubmit2(graphicsQueue_, 1, &submitInfo2, frame.inFlight)
+        : vk_->vkQueueSubmit(graphicsQueue_, 1, &submitInfo, frame.inFlight);
+    if (submitResult != VK_SUCCESS)
+      throw runtime_error("Failed to submit draw command buffer.");
+  }
+  catch (runtime_error& e) {
+    JlVulkanFramePacer::cancelPresent(presentId);
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    releaseFailedSubmit(frame, !headless_ && !frameSubmit.waitsSubmitted);
+    return;
+  }
+  JlVulkanProfiler::endFrame();
+  frameNumber_++;
+
+  // Headless frames are never presented.
+  if (!headless_) {
+    VkPresentInfoKHR presentInfo{};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = signalSemaphores;
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = &swapChain_;
+    presentInfo.pImageIndices = &imageIndex;
+
+    VkPresentIdKHR presentIdInfo{};
+    presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    presentIdInfo.swapchainCount = 1;
+    presentIdInfo.pPresentIds = &presentId;
+    if (presentId != 0) presentInfo.pNext = &presentIdInfo;
+
+    result = vk_->vkQueuePresentKHR(presentQueue_, &presentInfo);
+    if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+      JlVulkanFramePacer::cancelPresent(presentId);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
+        framebufferResized_)
+      recreateSwapChain();
+  }
+
+  currentFrame_ = (currentFrame_ + 1) % framesInFlight_;
+
+  clock::time_point frameEnd = clock::now();
+  frameStats_.frames++;
+  frameStats_.frameMs +=
+    chrono::duration<double, milli>(frameEnd - frameStart).count();
+  frameStats_.fenceWaitMs +=
+    chrono::duration<double, milli>(waitEnd - frameStart).count();
+  frameStats_.recordMs +=
+    chrono::duration<double, milli>(recordEnd - waitEnd).count();
+}
+
 void JlVulkanGraphics::shutdownVulkan() {
   cout << JlEngineReports::jlGraphicsVulkan
     << "Shutting down Vulkan Graphics API..." << endl;
 
+  if (device_ != VK_NULL_HANDLE) vk_->vkDeviceWaitIdle(device_);
+  reportFrameStats();
+
+  for (FrameData& frame : frames_) {
+    if (frame.readbackPending) writeReadback(frame);
+    if (frame.readbackBuffer != VK_NULL_HANDLE)
+      JlVulkanMemory::destroyBuffer(frame.readbackBuffer,
+                                    frame.readbackAllocation);
+  }
+
+  if (!headless_) {
+    JlVulkanFramePacer::reportStats();
+    JlVulkanFramePacer::shutdown();
+  }
+
+  JlVulkanQueueScheduler::reportStats();
+  JlVulkanQueueScheduler::shutdown();
+
+  JlVulkanProfiler::shutdown();
+  JlVulkanProfiler::reportStats();
+  if (!JlEngineSettings::gpuTraceFile.empty())
+    JlVulkanProfiler::exportTrace(JlEngineDirectories::appDir /
+                                  JlEngineSettings::gpuTraceFile);
+
+  for (FrameData& frame : frames_) {
+    vk_->vkDestroySemaphore(device_, frame.imageAvailable, allocator_);
+    vk_->vkDestroyFence(device_, frame.inFlight, allocator_);
+  }
+  frames_.clear();
+
+  for (VkSemaphore semaphore : renderFinishedSemaphores_)
+    vk_->vkDestroySemaphore(device_, semaphore, allocator_);
+
+  cout << JlEngineReports::jlGraphicsVulkan
+    << "Sync objects destroyed..." << endl;
+
+  destroyRetiredSwapChains(true);
+  frameGraph_.reset();
+  JlVulkanTimeline::shutdown();
+
+  frameDescriptors_->reportStats("Frame");
+  frameDescriptors_.reset();
+  vk_->vkDestroyCommandPool(device_, commandPool_, allocator_);
+
+  cout << JlEngineReports::jlGraphicsVulkan
+    << "Command pool destroyed..." << endl;
+
+  for (VkFramebuffer framebuffer : swapChainFramebuffers_)
+    vk_->vkDestroyFramebuffer(device_, framebuffer, allocator_);
+
+  cout << JlEngineReports::jlGraphicsVulkan
+    << "Framebuffers destroyed..." << endl;
+
+  // Pipelines compiled in the background end up in the saved cache too.
+  JlVulkanPipelineCompiler::reportStats();
+  JlVulkanPipelineCompiler::shutdown();
+
+  JlVulkanPipelineCache::reportStats();
+  JlVulkanPipelineCache::save();
+  JlVulkanPipelineCache::destroy();
+
+  JlVulkanDescriptorCache::reportStats();
+  JlVulkanDescriptorCache::shutdown();
+  if (cachedSetBuffer_ != VK_NULL_HANDLE)
+    JlVulkanMemory::destroyBuffer(cachedSetBuffer_, cachedSetAllocation_);
+  cachedSetBuffer_ = VK_NULL_HANDLE;
+
+  vk_->vkDestroyPipeline(device_, graphicsPipeline_, allocator_);
+  vk_->vkDestroyPipelineLayout(device_, pipelineLayout_, allocator_);
+  vk_->vkDestroyRenderPass(device_, renderPass_, allocator_);
+
+  cout << JlEngineReports::jlGraphicsVulkan
+    << "Graphics pipeline destroyed..." << endl;
+
+  JlVulkanBindless::reportStats();
+  JlVulkanBindless::shutdown();
+
   for (VkImageView imageView : swapChainImageViews_)
-    vkDestroyImageView(device_, imageView, nullptr);
+    vk_->vkDestroyImageView(device_, imageView, allocator_);
 
   cout << JlEngineReports::jlGraphicsVulkan
     << "Image views destroyed..." << endl;
 
-  vkDestroySwapchainKHR(device_, swapChain_, nullptr);
+  if (headless_) {
+    for (size_t i = 0; i < swapChainImages_.size(); i++)
+      JlVulkanMemory::destroyImage(swapChainImages_[i],
+                                   offscreenAllocations_[i]);
+    offscreenAllocations_.clear();
 
-  cout << JlEngineReports::jlGraphicsVulkan
-    << "Swap chain destroyed..." << endl;
+    cout << JlEngineReports::jlGraphicsVulkan
+      << "Offscreen targets destroyed..." << endl;
+  }
+  else {
+    vk_->vkDestroySwapchainKHR(device_, swapChain_, allocator_);
+
+    cout << JlEngineReports::jlGraphicsVulkan
+      << "Swap chain destroyed..." << endl;
+  }
 
-  vkDestroyDevice(device_, nullptr);
+  JlVulkanUploader::shutdown();
+
+  JlVulkanMemory::reportStats();
+  JlVulkanMemory::shutdown();
+
+  vk_->vkDestroyDevice(device_, allocator_);
 
   cout << JlEngineReports::jlGraphicsVulkan
     << "Device destroyed..." << endl;
 
   if (enableValidationLayers_) {
-    destroyDebugUtilsMessengerEXT(instance_, debugMessenger_, nullptr);
+    destroyDebugUtilsMessengerEXT(instance_, debugMessenger_, allocator_);
     cout << JlEngineReports::jlGraphicsVulkan
       << "Debug messenger destroyed..." << endl;
   }
 
-  vkDestroySurfaceKHR(instance_, surface_, nullptr);
+  if (!headless_) {
+    vk_->vkDestroySurfaceKHR(instance_, surface_, allocator_);
 
-  cout << JlEngineReports::jlGraphicsVulkan
-    << "Surface destroyed..." << endl;
+    cout << JlEngineReports::jlGraphicsVulkan
+      << "Surface destroyed..." << endl;
+  }
 
-  vkDestroyInstance(instance_, nullptr);
+  vk_->vkDestroyInstance(instance_, allocator_);
 
   cout << JlEngineReports::jlGraphicsVulkan
     << "Instance destroyed..." << endl;
@@ -107,6 +528,8 @@ void JlVulkanGraphics::shutdownVulkan() {
 }
 
 bool JlVulkanGraphics::createInstance() {
+  if (!JlVulkanDispatch::loadGlobal()) return false;
+
   try {
     if (enableValidationLayers_) {
       if (!checkValidationLayerSupport())
@@ -150,7 +573,8 @@ bool JlVulkanGraphics::createInstance() {
   }
 
   try {
-    if (vkCreateInstance(&createInfo, nullptr, &instance_) != VK_SUCCESS)
+    if (vk_->vkCreateInstance(&createInfo, allocator_, &instance_) !=
+        VK_SUCCESS)
       throw runtime_error("Failed to create a instance.");
   }
   catch (const runtime_error& e) {
@@ -158,6 +582,8 @@ bool JlVulkanGraphics::createInstance() {
     return false;
   }
 
+  if (!JlVulkanDispatch::loadInstance(instance_)) return false;
+
   cout << JlEngineReports::jlGraphicsVulkan << "Instance created..."
     << endl;
   return true;
@@ -170,7 +596,7 @@ bool JlVulkanGraphics::setupDebugMessenger() {
   populateDebugMessengerCreateInfo(createInfo);
 
   try {
-    if (createDebugUtilsMessengerEXT(instance_, &createInfo, nullptr, &debugMessenger_) != VK_SUCCESS)
+    if (createDebugUtilsMessengerEXT(instance_, &createInfo, allocator_, &debugMessenger_) != VK_SUCCESS)
       throw runtime_error("Failed to set up debug messenger.");
   }
   catch (const runtime_error& e) {
@@ -182,8 +608,10 @@ bool JlVulkanGraphics::setupDebugMessenger() {
 }
 
 bool JlVulkanGraphics::createSurface() {
+  if (headless_) return true;
+
   try {
-    if (glfwCreateWindowSurface(instance_, window_, nullptr, &surface_) != VK_SUCCESS)
+    if (glfwCreateWindowSurface(instance_, window_, allocator_, &surface_) != VK_SUCCESS)
       throw runtime_error("Failed to create surface.");
   }
   catch (const runtime_error& e) {
@@ -198,7 +626,7 @@ bool JlVulkanGraphics::createSurface() {
 
 bool JlVulkanGraphics::pickPhysicalDevice() {
   uint32_t deviceCount = 0;
-  vkEnumeratePhysicalDevices(instance_, &deviceCount, nullptr);
+  vk_->vkEnumeratePhysicalDevices(instance_, &deviceCount, nullptr);
 
   try {
     if (deviceCount == 0)
@@ -206,31 +634,82 @@ bool JlVulkanGraphics::pickPhysicalDevice() {
   }
   catch (const runtime_error& e) {
     cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return false;
   }
 
   vector<VkPhysicalDevice> devices(deviceCount);
-  vkEnumeratePhysicalDevices(instance_, &deviceCount, devices.data());
+  vk_->vkEnumeratePhysicalDevices(instance_, &deviceCount, devices.data());
 
-  /*multimap<int, VkPhysicalDevice> candidates;
+  vector<DeviceCandidate> candidates;
   for (const VkPhysicalDevice& device : devices) {
-    int score = pickBestDevice(device);
-    cout << score << endl;
-    candidates.insert(make_pair(score, device));
-  }*/
+    VkPhysicalDeviceProperties properties;
+    vk_->vkGetPhysicalDeviceProperties(device, &properties);
+    VkPhysicalDeviceMemoryProperties memory;
+    vk_->vkGetPhysicalDeviceMemoryProperties(device, &memory);
+
+    DeviceCandidate candidate;
+    candidate.device = device;
+    candidate.name = properties.deviceName;
+    candidate.score = pickBestDevice(device);
+    for (uint32_t i = 0; i < memory.memoryHeapCount; i++)
+      if (memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+        candidate.localMemory =
+          max(candidate.localMemory, memory.memoryHeaps[i].size);
+
+    switch (properties.deviceType) {
+      case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+        candidate.type = "discrete";
+        break;
+      case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+        candidate.type = "integrated";
+        break;
+      case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+        candidate.type = "virtual";
+        break;
+      case VK_PHYSICAL_DEVICE_TYPE_CPU:
+        candidate.type = "cpu";
+        break;
+      default:
+        candidate.type = "other";
+        break;
+    }
+    candidates.push_back(candidate);
+  }
 
-  for (const VkPhysicalDevice& device : devices) {
-    if (isDeviceSuitable(device)) {
-      physicalDevice_ = device;
-      break;
+  // Highest score first, enumeration order breaks ties.
+  stable_sort(candidates.begin(), candidates.end(),
+              [](const DeviceCandidate& a, const DeviceCandidate& b) {
+                return a.score > b.score;
+              });
+
+  physicalDevice_ = VK_NULL_HANDLE;
+  const string& deviceOverride = JlEngineSettings::gpuOverride;
+  if (!deviceOverride.empty()) {
+    for (const DeviceCandidate& candidate : candidates) {
+      if (candidate.score > 0 &&
+          matchesDeviceOverride(candidate.device, deviceOverride)) {
+        physicalDevice_ = candidate.device;
+        break;
+      }
     }
+
+    if (physicalDevice_ == VK_NULL_HANDLE)
+      cerr << JlEngineReports::jlGraphicsVulkan << "No suitable GPU matches \""
+        << deviceOverride << "\", falling back to the ranking." << endl;
   }
+  if (physicalDevice_ == VK_NULL_HANDLE && candidates.front().score > 0)
+    physicalDevice_ = candidates.front().device;
 
-  try {
-    /*if (candidates.rbegin()->first > 0)
-      physicalDevice_ = candidates.rbegin()->second;
-    else
-      throw runtime_error("Failed to find a suitable GPU.");*/
+  for (const DeviceCandidate& candidate : candidates) {
+    cout << JlEngineReports::jlGraphicsVulkan
+      << (candidate.device == physicalDevice_ ? "* " : "  ")
+      << candidate.name << " (" << candidate.type << ", "
+      << candidate.localMemory / (1024 * 1024) << " MB local), score "
+      << candidate.score << (candidate.score > 0 ? "" : ", unsuitable")
+      << endl;
+  }
 
+  try {
     if (physicalDevice_ == VK_NULL_HANDLE)
       throw runtime_error("Failed to find a suitable GPU.");
   }
@@ -239,6 +718,8 @@ bool JlVulkanGraphics::pickPhysicalDevice() {
     return false;
   }
 
+  vk_->vkGetPhysicalDeviceProperties(physicalDevice_, &deviceProperties_);
+
   cout << JlEngineReports::jlGraphicsVulkan << "Physical device picked..."
     << endl;
   return true;
@@ -250,6 +731,10 @@ bool JlVulkanGraphics::createLogicalDevice() {
   vector<VkDeviceQueueCreateInfo> queueCreateInfos;
   set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(),
                                        indices.presentFamily.value() };
+  if (indices.transferFamily.has_value())
+    uniqueQueueFamilies.insert(indices.transferFamily.value());
+  if (indices.computeFamily.has_value())
+    uniqueQueueFamilies.insert(indices.computeFamily.value());
 
   float queuePriority = 1.0f;
   for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -261,18 +746,17 @@ bool JlVulkanGraphics::createLogicalDevice() {
     queueCreateInfos.push_back(queueCreateInfo);
   }
 
-  VkPhysicalDeviceFeatures deviceFeatures{};
-
   VkDeviceCreateInfo createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
   createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
-  createInfo.pEnabledFeatures = &deviceFeatures;
-
-  createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions_.size());
-  createInfo.ppEnabledExtensionNames = deviceExtensions_.data();
+  // Headless devices never present, so the swap chain isn't needed either.
+  JlVulkanFeatures::DeviceSetup deviceSetup;
+  JlVulkanFeatures::negotiate(
+    physicalDevice_, headless_ ? vector<const char*>() : deviceExtensions_,
+    !headless_, deviceSetup, createInfo);
 
   if (enableValidationLayers_) {
     createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers_.size());
@@ -283,8 +767,8 @@ bool JlVulkanGraphics::createLogicalDevice() {
   }
 
   try {
-    if (vkCreateDevice(physicalDevice_, &createInfo, nullptr, &device_) !=
-        VK_SUCCESS)
+    if (vk_->vkCreateDevice(physicalDevice_, &createInfo, allocator_,
+                            &device_) != VK_SUCCESS)
       throw runtime_error("Failed to create logical device.");
   }
   catch (runtime_error& e) {
@@ -292,22 +776,38 @@ bool JlVulkanGraphics::createLogicalDevice() {
     return false;
   }
 
-  vkGetDeviceQueue(device_, indices.graphicsFamily.value(), 0, &graphicsQueue_);
-  vkGetDeviceQueue(device_, indices.presentFamily.value(), 0, &presentQueue_);
+  if (!JlVulkanDispatch::loadDevice(device_)) return false;
+
+  vk_->vkGetDeviceQueue(device_, indices.graphicsFamily.value(), 0,
+                        &graphicsQueue_);
+  vk_->vkGetDeviceQueue(device_, indices.presentFamily.value(), 0,
+                        &presentQueue_);
+  vk_->vkGetDeviceQueue(device_,
+                        indices.transferFamily.value_or(indices.graphicsFamily.value()),
+                        0, &transferQueue_);
+  if (indices.computeFamily.has_value())
+    vk_->vkGetDeviceQueue(device_, indices.computeFamily.value(), 0,
+                          &computeQueue_);
 
   cout << JlEngineReports::jlGraphicsVulkan << "Logical device created..."
     << endl;
+  JlVulkanFeatures::reportCapabilities();
   return true;
 }
 
-void JlVulkanGraphics::createSwapChain() {
+bool JlVulkanGraphics::createSwapChain() {
   SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice_);
 
   VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
   VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
   VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
-  uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+  // Every extra image is another frame that can wait in the present queue,
+  // only mailbox turns the extra depth into throughput.
+  uint32_t imageCount = JlEngineSettings::swapChainImages;
+  if (imageCount == 0)
+    imageCount = presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? 3 : 2;
+  imageCount = max(imageCount, swapChainSupport.capabilities.minImageCount);
   if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
     imageCount = swapChainSupport.capabilities.maxImageCount;
   }
@@ -340,27 +840,1527 @@ void JlVulkanGraphics::createSwapChain() {
   createInfo.presentMode = presentMode;
   createInfo.clipped = VK_TRUE;
 
-  createInfo.oldSwapchain = VK_NULL_HANDLE;
+  // Handing over the current swap chain lets the driver reuse its resources
+  // and keeps already queued presents valid while the new one takes over.
+  createInfo.oldSwapchain = swapChain_;
 
+  VkSwapchainKHR newSwapChain;
   try {
-    if (vkCreateSwapchainKHR(device_, &createInfo, nullptr, &swapChain_) != VK_SUCCESS)
+    if (vk_->vkCreateSwapchainKHR(device_, &createInfo, allocator_, &newSwapChain) != VK_SUCCESS)
       throw runtime_error("Failed to create swap chain.");
   }
   catch (runtime_error& e) {
     cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return false;
   }
+  swapChain_ = newSwapChain;
 
-  vkGetSwapchainImagesKHR(device_, swapChain_, &imageCount, nullptr);
+  vk_->vkGetSwapchainImagesKHR(device_, swapChain_, &imageCount, nullptr);
   swapChainImages_.resize(imageCount);
-  vkGetSwapchainImagesKHR(device_, swapChain_, &imageCount, swapChainImages_.data());
+  vk_->vkGetSwapchainImagesKHR(device_, swapChain_, &imageCount, swapChainImages_.data());
 
   swapChainImageFormat_ = surfaceFormat.format;
   swapChainExtent_ = extent;
 
-  cout << JlEngineReports::jlGraphicsVulkan << "Swap chain created..."
+  JlVulkanFramePacer::setSwapChain(
+    swapChain_, JlEngineSettings::presentPolicy == JlEngineSettings::LowLatency);
+
+  const char* presentModeName =
+    presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR ? "immediate" :
+    presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? "mailbox" : "fifo";
+  cout << JlEngineReports::jlGraphicsVulkan << "Swap chain created, "
+    << presentModeName << " with " << imageCount << " images..." << endl;
+  return true;
+}
+
+bool JlVulkanGraphics::createOffscreenTargets() {
+  swapChainImageFormat_ = VK_FORMAT_R8G8B8A8_UNORM;
+  swapChainExtent_ = { JlEngineSettings::headlessWidth,
+                       JlEngineSettings::headlessHeight };
+
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.format = swapChainImageFormat_;
+  imageInfo.extent = { swapChainExtent_.width, swapChainExtent_.height, 1 };
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                    VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  // One per possible frame in flight, so no target is ever shared.
+  swapChainImages_.resize(offscreenTargetCount_);
+  offscreenAllocations_.resize(offscreenTargetCount_);
+  try {
+    for (uint32_t i = 0; i < offscreenTargetCount_; i++)
+      if (JlVulkanMemory::createImage(
+            imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            JlVulkanMemory::Buddy, &swapChainImages_[i],
+            offscreenAllocations_[i]) != VK_SUCCESS)
+        throw runtime_error("Failed to create offscreen targets.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return false;
+  }
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Headless, "
+    << offscreenTargetCount_ << " offscreen targets of "
+    << swapChainExtent_.width << "x" << swapChainExtent_.height
+    << " created..." << endl;
+  return true;
+}
+
+void JlVulkanGraphics::releaseFailedSubmit(FrameData& frame,
+                                           bool waitImageAvailable) {
+  // An empty submit behind whatever did reach the queue signals what the
+  // failed one would have. It also consumes the acquire semaphore if the
+  // frame didn't, so the slot can acquire with it again.
+  VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+  uint64_t waitValue = 0;
+  VkSemaphore gpuTimeline = JlVulkanTimeline::getSemaphore();
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo{};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.waitSemaphoreValueCount = waitImageAvailable ? 1 : 0;
+  timelineInfo.pWaitSemaphoreValues = &waitValue;
+  timelineInfo.signalSemaphoreValueCount = 1;
+  timelineInfo.pSignalSemaphoreValues = &frame.timelineValue;
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.pNext = gpuTimeline != VK_NULL_HANDLE ? &timelineInfo : nullptr;
+  submitInfo.waitSemaphoreCount = waitImageAvailable ? 1 : 0;
+  submitInfo.pWaitSemaphores = &frame.imageAvailable;
+  submitInfo.pWaitDstStageMask = &waitStage;
+  submitInfo.signalSemaphoreCount = gpuTimeline != VK_NULL_HANDLE ? 1 : 0;
+  submitInfo.pSignalSemaphores = &gpuTimeline;
+
+  if (vk_->vkQueueSubmit(graphicsQueue_, 1, &submitInfo, frame.inFlight) ==
+      VK_SUCCESS)
+    return;
+
+  // The queue is gone as well, a signaled fence at least keeps the frame
+  // loop from hanging on this slot.
+  cerr << JlEngineReports::jlGraphicsVulkan
+    << "Failed to release the frame after a failed submit." << endl;
+  vk_->vkDestroyFence(device_, frame.inFlight, allocator_);
+  frame.inFlight = VK_NULL_HANDLE;
+
+  VkFenceCreateInfo fenceInfo{};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+  if (vk_->vkCreateFence(device_, &fenceInfo, allocator_, &frame.inFlight) !=
+      VK_SUCCESS)
+    cerr << JlEngineReports::jlGraphicsVulkan
+      << "Failed to recreate the frame fence." << endl;
+  JlVulkanTimeline::markCompleted(frame.timelineValue);
+}
+
+void JlVulkanGraphics::recreateSwapChain() {
+  int width = 0, height = 0;
+  glfwGetFramebufferSize(window_, &width, &height);
+
+  // Minimized, keep the old swap chain until there is something to draw
+  // to. Waiting for the next event keeps the retries from spinning.
+  if (width == 0 || height == 0) {
+    glfwWaitEvents();
+    return;
+  }
+
+  framebufferResized_ = false;
+
+  RetiredSwapChain retired;
+  retired.swapChain = swapChain_;
+  retired.imageViews = move(swapChainImageViews_);
+  retired.framebuffers = move(swapChainFramebuffers_);
+  retired.presentSemaphores = move(renderFinishedSemaphores_);
+  retired.retiredAtFrame = frameNumber_;
+
+  swapChainImageViews_.clear();
+  swapChainFramebuffers_.clear();
+  renderFinishedSemaphores_.clear();
+
+  // The old swap chain is retired even when creation fails, so it can't be
+  // passed as oldSwapchain again. Without a swap chain drawFrame() doesn't
+  // acquire and the retry creates one from scratch.
+  bool created = createSwapChain();
+  retiredSwapChains_.push_back(move(retired));
+  if (!created) {
+    swapChain_ = VK_NULL_HANDLE;
+    framebufferResized_ = true;
+    return;
+  }
+
+  // Either all of the new image's objects exist or none do. Without them
+  // drawFrame() doesn't acquire and retries the recreation instead.
+  if (!createImageViews() || !createFramebuffers() ||
+      !createPresentSemaphores()) {
+    for (VkFramebuffer framebuffer : swapChainFramebuffers_)
+      vk_->vkDestroyFramebuffer(device_, framebuffer, allocator_);
+    for (VkImageView imageView : swapChainImageViews_)
+      vk_->vkDestroyImageView(device_, imageView, allocator_);
+    for (VkSemaphore semaphore : renderFinishedSemaphores_)
+      vk_->vkDestroySemaphore(device_, semaphore, allocator_);
+    swapChainFramebuffers_.clear();
+    swapChainImageViews_.clear();
+    renderFinishedSemaphores_.clear();
+    framebufferResized_ = true;
+
+    cerr << JlEngineReports::jlGraphicsVulkan
+      << "Failed to recreate swap chain." << endl;
+    return;
+  }
+
+  frameStats_.swapChainRecreations++;
+  cout << JlEngineReports::jlGraphicsVulkan << "Swap chain recreated ("
+    << swapChainExtent_.width << "x" << swapChainExtent_.height << ")..."
+    << endl;
+}
+
+void JlVulkanGraphics::destroyRetiredSwapChains(bool force) {
+  // Frame N waits on the fence of frame N - framesInFlight, so once that many
+  // frames were submitted on the new swap chain nothing in flight can still
+  // reference the retired one. One extra frame covers its queued presents.
+  auto it = retiredSwapChains_.begin();
+  while (it != retiredSwapChains_.end()) {
+    if (!force && frameNumber_ < it->retiredAtFrame + framesInFlight_ + 1) {
+      ++it;
+      continue;
+    }
+
+    for (VkFramebuffer framebuffer : it->framebuffers)
+      vk_->vkDestroyFramebuffer(device_, framebuffer, allocator_);
+    for (VkImageView imageView : it->imageViews)
+      vk_->vkDestroyImageView(device_, imageView, allocator_);
+    for (VkSemaphore semaphore : it->presentSemaphores)
+      vk_->vkDestroySemaphore(device_, semaphore, allocator_);
+    vk_->vkDestroySwapchainKHR(device_, it->swapChain, allocator_);
+
+    it = retiredSwapChains_.erase(it);
+  }
+}
+
+void JlVulkanGraphics::runBenchmarks() {
+  cout << JlEngineReports::jlGraphicsVulkan << "Running benchmarks..."
+    << endl;
+
+  benchmarkCommandRecording();
+  benchmarkRenderGraph();
+  benchmarkRenderPaths();
+  benchmarkGpuCulling();
+  benchmarkAsyncCompute();
+  benchmarkPipelineCompiler();
+  benchmarkDescriptorAllocation();
+  benchmarkDispatch();
+}
+
+void JlVulkanGraphics::benchmarkCommandRecording() {
+  const uint32_t taskCount = 256;
+  const uint32_t drawsPerTask = 256;
+  const uint32_t iterations = 8;
+
+  // A target of its own, swap chain images can't be rendered unacquired.
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.format = swapChainImageFormat_;
+  imageInfo.extent = { swapChainExtent_.width, swapChainExtent_.height, 1 };
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  VkImage target = VK_NULL_HANDLE;
+  JlVulkanMemory::Allocation targetAllocation;
+  VkImageView targetView = VK_NULL_HANDLE;
+  VkFramebuffer targetFramebuffer = VK_NULL_HANDLE;
+  VkFence fence = VK_NULL_HANDLE;
+  VkCommandBuffer primary = VK_NULL_HANDLE;
+
+  try {
+    if (JlVulkanMemory::createImage(imageInfo,
+                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                    JlVulkanMemory::Buddy, &target,
+                                    targetAllocation) != VK_SUCCESS)
+      throw runtime_error("Failed to create recording benchmark target.");
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = target;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = swapChainImageFormat_;
+    viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    if (vk_->vkCreateImageView(device_, &viewInfo, allocator_, &targetView) !=
+        VK_SUCCESS)
+      throw runtime_error("Failed to create recording benchmark target.");
+
+    if (!features_.dynamicRendering) {
+      VkFramebufferCreateInfo framebufferInfo{};
+      framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+      framebufferInfo.renderPass = renderPass_;
+      framebufferInfo.attachmentCount = 1;
+      framebufferInfo.pAttachments = &targetView;
+      framebufferInfo.width = swapChainExtent_.width;
+      framebufferInfo.height = swapChainExtent_.height;
+      framebufferInfo.layers = 1;
+      if (vk_->vkCreateFramebuffer(device_, &framebufferInfo, allocator_,
+                                   &targetFramebuffer) != VK_SUCCESS)
+        throw runtime_error("Failed to create recording benchmark target.");
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vk_->vkCreateFence(device_, &fenceInfo, allocator_, &fence) !=
+        VK_SUCCESS)
+      throw runtime_error("Failed to create recording benchmark fence.");
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool_;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    if (vk_->vkAllocateCommandBuffers(device_, &allocInfo, &primary) !=
+        VK_SUCCESS)
+      throw runtime_error("Failed to allocate recording command buffer.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+  }
+
+  VkCommandBufferInheritanceRenderingInfo inheritanceRendering{};
+  inheritanceRendering.sType =
+    VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+  inheritanceRendering.colorAttachmentCount = 1;
+  inheritanceRendering.pColorAttachmentFormats = &swapChainImageFormat_;
+  inheritanceRendering.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+  VkCommandBufferInheritanceInfo inheritance{};
+  inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  if (features_.dynamicRendering) {
+    inheritance.pNext = &inheritanceRendering;
+  }
+  else {
+    inheritance.renderPass = renderPass_;
+    inheritance.subpass = 0;
+    inheritance.framebuffer = targetFramebuffer;
+  }
+
+  VkViewport viewport{};
+  viewport.width = static_cast<float>(swapChainExtent_.width);
+  viewport.height = static_cast<float>(swapChainExtent_.height);
+  viewport.maxDepth = 1.0f;
+
+  VkRect2D scissor{};
+  scissor.extent = swapChainExtent_;
+
+  vector<JlVulkanCommandRecorder::RecordTask> tasks(
+    taskCount, [&](VkCommandBuffer commandBuffer) {
+      vk_->vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                             graphicsPipeline_);
+      JlVulkanBindless::bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                             pipelineLayout_);
+      vk_->vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+      vk_->vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+      for (uint32_t i = 0; i < drawsPerTask; i++)
+        vk_->vkCmdDraw(commandBuffer, 3, 1, 0, i);
+    });
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  VkImageMemoryBarrier targetBarrier{};
+  targetBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  targetBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  targetBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  targetBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  targetBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  targetBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  targetBarrier.image = target;
+  targetBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+  VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
+
+  VkRenderingAttachmentInfo colorAttachment{};
+  colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+  colorAttachment.imageView = targetView;
+  colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  colorAttachment.clearValue = clearColor;
+
+  VkRenderingInfo renderingInfo{};
+  renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+  renderingInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+  renderingInfo.renderArea.extent = swapChainExtent_;
+  renderingInfo.layerCount = 1;
+  renderingInfo.colorAttachmentCount = 1;
+  renderingInfo.pColorAttachments = &colorAttachment;
+
+  VkRenderPassBeginInfo renderPassInfo{};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  renderPassInfo.renderPass = renderPass_;
+  renderPassInfo.framebuffer = targetFramebuffer;
+  renderPassInfo.renderArea.extent = swapChainExtent_;
+  renderPassInfo.clearValueCount = 1;
+  renderPassInfo.pClearValues = &clearColor;
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &primary;
+
+  // Records the secondaries on the workers, stitches them into the primary
+  // and submits it. The CPU side is timed up to the submit, the wait after
+  // it keeps the next pass from recycling buffers still in use.
+  auto recordFrame = [&](JlVulkanCommandRecorder& recorder) {
+    vector<VkCommandBuffer> secondaries =
+      recorder.recordSecondary(0, inheritance, tasks);
+
+    vk_->vkBeginCommandBuffer(primary, &beginInfo);
+    vk_->vkCmdPipelineBarrier(primary, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                              VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                              0, 0, nullptr, 0, nullptr, 1, &targetBarrier);
+    if (features_.dynamicRendering)
+      vk_->vkCmdBeginRendering(primary, &renderingInfo);
+    else
+      vk_->vkCmdBeginRenderPass(primary, &renderPassInfo,
+                                VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+    JlVulkanCommandRecorder::executeSecondary(primary, secondaries);
+
+    if (features_.dynamicRendering)
+      vk_->vkCmdEndRendering(primary);
+    else
+      vk_->vkCmdEndRenderPass(primary);
+    vk_->vkEndCommandBuffer(primary);
+
+    return vk_->vkQueueSubmit(graphicsQueue_, 1, &submitInfo, fence);
+  };
+  auto waitFrame = [&](JlVulkanCommandRecorder& recorder) {
+    vk_->vkWaitForFences(device_, 1, &fence, VK_TRUE, UINT64_MAX);
+    vk_->vkResetFences(device_, 1, &fence);
+    vk_->vkResetCommandBuffer(primary, 0);
+    recorder.resetFrame(0);
+  };
+
+  uint32_t queueFamily = findQueueFamilies(physicalDevice_).graphicsFamily.value();
+  uint32_t maxWorkers = JlEngineSettings::recordWorkers > 0
+                          ? JlEngineSettings::recordWorkers
+                          : JlWorkerPool::getDefaultWorkerCount();
+  double baselineMs = 0.0;
+
+  for (uint32_t workers = 1; primary != VK_NULL_HANDLE;
+       workers = min(workers * 2, maxWorkers)) {
+    JlVulkanCommandRecorder recorder(device_, queueFamily, 1, workers);
+
+    // The first pass allocates the command buffers, keep it out of the timing.
+    if (recordFrame(recorder) != VK_SUCCESS) {
+      cerr << JlEngineReports::jlGraphicsVulkan
+        << "Failed to submit recording benchmark." << endl;
+      break;
+    }
+    waitFrame(recorder);
+
+    using clock = chrono::steady_clock;
+    double recordMs = 0.0;
+    double frameMs = 0.0;
+    for (uint32_t i = 0; i < iterations; i++) {
+      clock::time_point start = clock::now();
+      recordFrame(recorder);
+      clock::time_point submitted = clock::now();
+      waitFrame(recorder);
+
+      recordMs += chrono::duration<double, milli>(submitted - start).count();
+      frameMs +=
+        chrono::duration<double, milli>(clock::now() - start).count();
+    }
+    recordMs /= iterations;
+    frameMs /= iterations;
+
+    if (workers == 1) baselineMs = recordMs;
+
+    cout << JlEngineReports::jlGraphicsVulkan << "Recording benchmark: "
+      << workers << " workers / " << recordMs << " ms per "
+      << taskCount * drawsPerTask << " draws / "
+      << (taskCount * drawsPerTask) / recordMs << " draws per ms / "
+      << baselineMs / recordMs << "x / " << frameMs
+      << " ms submitted and done." << endl;
+
+    if (workers == maxWorkers) break;
+  }
+
+  if (primary != VK_NULL_HANDLE)
+    vk_->vkFreeCommandBuffers(device_, commandPool_, 1, &primary);
+  vk_->vkDestroyFence(device_, fence, allocator_);
+  vk_->vkDestroyFramebuffer(device_, targetFramebuffer, allocator_);
+  vk_->vkDestroyImageView(device_, targetView, allocator_);
+  if (target != VK_NULL_HANDLE)
+    JlVulkanMemory::destroyImage(target, targetAllocation);
+}
+
+void JlVulkanGraphics::benchmarkRenderGraph() {
+  // A deferred style frame with a debug pass nobody reads, to check the
+  // culling, barrier and aliasing numbers against a known layout.
+  using Graph = JlVulkanRenderGraph;
+  Graph graph(device_, features_.synchronization2);
+
+  VkImageUsageFlags targetUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                  VK_IMAGE_USAGE_SAMPLED_BIT;
+  Graph::ImageDesc color{ VK_FORMAT_R8G8B8A8_UNORM, swapChainExtent_,
+                          targetUsage, VK_IMAGE_ASPECT_COLOR_BIT };
+  Graph::ImageDesc hdr{ VK_FORMAT_R16G16B16A16_SFLOAT, swapChainExtent_,
+                        targetUsage, VK_IMAGE_ASPECT_COLOR_BIT };
+  Graph::ImageDesc depth{ VK_FORMAT_D32_SFLOAT, swapChainExtent_,
+                          VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                            VK_IMAGE_USAGE_SAMPLED_BIT,
+                          VK_IMAGE_ASPECT_DEPTH_BIT };
+
+  Graph::ResourceHandle albedo = graph.createImage("albedo", color);
+  Graph::ResourceHandle normal = graph.createImage("normal", hdr);
+  Graph::ResourceHandle depthBuffer = graph.createImage("depth", depth);
+  Graph::ResourceHandle ao = graph.createImage("ao", color);
+  Graph::ResourceHandle lit = graph.createImage("lit", hdr);
+  Graph::ResourceHandle bloom = graph.createImage("bloom", hdr);
+  Graph::ResourceHandle ldr = graph.createImage("ldr", color);
+  Graph::ResourceHandle debugView = graph.createImage("debug", color);
+
+  uint32_t gbuffer = graph.addPass("gbuffer", nullptr);
+  graph.write(gbuffer, albedo, Graph::ColorAttachment);
+  graph.write(gbuffer, normal, Graph::ColorAttachment);
+  graph.write(gbuffer, depthBuffer, Graph::DepthAttachment);
+
+  uint32_t ssao = graph.addPass("ssao", nullptr);
+  graph.read(ssao, depthBuffer, Graph::SampledGraphics);
+  graph.read(ssao, normal, Graph::SampledGraphics);
+  graph.write(ssao, ao, Graph::ColorAttachment);
+
+  uint32_t lighting = graph.addPass("lighting", nullptr);
+  graph.read(lighting, albedo, Graph::SampledGraphics);
+  graph.read(lighting, normal, Graph::SampledGraphics);
+  graph.read(lighting, depthBuffer, Graph::SampledGraphics);
+  graph.read(lighting, ao, Graph::SampledGraphics);
+  graph.write(lighting, lit, Graph::ColorAttachment);
+
+  uint32_t debug = graph.addPass("debug", nullptr);
+  graph.read(debug, normal, Graph::SampledGraphics);
+  graph.write(debug, debugView, Graph::ColorAttachment);
+
+  uint32_t bloomPass = graph.addPass("bloom", nullptr);
+  graph.read(bloomPass, lit, Graph::SampledGraphics);
+  graph.write(bloomPass, bloom, Graph::ColorAttachment);
+
+  uint32_t tonemap = graph.addPass("tonemap", nullptr);
+  graph.read(tonemap, lit, Graph::SampledGraphics);
+  graph.read(tonemap, bloom, Graph::SampledGraphics);
+  graph.write(tonemap, ldr, Graph::ColorAttachment);
+  graph.setSideEffects(tonemap);
+
+  using clock = chrono::steady_clock;
+  clock::time_point start = clock::now();
+  bool compiled = graph.compile();
+  double compileMs =
+    chrono::duration<double, milli>(clock::now() - start).count();
+
+  if (!compiled) return;
+
+  graph.dumpSchedule();
+  cout << JlEngineReports::jlGraphicsVulkan << "Render graph benchmark: "
+    << compileMs << " ms to compile." << endl;
+}
+
+void JlVulkanGraphics::benchmarkRenderPaths() {
+  const uint32_t passCount = 4096;
+  uint32_t imageCount = static_cast<uint32_t>(swapChainImageViews_.size());
+
+  using clock = chrono::steady_clock;
+
+  // Render pass and framebuffers are the objects rebuilt on every resize,
+  // dynamic rendering needs neither.
+  VkAttachmentDescription colorAttachment{};
+  colorAttachment.format = swapChainImageFormat_;
+  colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference colorAttachmentRef{};
+  colorAttachmentRef.attachment = 0;
+  colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  VkSubpassDescription subpass{};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &colorAttachmentRef;
+
+  VkRenderPassCreateInfo renderPassInfo{};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  renderPassInfo.attachmentCount = 1;
+  renderPassInfo.pAttachments = &colorAttachment;
+  renderPassInfo.subpassCount = 1;
+  renderPassInfo.pSubpasses = &subpass;
+
+  clock::time_point start = clock::now();
+
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+  vector<VkFramebuffer> framebuffers(imageCount, VK_NULL_HANDLE);
+  vk_->vkCreateRenderPass(device_, &renderPassInfo, allocator_, &renderPass);
+  for (uint32_t i = 0; i < imageCount; i++) {
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = renderPass;
+    framebufferInfo.attachmentCount = 1;
+    framebufferInfo.pAttachments = &swapChainImageViews_[i];
+    framebufferInfo.width = swapChainExtent_.width;
+    framebufferInfo.height = swapChainExtent_.height;
+    framebufferInfo.layers = 1;
+    vk_->vkCreateFramebuffer(device_, &framebufferInfo, allocator_,
+                             &framebuffers[i]);
+  }
+
+  double objectsMs =
+    chrono::duration<double, milli>(clock::now() - start).count();
+
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = commandPool_;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = 1;
+
+  VkCommandBuffer commandBuffer;
+  vk_->vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer);
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
+
+  // Only recorded, never submitted, this measures the CPU side alone.
+  start = clock::now();
+  vk_->vkBeginCommandBuffer(commandBuffer, &beginInfo);
+  for (uint32_t i = 0; i < passCount; i++) {
+    VkRenderPassBeginInfo passBegin{};
+    passBegin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    passBegin.renderPass = renderPass;
+    passBegin.framebuffer = framebuffers[i % imageCount];
+    passBegin.renderArea.extent = swapChainExtent_;
+    passBegin.clearValueCount = 1;
+    passBegin.pClearValues = &clearColor;
+
+    vk_->vkCmdBeginRenderPass(commandBuffer, &passBegin,
+                              VK_SUBPASS_CONTENTS_INLINE);
+    vk_->vkCmdEndRenderPass(commandBuffer);
+  }
+  vk_->vkEndCommandBuffer(commandBuffer);
+  double legacyMs =
+    chrono::duration<double, milli>(clock::now() - start).count();
+  vk_->vkResetCommandBuffer(commandBuffer, 0);
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Render path benchmark: "
+    << "legacy " << 1 + imageCount << " objects in " << objectsMs
+    << " ms / " << legacyMs << " ms for " << passCount << " passes."
+    << endl;
+
+  if (features_.dynamicRendering) {
+    start = clock::now();
+    vk_->vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    for (uint32_t i = 0; i < passCount; i++) {
+      VkRenderingAttachmentInfo attachment{};
+      attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+      attachment.imageView = swapChainImageViews_[i % imageCount];
+      attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+      attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+      attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+      attachment.clearValue = clearColor;
+
+      VkRenderingInfo renderingInfo{};
+      renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+      renderingInfo.renderArea.extent = swapChainExtent_;
+      renderingInfo.layerCount = 1;
+      renderingInfo.colorAttachmentCount = 1;
+      renderingInfo.pColorAttachments = &attachment;
+
+      vk_->vkCmdBeginRendering(commandBuffer, &renderingInfo);
+      vk_->vkCmdEndRendering(commandBuffer);
+    }
+    vk_->vkEndCommandBuffer(commandBuffer);
+    double dynamicMs =
+      chrono::duration<double, milli>(clock::now() - start).count();
+    vk_->vkResetCommandBuffer(commandBuffer, 0);
+
+    cout << JlEngineReports::jlGraphicsVulkan << "Render path benchmark: "
+      << "dynamic 0 objects / " << dynamicMs << " ms for " << passCount
+      << " passes / " << legacyMs / dynamicMs << "x." << endl;
+  }
+
+  // Barriers of the frame graph, batched into one call per pass against
+  // one call per barrier done naively.
+  JlVulkanRenderGraph::Stats graphStats = frameGraph_->getStats();
+  cout << JlEngineReports::jlGraphicsVulkan << "Render path benchmark: "
+    << graphStats.barriers << " frame barriers in "
+    << graphStats.barrierBatches << " calls, "
+    << graphStats.naiveBarriers << " naively, "
+    << (features_.synchronization2 ? "vkQueueSubmit2." : "vkQueueSubmit.")
+    << endl;
+
+  vk_->vkFreeCommandBuffers(device_, commandPool_, 1, &commandBuffer);
+  for (VkFramebuffer framebuffer : framebuffers)
+    vk_->vkDestroyFramebuffer(device_, framebuffer, allocator_);
+  vk_->vkDestroyRenderPass(device_, renderPass, allocator_);
+}
+
+void JlVulkanGraphics::benchmarkGpuCulling() {
+  if (!features_.multiDrawIndirect) {
+    cout << JlEngineReports::jlGraphicsVulkan
+      << "GPU culling benchmark skipped, no multi draw indirect." << endl;
+    return;
+  }
+
+  const uint32_t sceneSizes[] = { 1000, 10000, 100000 };
+  const float sceneExtent = 500.0f;
+
+  JlVulkanCulling culling(device_, features_.drawIndirectCount);
+  if (!culling.init(JlEngineDirectories::appDir.string() +
+                      JlEngineDirectories::compiledShadersDir.string(),
+                    swapChainImageFormat_, renderPass_))
+    return;
+
+  // Seeded, so every run culls the same scene.
+  mt19937 random(1234);
+  uniform_real_distribution<float> position(-sceneExtent, sceneExtent);
+  uniform_real_distribution<float> radius(0.5f, 3.0f);
+  vector<JlVulkanCulling::Instance> instances(sceneSizes[2]);
+  for (JlVulkanCulling::Instance& instance : instances) {
+    instance = {};
+    instance.center = { position(random), position(random), position(random) };
+    instance.radius = radius(random);
+    instance.indexCount = JlVulkanCulling::getCubeIndexCount();
+  }
+
+  float aspect = static_cast<float>(swapChainExtent_.width) /
+                 static_cast<float>(swapChainExtent_.height);
+  glm::mat4 projection =
+    glm::perspective(glm::radians(60.0f), aspect, 0.1f, 2.0f * sceneExtent);
+  projection[1][1] *= -1.0f;
+  glm::mat4 viewProjection =
+    projection * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+                             glm::vec3(0.0f, 1.0f, 0.0f));
+
+  // A target of its own, swap chain images can't be rendered unacquired.
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.format = swapChainImageFormat_;
+  imageInfo.extent = { swapChainExtent_.width, swapChainExtent_.height, 1 };
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  VkImage target = VK_NULL_HANDLE;
+  JlVulkanMemory::Allocation targetAllocation;
+  VkImageView targetView = VK_NULL_HANDLE;
+  VkFramebuffer targetFramebuffer = VK_NULL_HANDLE;
+
+  VkBufferCreateInfo readbackInfo{};
+  readbackInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  readbackInfo.size = sizeof(uint32_t);
+  readbackInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  readbackInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VkBuffer readback = VK_NULL_HANDLE;
+  JlVulkanMemory::Allocation readbackAllocation;
+
+  VkQueryPoolCreateInfo queryInfo{};
+  queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  queryInfo.queryCount = 3;
+
+  VkQueryPool queries = VK_NULL_HANDLE;
+  VkFence fence = VK_NULL_HANDLE;
+  VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+
+  try {
+    if (JlVulkanMemory::createImage(imageInfo,
+                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                    JlVulkanMemory::Buddy, &target,
+                                    targetAllocation) != VK_SUCCESS)
+      throw runtime_error("Failed to create culling benchmark target.");
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = target;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = swapChainImageFormat_;
+    viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    if (vk_->vkCreateImageView(device_, &viewInfo, allocator_, &targetView) !=
+        VK_SUCCESS)
+      throw runtime_error("Failed to create culling benchmark target.");
+
+    if (!features_.dynamicRendering) {
+      VkFramebufferCreateInfo framebufferInfo{};
+      framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+      framebufferInfo.renderPass = renderPass_;
+      framebufferInfo.attachmentCount = 1;
+      framebufferInfo.pAttachments = &targetView;
+      framebufferInfo.width = swapChainExtent_.width;
+      framebufferInfo.height = swapChainExtent_.height;
+      framebufferInfo.layers = 1;
+      if (vk_->vkCreateFramebuffer(device_, &framebufferInfo, allocator_,
+                                   &targetFramebuffer) != VK_SUCCESS)
+        throw runtime_error("Failed to create culling benchmark target.");
+    }
+
+    if (JlVulkanMemory::createBuffer(
+          readbackInfo,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+          0, JlVulkanMemory::Buddy, &readback,
+          readbackAllocation) != VK_SUCCESS)
+      throw runtime_error("Failed to create culling readback buffer.");
+
+    if (vk_->vkCreateQueryPool(device_, &queryInfo, allocator_, &queries) !=
+        VK_SUCCESS)
+      throw runtime_error("Failed to create culling query pool.");
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vk_->vkCreateFence(device_, &fenceInfo, allocator_, &fence) !=
+        VK_SUCCESS)
+      throw runtime_error("Failed to create culling benchmark fence.");
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool_;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    if (vk_->vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer) !=
+        VK_SUCCESS)
+      throw runtime_error("Failed to allocate culling command buffer.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+  }
+
+  VkViewport viewport{};
+  viewport.width = static_cast<float>(swapChainExtent_.width);
+  viewport.height = static_cast<float>(swapChainExtent_.height);
+  viewport.maxDepth = 1.0f;
+
+  VkRect2D scissor{};
+  scissor.extent = swapChainExtent_;
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  using clock = chrono::steady_clock;
+
+  for (uint32_t i = 0; commandBuffer != VK_NULL_HANDLE && i < 3; i++) {
+    uint32_t instanceCount = sceneSizes[i];
+    if (!culling.setInstances(vector<JlVulkanCulling::Instance>(
+          instances.begin(), instances.begin() + instanceCount)))
+      break;
+
+    clock::time_point start = clock::now();
+    vk_->vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    vk_->vkCmdResetQueryPool(commandBuffer, queries, 0, 3);
+
+    culling.recordReset(commandBuffer);
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
+                            VK_ACCESS_SHADER_WRITE_BIT;
+    vk_->vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                              &barrier, 0, nullptr, 0, nullptr);
+
+    vk_->vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                             queries, 0);
+    culling.recordCull(commandBuffer, viewProjection);
+    vk_->vkCmdWriteTimestamp(commandBuffer,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, queries, 1);
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+                            VK_ACCESS_TRANSFER_READ_BIT;
+
+    VkImageMemoryBarrier targetBarrier{};
+    targetBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    targetBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    targetBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    targetBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    targetBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    targetBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    targetBarrier.image = target;
+    targetBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+    vk_->vkCmdPipelineBarrier(commandBuffer,
+                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                              VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                                VK_PIPELINE_STAGE_TRANSFER_BIT |
+                                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                              0, 1, &barrier, 0, nullptr, 1, &targetBarrier);
+
+    VkBufferCopy countCopy{ 0, 0, sizeof(uint32_t) };
+    vk_->vkCmdCopyBuffer(commandBuffer, culling.getCountBuffer(), readback, 1,
+                         &countCopy);
+
+    VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
+    if (features_.dynamicRendering) {
+      VkRenderingAttachmentInfo colorAttachment{};
+      colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+      colorAttachment.imageView = targetView;
+      colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+      colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+      colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+      colorAttachment.clearValue = clearColor;
+
+      VkRenderingInfo renderingInfo{};
+      renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+      renderingInfo.renderArea.extent = swapChainExtent_;
+      renderingInfo.layerCount = 1;
+      renderingInfo.colorAttachmentCount = 1;
+      renderingInfo.pColorAttachments = &colorAttachment;
+      vk_->vkCmdBeginRendering(commandBuffer, &renderingInfo);
+    }
+    else {
+      VkRenderPassBeginInfo renderPassInfo{};
+      renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+      renderPassInfo.renderPass = renderPass_;
+      renderPassInfo.framebuffer = targetFramebuffer;
+      renderPassInfo.renderArea.extent = swapChainExtent_;
+      renderPassInfo.clearValueCount = 1;
+      renderPassInfo.pClearValues = &clearColor;
+      vk_->vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                                VK_SUBPASS_CONTENTS_INLINE);
+    }
+
+    vk_->vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vk_->vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    culling.recordDraw(commandBuffer, viewProjection);
+
+    if (features_.dynamicRendering)
+      vk_->vkCmdEndRendering(commandBuffer);
+    else
+      vk_->vkCmdEndRenderPass(commandBuffer);
+
+    vk_->vkCmdWriteTimestamp(commandBuffer,
+                             VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queries, 2);
+    vk_->vkEndCommandBuffer(commandBuffer);
+    double recordMs =
+      chrono::duration<double, milli>(clock::now() - start).count();
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    vk_->vkQueueSubmit(graphicsQueue_, 1, &submitInfo, fence);
+    vk_->vkWaitForFences(device_, 1, &fence, VK_TRUE, UINT64_MAX);
+    vk_->vkResetFences(device_, 1, &fence);
+    vk_->vkResetCommandBuffer(commandBuffer, 0);
+
+    uint64_t timestamps[3] = {};
+    vk_->vkGetQueryPoolResults(device_, queries, 0, 3, sizeof(timestamps),
+                               timestamps, sizeof(uint64_t),
+                               VK_QUERY_RESULT_64_BIT);
+    double period = deviceProperties_.limits.timestampPeriod / 1000000.0;
+    double cullMs = (timestamps[1] - timestamps[0]) * period;
+    double drawMs = (timestamps[2] - timestamps[1]) * period;
+
+    // What the CPU records when it submits every instance itself.
+    start = clock::now();
+    vk_->vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    for (uint32_t instance = 0; instance < instanceCount; instance++)
+      vk_->vkCmdDrawIndexed(commandBuffer,
+                            JlVulkanCulling::getCubeIndexCount(), 1, 0, 0,
+                            instance);
+    vk_->vkEndCommandBuffer(commandBuffer);
+    double cpuDrivenMs =
+      chrono::duration<double, milli>(clock::now() - start).count();
+    vk_->vkResetCommandBuffer(commandBuffer, 0);
+
+    cout << JlEngineReports::jlGraphicsVulkan << "GPU culling benchmark: "
+      << instanceCount << " instances / ";
+    if (features_.drawIndirectCount)
+      cout << *static_cast<uint32_t*>(readbackAllocation.mapped)
+        << " visible / ";
+    cout << "record " << recordMs << " ms (" << cpuDrivenMs
+      << " ms CPU driven) / GPU cull " << cullMs << " ms / draw " << drawMs
+      << " ms." << endl;
+  }
+
+  if (commandBuffer != VK_NULL_HANDLE)
+    vk_->vkFreeCommandBuffers(device_, commandPool_, 1, &commandBuffer);
+  vk_->vkDestroyFence(device_, fence, allocator_);
+  vk_->vkDestroyQueryPool(device_, queries, allocator_);
+  if (readback != VK_NULL_HANDLE)
+    JlVulkanMemory::destroyBuffer(readback, readbackAllocation);
+  vk_->vkDestroyFramebuffer(device_, targetFramebuffer, allocator_);
+  vk_->vkDestroyImageView(device_, targetView, allocator_);
+  if (target != VK_NULL_HANDLE)
+    JlVulkanMemory::destroyImage(target, targetAllocation);
+}
+
+void JlVulkanGraphics::benchmarkAsyncCompute() {
+  if (!JlVulkanQueueScheduler::isEnabled()) {
+    cout << JlEngineReports::jlGraphicsVulkan
+      << "Async compute benchmark skipped, no separate compute queue."
+      << endl;
+    return;
+  }
+
+  const uint32_t instanceCount = 100000;
+  const uint32_t cullRepeats = 16;
+  const uint32_t clearPasses = 8;
+  const uint32_t iterations = 16;
+
+  JlVulkanCulling culling(device_, features_.drawIndirectCount);
+  if (!culling.init(JlEngineDirectories::appDir.string() +
+                      JlEngineDirectories::compiledShadersDir.string(),
+                    swapChainImageFormat_, renderPass_))
+    return;
+
+  mt19937 random(1234);
+  uniform_real_distribution<float> position(-500.0f, 500.0f);
+  vector<JlVulkanCulling::Instance> instances(instanceCount);
+  for (JlVulkanCulling::Instance& instance : instances) {
+    instance = {};
+    instance.center = { position(random), position(random), position(random) };
+    instance.radius = 1.0f;
+    instance.indexCount = JlVulkanCulling::getCubeIndexCount();
+  }
+  if (!culling.setInstances(instances)) return;
+
+  glm::mat4 viewProjection =
+    glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 1000.0f);
+
+  VkBufferCreateInfo readbackInfo{};
+  readbackInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  readbackInfo.size = sizeof(uint32_t);
+  readbackInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  readbackInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VkBuffer readback = VK_NULL_HANDLE;
+  JlVulkanMemory::Allocation readbackAllocation;
+  VkFence fence = VK_NULL_HANDLE;
+  VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+
+  try {
+    if (JlVulkanMemory::createBuffer(
+          readbackInfo,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+          0, JlVulkanMemory::Buddy, &readback,
+          readbackAllocation) != VK_SUCCESS)
+      throw runtime_error("Failed to create async compute readback buffer.");
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vk_->vkCreateFence(device_, &fenceInfo, allocator_, &fence) !=
+        VK_SUCCESS)
+      throw runtime_error("Failed to create async compute benchmark fence.");
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool_;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    if (vk_->vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer) !=
+        VK_SUCCESS)
+      throw runtime_error("Failed to allocate async compute command buffer.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+  }
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  // Clears on the graphics queue with nothing to do with the culling, then
+  // a pass reading the culled count back. The same graph runs once with
+  // everything on the graphics queue and once with the culling on the
+  // compute queue, overlapping the clears.
+  using Graph = JlVulkanRenderGraph;
+  uint32_t graphicsFamily =
+    findQueueFamilies(physicalDevice_).graphicsFamily.value();
+  uint32_t computeFamilies[] = { VK_QUEUE_FAMILY_IGNORED,
+                                 JlVulkanQueueScheduler::getComputeFamily() };
+  double frameMs[2] = {};
+  JlVulkanQueueScheduler::Stats queueStats[2];
+
+  for (uint32_t variant = 0; commandBuffer != VK_NULL_HANDLE && variant < 2;
+       variant++) {
+    Graph graph(device_, features_.synchronization2);
+    graph.setQueueFamilies(graphicsFamily, computeFamilies[variant]);
+
+    Graph::ImageDesc canvasDesc{ VK_FORMAT_R8G8B8A8_UNORM, { 4096, 4096 },
+                                 VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                                 VK_IMAGE_ASPECT_COLOR_BIT };
+    for (uint32_t i = 0; i < clearPasses; i++) {
+      Graph::ResourceHandle canvas =
+        graph.createImage("canvas" + to_string(i), canvasDesc);
+      uint32_t clear = graph.addPass(
+        "clear" + to_string(i), [&graph, canvas](VkCommandBuffer commandBuffer) {
+          VkClearColorValue color = { {0.2f, 0.4f, 0.6f, 1.0f} };
+          VkImageSubresourceRange range{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+          vk_->vkCmdClearColorImage(commandBuffer, graph.getImage(canvas),
+                                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                    &color, 1, &range);
+        });
+      graph.write(clear, canvas, Graph::TransferDst);
+      graph.setSideEffects(clear);
+    }
+
+    Graph::ResourceHandle draws =
+      graph.importBuffer("draws", culling.getDrawBuffer());
+    Graph::ResourceHandle count =
+      graph.importBuffer("count", culling.getCountBuffer());
+
+    // The fill and the dispatch are passes of their own, so the graph orders
+    // them and each pass declares one use of the count.
+    for (uint32_t i = 0; i < cullRepeats; i++) {
+      uint32_t reset = graph.addPass(
+        "reset" + to_string(i), [&](VkCommandBuffer commandBuffer) {
+          culling.recordReset(commandBuffer);
+        });
+      graph.write(reset, count, Graph::TransferDst);
+      graph.setQueue(reset, Graph::ComputeQueue);
+
+      uint32_t cull = graph.addPass(
+        "cull" + to_string(i), [&](VkCommandBuffer commandBuffer) {
+          culling.recordCull(commandBuffer, viewProjection);
+        });
+      graph.write(cull, draws, Graph::StorageWrite);
+      graph.write(cull, count, Graph::StorageWrite);
+      graph.setQueue(cull, Graph::ComputeQueue);
+    }
+
+    uint32_t consume =
+      graph.addPass("consume", [&](VkCommandBuffer commandBuffer) {
+        VkBufferCopy countCopy{ 0, 0, sizeof(uint32_t) };
+        vk_->vkCmdCopyBuffer(commandBuffer, graph.getBuffer(count), readback, 1,
+                             &countCopy);
+      });
+    graph.read(consume, count, Graph::TransferSrc);
+    graph.setSideEffects(consume);
+
+    if (!graph.compile()) break;
+    if (variant == 1) graph.dumpSchedule();
+
+    JlVulkanQueueScheduler::FrameSubmit frameSubmit;
+    frameSubmit.commandBuffer = commandBuffer;
+    frameSubmit.fence = fence;
+
+    // The first run warms up, its queue times are dropped.
+    using clock = chrono::steady_clock;
+    clock::time_point start;
+    for (uint32_t i = 0; i <= iterations; i++) {
+      JlVulkanQueueScheduler::beginFrame(0);
+      if (i == 1) {
+        JlVulkanQueueScheduler::resetStats();
+        start = clock::now();
+      }
+
+      vk_->vkBeginCommandBuffer(commandBuffer, &beginInfo);
+      if (JlVulkanQueueScheduler::submit(graph, 0, frameSubmit) !=
+          VK_SUCCESS)
+        break;
+      vk_->vkWaitForFences(device_, 1, &fence, VK_TRUE, UINT64_MAX);
+      vk_->vkResetFences(device_, 1, &fence);
+      vk_->vkResetCommandBuffer(commandBuffer, 0);
+    }
+    JlVulkanQueueScheduler::beginFrame(0);
+
+    frameMs[variant] =
+      chrono::duration<double, milli>(clock::now() - start).count() /
+      iterations;
+    queueStats[variant] = JlVulkanQueueScheduler::getStats();
+  }
+
+  for (uint32_t variant = 0; variant < 2; variant++) {
+    double frames = max<double>(
+      static_cast<double>(queueStats[variant].frames), 1.0);
+    cout << JlEngineReports::jlGraphicsVulkan << "Async compute benchmark: "
+      << (variant == 0 ? "single queue / " : "async compute / ")
+      << frameMs[variant] << " ms per frame / graphics "
+      << queueStats[variant].graphicsMs / frames << " ms, compute "
+      << queueStats[variant].computeMs / frames << " ms";
+    // Busy time beyond the frame's wall clock time can only have overlapped,
+    // a lower bound as the frame also includes the CPU's submit and wait.
+    double overlapMs = (queueStats[variant].graphicsMs +
+                        queueStats[variant].computeMs) / frames -
+                       frameMs[variant];
+    if (variant == 1)
+      cout << ", overlapped at least " << max(overlapMs, 0.0) << " ms";
+    if (variant == 1 && frameMs[1] > 0.0)
+      cout << " / " << frameMs[0] / frameMs[1] << "x";
+    cout << "." << endl;
+  }
+  JlVulkanQueueScheduler::resetStats();
+
+  if (commandBuffer != VK_NULL_HANDLE)
+    vk_->vkFreeCommandBuffers(device_, commandPool_, 1, &commandBuffer);
+  vk_->vkDestroyFence(device_, fence, allocator_);
+  if (readback != VK_NULL_HANDLE)
+    JlVulkanMemory::destroyBuffer(readback, readbackAllocation);
+}
+
+void JlVulkanGraphics::benchmarkPipelineCompiler() {
+  using Compiler = JlVulkanPipelineCompiler;
+  string cshDir = JlEngineDirectories::appDir.string() +
+                  JlEngineDirectories::compiledShadersDir.string();
+
+  Compiler::GraphicsState base;
+  try {
+    base.vertexShader = Compiler::loadShader(readFile(cshDir + "base.vert.spv"));
+    base.fragmentShader =
+      Compiler::loadShader(readFile(cshDir + "base.frag.spv"));
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return;
+  }
+  base.layout = pipelineLayout_;
+  base.colorFormats = { swapChainImageFormat_ };
+  base.renderPass = renderPass_;
+
+  Compiler::Key fallback = Compiler::registerFallback(base);
+
+  // Material permutations the renderer would meet one by one.
+  const VkCullModeFlags cullModes[] = { VK_CULL_MODE_NONE,
+                                        VK_CULL_MODE_FRONT_BIT,
+                                        VK_CULL_MODE_BACK_BIT,
+                                        VK_CULL_MODE_FRONT_AND_BACK };
+  const VkFrontFace frontFaces[] = { VK_FRONT_FACE_CLOCKWISE,
+                                     VK_FRONT_FACE_COUNTER_CLOCKWISE };
+  const VkPrimitiveTopology topologies[] = {
+    VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP
+  };
+
+  // Permutations changing one thing come first, each needs new parts. The
+  // rest only recombine those, which pipeline libraries link from parts
+  // already compiled.
+  vector<Compiler::GraphicsState> newStates, recombinedStates;
+  for (VkCullModeFlags cullMode : cullModes)
+    for (VkFrontFace frontFace : frontFaces)
+      for (VkPrimitiveTopology topology : topologies)
+        for (uint32_t blend = 0; blend < 2; blend++) {
+          Compiler::GraphicsState state = base;
+          state.cullMode = cullMode;
+          state.frontFace = frontFace;
+          state.topology = topology;
+          state.blend = blend == 1;
+          if (Compiler::getKey(state) == fallback) continue;
+
+          uint32_t changes = (cullMode != base.cullMode) +
+                             (frontFace != base.frontFace) +
+                             (topology != base.topology) +
+                             (state.blend != base.blend);
+          if (changes == 1)
+            newStates.push_back(state);
+          else
+            recombinedStates.push_back(state);
+        }
+
+  // Every simulated frame asks for every permutation of its phase, as a
+  // scene using all of them would, until no compile is outstanding.
+  using clock = chrono::steady_clock;
+  auto runPhase = [&](const char* name,
+                      const vector<Compiler::GraphicsState>& states) {
+    Compiler::Stats before = Compiler::getStats();
+    clock::time_point start = clock::now();
+    double maxFrameMs = 0.0;
+    uint32_t frames = 0;
+
+    for (bool pending = true; pending; frames++) {
+      clock::time_point frameStart = clock::now();
+      Compiler::beginFrame();
+
+      for (const Compiler::GraphicsState& state : states)
+        Compiler::getPipeline(state, fallback);
+      pending = Compiler::getStats().queueDepth > 0;
+
+      maxFrameMs = max(maxFrameMs, chrono::duration<double, milli>(
+                                     clock::now() - frameStart).count());
+      if (pending) this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    double readyMs =
+      chrono::duration<double, milli>(clock::now() - start).count();
+    Compiler::Stats after = Compiler::getStats();
+
+    cout << JlEngineReports::jlGraphicsVulkan << "Pipeline compiler benchmark, "
+      << name << ": " << states.size() << " permutations ready after "
+      << frames << " frames / " << readyMs << " ms / render thread at most "
+      << maxFrameMs << " ms per frame, "
+      << after.compiled - before.compiled << " compiled in "
+      << after.compileMs - before.compileMs << " ms / "
+      << after.fastLinks - before.fastLinks << " fast-linked in "
+      << after.fastLinkMs - before.fastLinkMs << " ms / fallback in "
+      << after.fallbackFrames - before.fallbackFrames << " frames." << endl;
+  };
+
+  runPhase("new parts", newStates);
+  runPhase("recombined parts", recombinedStates);
+
+  // Optimized links finish in the background, report them once they did.
+  while (Compiler::getStats().pendingOptimizations > 0) {
+    this_thread::sleep_for(chrono::milliseconds(1));
+    Compiler::beginFrame();
+  }
+
+  Compiler::Stats stats = Compiler::getStats();
+  cout << JlEngineReports::jlGraphicsVulkan << "Pipeline compiler benchmark: "
+    << (Compiler::usesPipelineLibrary() ? "pipeline libraries, "
+                                        : "whole pipelines, ")
+    << stats.libraryParts << " parts, " << stats.optimizedLinks
+    << " optimized links in " << stats.optimizedLinkMs
+    << " ms / queue depth " << stats.maxQueueDepth << "." << endl;
+}
+
+void JlVulkanGraphics::benchmarkDescriptorAllocation() {
+  const uint32_t setsPerFrame = 1024;
+  const uint32_t iterations = 100;
+
+  // A typical per-draw set, a uniform block and the instance data.
+  VkDescriptorSetLayoutBinding bindings[2]{};
+  bindings[0].binding = 0;
+  bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  bindings[0].descriptorCount = 1;
+  bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  bindings[1].binding = 1;
+  bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  bindings[1].descriptorCount = 1;
+  bindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  VkDescriptorSetLayout layout = JlVulkanDescriptorCache::getLayout(
+    vector<VkDescriptorSetLayoutBinding>(begin(bindings), end(bindings)));
+
+  VkDescriptorPoolSize poolSizes[2] = {
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, setsPerFrame },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, setsPerFrame }
+  };
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+  poolInfo.maxSets = setsPerFrame;
+  poolInfo.poolSizeCount = 2;
+  poolInfo.pPoolSizes = poolSizes;
+
+  VkDescriptorPool pool = VK_NULL_HANDLE;
+  try {
+    if (layout == VK_NULL_HANDLE)
+      throw runtime_error("Failed to create benchmark descriptor layout.");
+    if (vk_->vkCreateDescriptorPool(device_, &poolInfo, allocator_, &pool) !=
+        VK_SUCCESS)
+      throw runtime_error("Failed to create benchmark descriptor pool.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return;
+  }
+
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = pool;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &layout;
+
+  using clock = chrono::steady_clock;
+  vector<VkDescriptorSet> sets(setsPerFrame, VK_NULL_HANDLE);
+
+  // Every set allocated and freed on its own.
+  clock::time_point start = clock::now();
+  for (uint32_t i = 0; i < iterations; i++) {
+    for (VkDescriptorSet& set : sets)
+      vk_->vkAllocateDescriptorSets(device_, &allocInfo, &set);
+    for (VkDescriptorSet set : sets)
+      if (set != VK_NULL_HANDLE)
+        vk_->vkFreeDescriptorSets(device_, pool, 1, &set);
+  }
+  double individualMs =
+    chrono::duration<double, milli>(clock::now() - start).count() /
+    iterations;
+  vk_->vkDestroyDescriptorPool(device_, pool, allocator_);
+
+  // The same sets from the frame allocator, recycled by one reset. The
+  // first frame creates the pools, keep it out of the timing.
+  JlVulkanDescriptorAllocator frameAllocator(device_, 1, 1);
+  for (uint32_t i = 0; i < setsPerFrame; i++)
+    frameAllocator.allocate(0, 0, layout);
+  frameAllocator.resetFrame(0);
+
+  start = clock::now();
+  for (uint32_t i = 0; i < iterations; i++) {
+    for (uint32_t j = 0; j < setsPerFrame; j++)
+      frameAllocator.allocate(0, 0, layout);
+    frameAllocator.resetFrame(0);
+  }
+  double bulkMs =
+    chrono::duration<double, milli>(clock::now() - start).count() /
+    iterations;
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Descriptor benchmark: "
+    << setsPerFrame << " sets per frame / " << individualMs
+    << " ms allocated and freed one by one / " << bulkMs
+    << " ms with one reset per pool / " << individualMs / bulkMs << "x."
+    << endl;
+  frameAllocator.reportStats("Benchmark");
+
+  // Long-lived sets, a few distinct ones looked up over and over the way
+  // materials are, written once each and hits from then on.
+  const uint32_t cachedSetCount = 64;
+  VkDeviceSize stride =
+    max({ deviceProperties_.limits.minUniformBufferOffsetAlignment,
+          deviceProperties_.limits.minStorageBufferOffsetAlignment,
+          VkDeviceSize(256) });
+
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = stride * cachedSetCount;
+  bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  try {
+    if (cachedSetBuffer_ == VK_NULL_HANDLE &&
+        JlVulkanMemory::createBuffer(
+          bufferInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+          JlVulkanMemory::Buddy, &cachedSetBuffer_, cachedSetAllocation_) !=
+          VK_SUCCESS) {
+      cachedSetBuffer_ = VK_NULL_HANDLE;
+      throw runtime_error("Failed to create cached descriptor set buffer.");
+    }
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return;
+  }
+
+  vector<vector<JlVulkanDescriptorCache::Write>> materials(cachedSetCount);
+  for (uint32_t i = 0; i < cachedSetCount; i++) {
+    JlVulkanDescriptorCache::Write uniform;
+    uniform.binding = 0;
+    uniform.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uniform.buffer = { cachedSetBuffer_, stride * i, stride };
+
+    JlVulkanDescriptorCache::Write storage;
+    storage.binding = 1;
+    storage.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    storage.buffer = { cachedSetBuffer_, stride * i, stride };
+
+    materials[i] = { uniform, storage };
+  }
+
+  JlVulkanDescriptorCache::Stats before = JlVulkanDescriptorCache::getStats();
+  start = clock::now();
+  for (uint32_t i = 0; i < iterations; i++)
+    for (uint32_t j = 0; j < setsPerFrame; j++)
+      JlVulkanDescriptorCache::getSet(layout, materials[j % cachedSetCount]);
+  double cachedMs =
+    chrono::duration<double, milli>(clock::now() - start).count() /
+    iterations;
+  JlVulkanDescriptorCache::Stats after = JlVulkanDescriptorCache::getStats();
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Descriptor benchmark: "
+    << setsPerFrame << " cached set lookups per frame over "
+    << cachedSetCount << " sets / " << cachedMs << " ms / "
+    << after.sets - before.sets << " written, " << after.hits - before.hits
+    << " hits, " << after.collisions - before.collisions << " collisions."
     << endl;
 }
 
+void JlVulkanGraphics::benchmarkDispatch() {
+  const uint32_t commandCount = 100000;
+  const uint32_t iterations = 8;
+
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = commandPool_;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = 1;
+
+  VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+  try {
+    if (vk_->vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer) !=
+        VK_SUCCESS)
+      throw runtime_error("Failed to allocate dispatch benchmark buffer.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return;
+  }
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  VkViewport viewport{ 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f };
+  VkRect2D scissor{ { 0, 0 }, { 1, 1 } };
+
+  using clock = chrono::steady_clock;
+  double loaderMs = 0.0, dispatchMs = 0.0;
+
+  // Dynamic state is the cheapest thing to record, what's left is mostly
+  // the call itself. Both ways record the same buffer, interleaved so
+  // neither gets the warmer caches.
+  for (uint32_t i = 0; i < iterations; i++) {
+    vk_->vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    clock::time_point start = clock::now();
+    for (uint32_t j = 0; j < commandCount; j++) {
+      ::vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+      ::vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    }
+    loaderMs += chrono::duration<double, milli>(clock::now() - start).count();
+    vk_->vkEndCommandBuffer(commandBuffer);
+    vk_->vkResetCommandBuffer(commandBuffer, 0);
+
+    vk_->vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    start = clock::now();
+    for (uint32_t j = 0; j < commandCount; j++) {
+      vk_->vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+      vk_->vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    }
+    dispatchMs +=
+      chrono::duration<double, milli>(clock::now() - start).count();
+    vk_->vkEndCommandBuffer(commandBuffer);
+    vk_->vkResetCommandBuffer(commandBuffer, 0);
+  }
+
+  vk_->vkFreeCommandBuffers(device_, commandPool_, 1, &commandBuffer);
+
+  double calls = 2.0 * commandCount * iterations;
+  double loaderNs = loaderMs * 1e6 / calls;
+  double dispatchNs = dispatchMs * 1e6 / calls;
+  cout << JlEngineReports::jlGraphicsVulkan << "Dispatch benchmark: "
+    << loaderNs << " ns per call through the loader / " << dispatchNs
+    << " ns per call from the device table / "
+    << (loaderNs - dispatchNs) / loaderNs * 100.0 << "% saved." << endl;
+}
+
+void JlVulkanGraphics::framebufferResizeCallback(GLFWwindow*, int, int) {
+  framebufferResized_ = true;
+}
+
 bool JlVulkanGraphics::createImageViews() {
   swapChainImageViews_.resize(swapChainImages_.size());
 
@@ -381,7 +2381,7 @@ bool JlVulkanGraphics::createImageViews() {
     createInfo.subresourceRange.layerCount = 1;
 
     try {
-      if (vkCreateImageView(device_, &createInfo, nullptr, &swapChainImageViews_[i]) != VK_SUCCESS)
+      if (vk_->vkCreateImageView(device_, &createInfo, allocator_, &swapChainImageViews_[i]) != VK_SUCCESS)
         throw std::runtime_error("Failed to create image views.");
     }
     catch (runtime_error& e) {
@@ -395,11 +2395,578 @@ bool JlVulkanGraphics::createImageViews() {
   return true;
 }
 
-void JlVulkanGraphics::createGraphicsPipeline() {
+bool JlVulkanGraphics::createRenderPass() {
+  // Dynamic rendering describes attachments when the pass begins, the
+  // pipeline only needs their formats.
+  if (features_.dynamicRendering) {
+    cout << JlEngineReports::jlGraphicsVulkan
+      << "Dynamic rendering, no render pass needed..." << endl;
+    return true;
+  }
+
+  VkAttachmentDescription colorAttachment{};
+  colorAttachment.format = swapChainImageFormat_;
+  colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  // The frame graph transitions the swap chain image around the pass.
+  colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference colorAttachmentRef{};
+  colorAttachmentRef.attachment = 0;
+  colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  VkSubpassDescription subpass{};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &colorAttachmentRef;
+
+  VkSubpassDependency dependency{};
+  dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependency.dstSubpass = 0;
+  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependency.srcAccessMask = 0;
+  dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+  VkRenderPassCreateInfo renderPassInfo{};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  renderPassInfo.attachmentCount = 1;
+  renderPassInfo.pAttachments = &colorAttachment;
+  renderPassInfo.subpassCount = 1;
+  renderPassInfo.pSubpasses = &subpass;
+  renderPassInfo.dependencyCount = 1;
+  renderPassInfo.pDependencies = &dependency;
+
+  try {
+    if (vk_->vkCreateRenderPass(device_, &renderPassInfo, allocator_, &renderPass_) !=
+        VK_SUCCESS)
+      throw runtime_error("Failed to create render pass.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return false;
+  }
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Render pass created..."
+    << endl;
+  return true;
+}
+
+bool JlVulkanGraphics::createGraphicsPipeline() {
+  string cshDir = JlEngineDirectories::appDir.string() +
+                  JlEngineDirectories::compiledShadersDir.string();
+
+  VkShaderModule vertShaderModule;
+  VkShaderModule fragShaderModule;
+  try {
+    vertShaderModule = createShaderModule(readFile(cshDir + "base.vert.spv"));
+    fragShaderModule = createShaderModule(readFile(cshDir + "base.frag.spv"));
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return false;
+  }
+
+  VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+  vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+  vertShaderStageInfo.module = vertShaderModule;
+  vertShaderStageInfo.pName = "main";
+
+  VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+  fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  fragShaderStageInfo.module = fragShaderModule;
+  fragShaderStageInfo.pName = "main";
+
+  VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo,
+                                                     fragShaderStageInfo };
+
+  VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+  vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+  VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+  inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+  VkPipelineViewportStateCreateInfo viewportState{};
+  viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewportState.viewportCount = 1;
+  viewportState.scissorCount = 1;
+
+  VkPipelineRasterizationStateCreateInfo rasterizer{};
+  rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  rasterizer.depthClampEnable = VK_FALSE;
+  rasterizer.rasterizerDiscardEnable = VK_FALSE;
+  rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+  rasterizer.lineWidth = 1.0f;
+  rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+  rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+  rasterizer.depthBiasEnable = VK_FALSE;
+
+  VkPipelineMultisampleStateCreateInfo multisampling{};
+  multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  multisampling.sampleShadingEnable = VK_FALSE;
+  multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+  VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+  colorBlendAttachment.colorWriteMask =
+    VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+    VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  colorBlendAttachment.blendEnable = VK_FALSE;
+
+  VkPipelineColorBlendStateCreateInfo colorBlending{};
+  colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  colorBlending.logicOpEnable = VK_FALSE;
+  colorBlending.attachmentCount = 1;
+  colorBlending.pAttachments = &colorBlendAttachment;
+
+  vector<VkDynamicState> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT,
+                                           VK_DYNAMIC_STATE_SCISSOR };
+
+  VkPipelineDynamicStateCreateInfo dynamicState{};
+  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+  dynamicState.pDynamicStates = dynamicStates.data();
+
+  // Set 0 is the bindless table, draws push their resource indices.
+  VkDescriptorSetLayout bindlessLayout = JlVulkanBindless::getSetLayout();
+  VkPushConstantRange pushConstantRange =
+    JlVulkanBindless::getPushConstantRange();
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  if (JlVulkanBindless::isAvailable()) {
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &bindlessLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+  }
+
+  bool success = true;
+  try {
+    if (vk_->vkCreatePipelineLayout(device_, &pipelineLayoutInfo, allocator_,
+                                    &pipelineLayout_) != VK_SUCCESS)
+      throw runtime_error("Failed to create pipeline layout.");
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = pipelineLayout_;
+    pipelineInfo.renderPass = renderPass_;
+    pipelineInfo.subpass = 0;
+
+    VkPipelineRenderingCreateInfo renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachmentFormats = &swapChainImageFormat_;
+    if (features_.dynamicRendering) pipelineInfo.pNext = &renderingInfo;
+
+    if (JlVulkanPipelineCache::createGraphicsPipeline(
+          pipelineInfo, &graphicsPipeline_) != VK_SUCCESS)
+      throw runtime_error("Failed to create graphics pipeline.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    success = false;
+  }
+
+  vk_->vkDestroyShaderModule(device_, fragShaderModule, allocator_);
+  vk_->vkDestroyShaderModule(device_, vertShaderModule, allocator_);
+
+  if (success)
+    cout << JlEngineReports::jlGraphicsVulkan << "Graphics pipeline created..."
+      << endl;
+  return success;
+}
+
+bool JlVulkanGraphics::createFramebuffers() {
+  if (features_.dynamicRendering) return true;
+
+  swapChainFramebuffers_.resize(swapChainImageViews_.size());
+
+  for (size_t i = 0; i < swapChainImageViews_.size(); i++) {
+    VkImageView attachments[] = { swapChainImageViews_[i] };
+
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = renderPass_;
+    framebufferInfo.attachmentCount = 1;
+    framebufferInfo.pAttachments = attachments;
+    framebufferInfo.width = swapChainExtent_.width;
+    framebufferInfo.height = swapChainExtent_.height;
+    framebufferInfo.layers = 1;
+
+    try {
+      if (vk_->vkCreateFramebuffer(device_, &framebufferInfo, allocator_,
+                                   &swapChainFramebuffers_[i]) != VK_SUCCESS)
+        throw runtime_error("Failed to create framebuffer.");
+    }
+    catch (runtime_error& e) {
+      cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+      return false;
+    }
+  }
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Framebuffers created..."
+    << endl;
+  return true;
+}
+
+bool JlVulkanGraphics::createCommandPool() {
+  QueueFamilyIndices indices = findQueueFamilies(physicalDevice_);
+
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.queueFamilyIndex = indices.graphicsFamily.value();
+
+  try {
+    if (vk_->vkCreateCommandPool(device_, &poolInfo, allocator_,
+                                 &commandPool_) != VK_SUCCESS)
+      throw runtime_error("Failed to create command pool.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return false;
+  }
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Command pool created..."
+    << endl;
+  return true;
+}
+
+bool JlVulkanGraphics::createFrameResources() {
+  framesInFlight_ = clamp(JlEngineSettings::framesInFlight, 1u, 3u);
+  frames_.resize(framesInFlight_);
+  currentFrame_ = 0;
+
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+  VkFenceCreateInfo fenceInfo{};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+  try {
+    for (FrameData& frame : frames_) {
+      VkCommandBufferAllocateInfo allocInfo{};
+      allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      allocInfo.commandPool = commandPool_;
+      allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+      allocInfo.commandBufferCount = 1;
+
+      if (vk_->vkAllocateCommandBuffers(device_, &allocInfo,
+                                        &frame.commandBuffer) != VK_SUCCESS)
+        throw runtime_error("Failed to allocate command buffers.");
+
+      if (vk_->vkCreateSemaphore(device_, &semaphoreInfo, allocator_,
+                                 &frame.imageAvailable) != VK_SUCCESS ||
+          vk_->vkCreateFence(device_, &fenceInfo, allocator_,
+                             &frame.inFlight) != VK_SUCCESS)
+        throw runtime_error("Failed to create frame sync objects.");
+
+      if (!headless_ || JlEngineSettings::readbackInterval == 0) continue;
+
+      VkBufferCreateInfo bufferInfo{};
+      bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+      bufferInfo.size = static_cast<VkDeviceSize>(swapChainExtent_.width) *
+                        swapChainExtent_.height * 4;
+      bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+      bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+      if (JlVulkanMemory::createBuffer(
+            bufferInfo,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            VK_MEMORY_PROPERTY_HOST_CACHED_BIT, JlVulkanMemory::Buddy,
+            &frame.readbackBuffer, frame.readbackAllocation) != VK_SUCCESS)
+        throw runtime_error("Failed to create readback buffer.");
+    }
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return false;
+  }
+
+  // The frame records on the render thread alone, one thread slot.
+  frameDescriptors_ =
+    make_unique<JlVulkanDescriptorAllocator>(device_, framesInFlight_, 1);
+
+  cout << JlEngineReports::jlGraphicsVulkan << framesInFlight_
+    << " frames in flight created..." << endl;
+  return true;
+}
+
+bool JlVulkanGraphics::createFrameGraph() {
+  frameGraph_ =
+    make_unique<JlVulkanRenderGraph>(device_, features_.synchronization2);
+  frameGraph_->setQueueFamilies(
+    findQueueFamilies(physicalDevice_).graphicsFamily.value(),
+    JlVulkanQueueScheduler::getComputeFamily());
+
+  // The image is only known once acquired, it's swapped in every frame.
+  backbuffer_ = frameGraph_->importImage(
+    "backbuffer", VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+    VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+    headless_ ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+  uint32_t mainPass =
+    frameGraph_->addPass("main", [](VkCommandBuffer commandBuffer) {
+      VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
+
+      if (features_.dynamicRendering) {
+        VkRenderingAttachmentInfo colorAttachment{};
+        colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        colorAttachment.imageView = swapChainImageViews_[frameImageIndex_];
+        colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.clearValue = clearColor;
+
+        VkRenderingInfo renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+        renderingInfo.renderArea.extent = swapChainExtent_;
+        renderingInfo.layerCount = 1;
+        renderingInfo.colorAttachmentCount = 1;
+        renderingInfo.pColorAttachments = &colorAttachment;
+
+        vk_->vkCmdBeginRendering(commandBuffer, &renderingInfo);
+      }
+      else {
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = renderPass_;
+        renderPassInfo.framebuffer = swapChainFramebuffers_[frameImageIndex_];
+        renderPassInfo.renderArea.offset = { 0, 0 };
+        renderPassInfo.renderArea.extent = swapChainExtent_;
+        renderPassInfo.clearValueCount = 1;
+        renderPassInfo.pClearValues = &clearColor;
+
+        vk_->vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                                  VK_SUBPASS_CONTENTS_INLINE);
+      }
+
+      vk_->vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                             graphicsPipeline_);
+      // Once per pass, draws only push their indices. Without descriptor
+      // indexing there is no table and this does nothing.
+      JlVulkanBindless::bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                             pipelineLayout_);
+
+      VkViewport viewport{};
+      viewport.x = 0.0f;
+      viewport.y = 0.0f;
+      viewport.width = static_cast<float>(swapChainExtent_.width);
+      viewport.height = static_cast<float>(swapChainExtent_.height);
+      viewport.minDepth = 0.0f;
+      viewport.maxDepth = 1.0f;
+      vk_->vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+      VkRect2D scissor{};
+      scissor.offset = { 0, 0 };
+      scissor.extent = swapChainExtent_;
+      vk_->vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+      vk_->vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+      if (features_.dynamicRendering)
+        vk_->vkCmdEndRendering(commandBuffer);
+      else
+        vk_->vkCmdEndRenderPass(commandBuffer);
+    });
+  frameGraph_->write(mainPass, backbuffer_,
+                     JlVulkanRenderGraph::ColorAttachment);
+
+  if (headless_ && JlEngineSettings::readbackInterval > 0) {
+    uint32_t readbackPass =
+      frameGraph_->addPass("readback", [](VkCommandBuffer commandBuffer) {
+        FrameData& frame = frames_[currentFrame_];
+        if (frameNumber_ % JlEngineSettings::readbackInterval != 0) return;
+
+        VkBufferImageCopy region{};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = { swapChainExtent_.width,
+                               swapChainExtent_.height, 1 };
+        vk_->vkCmdCopyImageToBuffer(commandBuffer,
+                                    swapChainImages_[frameImageIndex_],
+                                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                    frame.readbackBuffer, 1, &region);
+
+        VkBufferMemoryBarrier hostBarrier{};
+        hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        hostBarrier.buffer = frame.readbackBuffer;
+        hostBarrier.size = VK_WHOLE_SIZE;
+        vk_->vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                  VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1,
+                                  &hostBarrier, 0, nullptr);
+
+        frame.readbackFrame = frameNumber_;
+        frame.readbackPending = true;
+      });
+    frameGraph_->read(readbackPass, backbuffer_,
+                      JlVulkanRenderGraph::TransferSrc);
+    frameGraph_->setSideEffects(readbackPass);
+  }
+
+  if (!frameGraph_->compile()) return false;
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Frame graph compiled..."
+    << endl;
+  return true;
+}
+
+void JlVulkanGraphics::writeReadback(FrameData& frame) {
+  frame.readbackPending = false;
+
+  path directory = JlEngineDirectories::appDir / "frames";
+  path file = directory / ("frame_" + to_string(frame.readbackFrame) + ".ppm");
+
+  try {
+    create_directories(directory);
+
+    ofstream out(file, ios::binary | ios::trunc);
+    if (!out.is_open())
+      throw runtime_error("Failed to open \"" + file.string() + "\".");
+
+    out << "P6\n" << swapChainExtent_.width << " " << swapChainExtent_.height
+      << "\n255\n";
+
+    const uint8_t* pixels =
+      static_cast<const uint8_t*>(frame.readbackAllocation.mapped);
+    vector<char> row(swapChainExtent_.width * 3);
+    for (uint32_t y = 0; y < swapChainExtent_.height; y++) {
+      for (uint32_t x = 0; x < swapChainExtent_.width; x++) {
+        const uint8_t* pixel = pixels + (y * swapChainExtent_.width + x) * 4;
+        row[x * 3 + 0] = static_cast<char>(pixel[0]);
+        row[x * 3 + 1] = static_cast<char>(pixel[1]);
+        row[x * 3 + 2] = static_cast<char>(pixel[2]);
+      }
+      out.write(row.data(), row.size());
+    }
+  }
+  catch (exception& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+  }
+}
+
+bool JlVulkanGraphics::createPresentSemaphores() {
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+  // Presentation can still be reading a release semaphore after the frame
+  // that signaled it retired, so those are owned by the swap chain image.
+  renderFinishedSemaphores_.resize(swapChainImages_.size());
+  try {
+    for (VkSemaphore& semaphore : renderFinishedSemaphores_) {
+      if (vk_->vkCreateSemaphore(device_, &semaphoreInfo, allocator_,
+                                 &semaphore) != VK_SUCCESS)
+        throw runtime_error("Failed to create present semaphores.");
+    }
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return false;
+  }
+
+  return true;
+}
+
+void JlVulkanGraphics::recordCommandBuffer(VkCommandBuffer commandBuffer,
+                                           uint32_t imageIndex) {
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  vk_->vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+  frameUploadWait_ = JlVulkanUploader::recordGraphicsAcquire(commandBuffer);
+
+  JlVulkanProfiler::beginFrame(commandBuffer);
+
+  frameImageIndex_ = imageIndex;
+  frameGraph_->setImportedImage(backbuffer_, swapChainImages_[imageIndex]);
+
+  // Split over queues, the scheduler records the graph and ends it.
+  if (frameGraph_->getBatches().size() > 1) return;
+  {
+    JlVulkanProfiler::Scope scope(commandBuffer, "frame");
+    frameGraph_->execute(commandBuffer);
+  }
+
+  vk_->vkEndCommandBuffer(commandBuffer);
+}
+
+VkShaderModule JlVulkanGraphics::createShaderModule(const vector<char>& code) {
+  VkShaderModuleCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  createInfo.codeSize = code.size();
+  createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+  VkShaderModule shaderModule;
+  if (vk_->vkCreateShaderModule(device_, &createInfo, allocator_,
+                                &shaderModule) != VK_SUCCESS)
+    throw runtime_error("Failed to create shader module.");
+
+  return shaderModule;
+}
+
+vector<char> JlVulkanGraphics::readFile(const string& filename) {
+  ifstream file(filename, ios::ate | ios::binary);
+
+  if (!file.is_open())
+    throw runtime_error("Failed to open \"" + filename + "\".");
+
+  size_t fileSize = static_cast<size_t>(file.tellg());
+  vector<char> buffer(fileSize);
+
+  file.seekg(0);
+  file.read(buffer.data(), fileSize);
+
+  return buffer;
+}
+
+void JlVulkanGraphics::reportFrameStats() {
+  if (frameStats_.frames == 0) return;
+
+  double frames = static_cast<double>(frameStats_.frames);
+  double frameMs = frameStats_.frameMs / frames;
+  double waitMs = frameStats_.fenceWaitMs / frames;
+  double recordMs = frameStats_.recordMs / frames;
+
+  // Time not spent blocked on a frame fence is time the CPU worked while
+  // the GPU was still busy with earlier frames.
+  double overlap = frameMs > 0.0 ? (1.0 - waitMs / frameMs) * 100.0 : 0.0;
+
+  cout << JlEngineReports::jlGraphicsVulkan << frameStats_.frames
+    << " frames, " << framesInFlight_ << " in flight. Avg frame "
+    << frameMs << " ms / fence wait " << waitMs << " ms / record "
+    << recordMs << " ms / CPU-GPU overlap " << overlap << "% / "
+    << frameStats_.swapChainRecreations << " swap chain recreations."
+    << endl;
 }
 
 bool JlVulkanGraphics::isDeviceSuitable(VkPhysicalDevice device) {
   QueueFamilyIndices indices = findQueueFamilies(device);
+  if (headless_) return indices.isComplete();
 
   bool extensionsSupported = checkDeviceExtensionSupport(device);
 
@@ -415,12 +2982,14 @@ bool JlVulkanGraphics::isDeviceSuitable(VkPhysicalDevice device) {
 }
 
 vector<const char*> JlVulkanGraphics::getRequiredExtensions() {
-  uint32_t glfwExtensionCount = 0;
-  const char** glfwExtensions;
-  glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+  vector<const char*> extensions;
+  if (!headless_) {
+    uint32_t glfwExtensionCount = 0;
+    const char** glfwExtensions;
+    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-  vector<const char*> extensions(glfwExtensions,
-                                 glfwExtensions + glfwExtensionCount);
+    extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  }
 
   if (enableValidationLayers_) {
     extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -433,12 +3002,12 @@ vector<const char*> JlVulkanGraphics::getRequiredExtensions() {
 
 bool JlVulkanGraphics::checkDeviceExtensionSupport(VkPhysicalDevice device) {
   uint32_t extensionCount;
-  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
-                                       nullptr);
+  vk_->vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                            nullptr);
 
   vector<VkExtensionProperties> availableExtensions(extensionCount);
-  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
-                                       availableExtensions.data());
+  vk_->vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                            availableExtensions.data());
 
   set<string> requiredExtensions(deviceExtensions_.begin(),
                                  deviceExtensions_.end());
@@ -451,45 +3020,173 @@ bool JlVulkanGraphics::checkDeviceExtensionSupport(VkPhysicalDevice device) {
 }
 
 int JlVulkanGraphics::pickBestDevice(VkPhysicalDevice device) {
-  int score = 0;
+  if (!isDeviceSuitable(device)) return 0;
 
-  if (deviceProperties_.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
-    score += 1000;
+  VkPhysicalDeviceProperties properties;
+  vk_->vkGetPhysicalDeviceProperties(device, &properties);
+  if (properties.apiVersion < VK_API_VERSION_1_1) return 0;
 
-  score += deviceProperties_.limits.maxImageDimension2D;
+  // Device type dominates, a CPU implementation only wins when it's alone.
+  int score = 1;
+  switch (properties.deviceType) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      score += 100000;
+      break;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      score += 40000;
+      break;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+      score += 20000;
+      break;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+      break;
+    default:
+      score += 10000;
+      break;
+  }
 
-  if (!deviceFeatures_.geometryShader) {
-    cerr << JlEngineReports::jlGraphicsVulkan
-      << "GPU doesn't support Geometry Shaders." << endl;
-    return 0;
+  // 1000 per GiB of device local memory, capped so a huge heap can't
+  // outweigh the device type.
+  VkPhysicalDeviceMemoryProperties memory;
+  vk_->vkGetPhysicalDeviceMemoryProperties(device, &memory);
+  VkDeviceSize localMemory = 0;
+  for (uint32_t i = 0; i < memory.memoryHeapCount; i++)
+    if (memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+      localMemory = max(localMemory, memory.memoryHeaps[i].size);
+  score += static_cast<int>(
+    min<VkDeviceSize>(localMemory / (1024 * 1024 * 1024), 32) * 1000);
+
+  // Queues that run beside graphics, uploads and async compute use them.
+  uint32_t queueFamilyCount = 0;
+  vk_->vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount,
+                                                nullptr);
+  vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vk_->vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount,
+                                                queueFamilies.data());
+
+  bool asyncCompute = false, dedicatedTransfer = false;
+  for (const VkQueueFamilyProperties& family : queueFamilies) {
+    bool graphics = family.queueFlags & VK_QUEUE_GRAPHICS_BIT;
+    bool compute = family.queueFlags & VK_QUEUE_COMPUTE_BIT;
+    bool transfer = family.queueFlags & VK_QUEUE_TRANSFER_BIT;
+    if (compute && !graphics) asyncCompute = true;
+    if (transfer && !compute && !graphics) dedicatedTransfer = true;
+  }
+  if (asyncCompute) score += 3000;
+  if (dedicatedTransfer) score += 2000;
+
+  // Optional features the engine uses when present.
+  if (properties.apiVersion >= VK_API_VERSION_1_2) {
+    VkPhysicalDeviceVulkan13Features features13{};
+    features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    VkPhysicalDeviceVulkan12Features features12{};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    if (properties.apiVersion >= VK_API_VERSION_1_3)
+      features12.pNext = &features13;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &features12;
+    vk_->vkGetPhysicalDeviceFeatures2(device, &features);
+
+    if (features12.timelineSemaphore) score += 4000;
+    if (features12.descriptorIndexing &&
+        features12.runtimeDescriptorArray &&
+        features12.descriptorBindingPartiallyBound)
+      score += 2000;
+    if (features13.synchronization2) score += 2000;
   }
 
   return score;
 }
 
+bool JlVulkanGraphics::matchesDeviceOverride(VkPhysicalDevice device,
+                                             const string& deviceOverride) {
+  VkPhysicalDeviceIDProperties idProperties{};
+  idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+  VkPhysicalDeviceProperties2 properties{};
+  properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  properties.pNext = &idProperties;
+  vk_->vkGetPhysicalDeviceProperties2(device, &properties);
+
+  auto lower = [](string text) {
+    transform(text.begin(), text.end(), text.begin(),
+              [](unsigned char c) { return static_cast<char>(tolower(c)); });
+    return text;
+  };
+
+  // The UUID as hex, dashes in the override are ignored.
+  static const char hex[] = "0123456789abcdef";
+  string uuid;
+  for (uint32_t i = 0; i < VK_UUID_SIZE; i++) {
+    uuid += hex[idProperties.deviceUUID[i] >> 4];
+    uuid += hex[idProperties.deviceUUID[i] & 0xF];
+  }
+
+  string wanted = lower(deviceOverride);
+  string wantedUUID = wanted;
+  wantedUUID.erase(remove(wantedUUID.begin(), wantedUUID.end(), '-'),
+                   wantedUUID.end());
+  if (wantedUUID == uuid) return true;
+
+  return lower(properties.properties.deviceName).find(wanted) != string::npos;
+}
+
 JlVulkanGraphics::QueueFamilyIndices JlVulkanGraphics::findQueueFamilies(
   VkPhysicalDevice device) {
   QueueFamilyIndices indices{};
 
   uint32_t queueFamilyCount = 0;
-  vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+  vk_->vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount,
+                                                nullptr);
 
   vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-  vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount,
-                                           queueFamilies.data());
-
-  int i = 0;
-  for (const auto& queueFamily : queueFamilies) {
-    if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+  vk_->vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount,
+                                                queueFamilies.data());
+
+  bool dedicatedTransfer = false;
+  for (uint32_t i = 0; i < queueFamilyCount; i++) {
+    VkQueueFlags flags = queueFamilies[i].queueFlags;
+    bool graphics = flags & VK_QUEUE_GRAPHICS_BIT;
+
+    // Headless, the graphics family stands in for the present family.
+    VkBool32 presentSupport = headless_ && graphics;
+    if (!headless_)
+      vk_->vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_,
+                                                &presentSupport);
+
+    // One family doing both saves cross-family sharing on swap chain images.
+    bool sharedFamily = indices.graphicsFamily.has_value() &&
+                        indices.graphicsFamily == indices.presentFamily;
+    if (graphics && presentSupport && !sharedFamily) {
       indices.graphicsFamily = i;
+      indices.presentFamily = i;
+    }
+    if (graphics && !indices.graphicsFamily.has_value())
+      indices.graphicsFamily = i;
+    if (presentSupport && !indices.presentFamily.has_value())
+      indices.presentFamily = i;
+
+    // Graphics and compute queues imply transfer support.
+    bool transferOnly = (flags & VK_QUEUE_TRANSFER_BIT) &&
+                        !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
+    if (transferOnly && !dedicatedTransfer) {
+      indices.transferFamily = i;
+      dedicatedTransfer = true;
+    } else if (!graphics && (flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+               !indices.transferFamily.has_value()) {
+      indices.transferFamily = i;
+    }
+  }
 
-    VkBool32 presentSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
-    if (presentSupport) indices.presentFamily = i;
-
-    if (indices.isComplete()) break;
-
-    i++;
+  // Only known once the transfer family is settled.
+  for (uint32_t i = 0; i < queueFamilyCount; i++) {
+    VkQueueFlags flags = queueFamilies[i].queueFlags;
+    bool computeOnly = (flags & VK_QUEUE_COMPUTE_BIT) &&
+                       !(flags & VK_QUEUE_GRAPHICS_BIT);
+    if (computeOnly && (!indices.computeFamily.has_value() ||
+                        indices.computeFamily == indices.transferFamily))
+      indices.computeFamily = i;
   }
 
   return indices;
@@ -498,22 +3195,23 @@ JlVulkanGraphics::QueueFamilyIndices JlVulkanGraphics::findQueueFamilies(
 JlVulkanGraphics::SwapChainSupportDetails JlVulkanGraphics::querySwapChainSupport(VkPhysicalDevice device) {
   SwapChainSupportDetails details;
 
-  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface_, &details.capabilities);
+  vk_->vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface_, &details.capabilities);
 
   uint32_t formatCount;
-  vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface_, &formatCount, nullptr);
+  vk_->vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface_, &formatCount,
+                                            nullptr);
 
   if (formatCount != 0) {
     details.formats.resize(formatCount);
-    vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface_, &formatCount, details.formats.data());
+    vk_->vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface_, &formatCount, details.formats.data());
   }
 
   uint32_t presentModeCount;
-  vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface_, &presentModeCount, nullptr);
+  vk_->vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface_, &presentModeCount, nullptr);
 
   if (presentModeCount != 0) {
     details.presentModes.resize(presentModeCount);
-    vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface_, &presentModeCount, details.presentModes.data());
+    vk_->vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface_, &presentModeCount, details.presentModes.data());
   }
 
   return details;
@@ -530,10 +3228,25 @@ VkSurfaceFormatKHR JlVulkanGraphics::chooseSwapSurfaceFormat(const std::vector<V
 }
 
 VkPresentModeKHR JlVulkanGraphics::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
-  for (const auto& availablePresentMode : availablePresentModes) {
-    if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-      return availablePresentMode;
-    }
+  auto available = [&availablePresentModes](VkPresentModeKHR mode) {
+    return find(availablePresentModes.begin(), availablePresentModes.end(),
+                mode) != availablePresentModes.end();
+  };
+
+  // FIFO is the only mode every device supports.
+  switch (JlEngineSettings::presentPolicy) {
+    case JlEngineSettings::Uncapped:
+      if (available(VK_PRESENT_MODE_IMMEDIATE_KHR))
+        return VK_PRESENT_MODE_IMMEDIATE_KHR;
+      if (available(VK_PRESENT_MODE_MAILBOX_KHR))
+        return VK_PRESENT_MODE_MAILBOX_KHR;
+      break;
+    case JlEngineSettings::Throughput:
+      if (available(VK_PRESENT_MODE_MAILBOX_KHR))
+        return VK_PRESENT_MODE_MAILBOX_KHR;
+      break;
+    default:
+      break;
   }
 
   return VK_PRESENT_MODE_FIFO_KHR;
@@ -561,10 +3274,10 @@ VkExtent2D JlVulkanGraphics::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& ca
 
 bool JlVulkanGraphics::checkValidationLayerSupport() {
   uint32_t layerCount;
-  vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+  vk_->vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
 
   vector<VkLayerProperties> availableLayers(layerCount);
-  vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+  vk_->vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
 
   for (const char* layerName : validationLayers_) {
     bool layerFound = false;
@@ -612,10 +3325,9 @@ VkResult JlVulkanGraphics::createDebugUtilsMessengerEXT(
   VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
   const VkAllocationCallbacks* pAllocator,
   VkDebugUtilsMessengerEXT* pDebugMessenger) {
-  auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
-    instance, "vkCreateDebugUtilsMessengerEXT");
-  if (func != nullptr) {
-    return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
+  if (vk_->vkCreateDebugUtilsMessengerEXT != nullptr) {
+    return vk_->vkCreateDebugUtilsMessengerEXT(instance, pCreateInfo,
+                                               pAllocator, pDebugMessenger);
   }
   else {
     return VK_ERROR_EXTENSION_NOT_PRESENT;
@@ -625,9 +3337,8 @@ VkResult JlVulkanGraphics::createDebugUtilsMessengerEXT(
 void JlVulkanGraphics::destroyDebugUtilsMessengerEXT(
   VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger_,
   const VkAllocationCallbacks* pAllocator) {
-  auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
-    instance, "vkDestroyDebugUtilsMessengerEXT");
-  if (func != nullptr) {
-    func(instance, debugMessenger_, pAllocator);
+  if (vk_->vkDestroyDebugUtilsMessengerEXT != nullptr) {
+    vk_->vkDestroyDebugUtilsMessengerEXT(instance, debugMessenger_,
+                                         pAllocator);
   }
 }
\ No newline at end of file
@@ -0,0 +1,304 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#include "graphics/jl_vulkan_bindless.h"
+#include "graphics/jl_vulkan_dispatch.h"
+#include "graphics/jl_vulkan_memory.h"
+#include "graphics/jl_vulkan_timeline.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "defines.h"
+
+using namespace std;
+
+const VkAllocationCallbacks* const allocator_ =
+  JlVulkanMemory::getAllocationCallbacks();
+const JlVulkanDispatch* const vk_ = &JlVulkanDispatch::get();
+
+const uint32_t maxBindlessImages_ = 16384;
+const uint32_t maxBindlessBuffers_ = 16384;
+const uint32_t maxBindlessSamplers_ = 1024;
+
+VkDevice bindlessDevice_ = VK_NULL_HANDLE;
+VkDescriptorSetLayout bindlessSetLayout_ = VK_NULL_HANDLE;
+VkDescriptorPool bindlessPool_ = VK_NULL_HANDLE;
+VkDescriptorSet bindlessSet_ = VK_NULL_HANDLE;
+
+mutex bindlessMutex_;
+array<JlVulkanBindless::SlotTable, JlVulkanBindless::BindingCount>
+  bindlessSlots_;
+
+const VkDescriptorType bindlessTypes_[JlVulkanBindless::BindingCount] = {
+  VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+  VK_DESCRIPTOR_TYPE_SAMPLER };
+
+bool JlVulkanBindless::init(VkPhysicalDevice physicalDevice,
+                            VkDevice device) {
+  bindlessDevice_ = device;
+
+  VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+  indexingProperties.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+
+  VkPhysicalDeviceProperties2 properties{};
+  properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  properties.pNext = &indexingProperties;
+  vk_->vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+  uint32_t capacities[BindingCount] = {
+    min({ maxBindlessImages_,
+          indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+          indexingProperties
+            .maxPerStageDescriptorUpdateAfterBindSampledImages }),
+    min({ maxBindlessBuffers_,
+          indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+          indexingProperties
+            .maxPerStageDescriptorUpdateAfterBindStorageBuffers }),
+    min({ maxBindlessSamplers_,
+          indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+          indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers })
+  };
+
+  VkDescriptorSetLayoutBinding bindings[BindingCount]{};
+  VkDescriptorBindingFlags bindingFlags[BindingCount]{};
+  VkDescriptorPoolSize poolSizes[BindingCount]{};
+  for (uint32_t i = 0; i < BindingCount; i++) {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = bindlessTypes_[i];
+    bindings[i].descriptorCount = capacities[i];
+    bindings[i].stageFlags = VK_SHADER_STAGE_ALL;
+
+    // Slots that were never written are fine as long as nothing indexes
+    // them, and writes may land while older frames are still in flight.
+    bindingFlags[i] = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                      VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+                      VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+    poolSizes[i].type = bindlessTypes_[i];
+    poolSizes[i].descriptorCount = capacities[i];
+
+    bindlessSlots_[i] = {};
+    bindlessSlots_[i].capacity = capacities[i];
+  }
+
+  VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+  bindingFlagsInfo.sType =
+    VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+  bindingFlagsInfo.bindingCount = BindingCount;
+  bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.pNext = &bindingFlagsInfo;
+  layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+  layoutInfo.bindingCount = BindingCount;
+  layoutInfo.pBindings = bindings;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+  poolInfo.maxSets = 1;
+  poolInfo.poolSizeCount = BindingCount;
+  poolInfo.pPoolSizes = poolSizes;
+
+  try {
+    if (vk_->vkCreateDescriptorSetLayout(device, &layoutInfo, allocator_,
+                                         &bindlessSetLayout_) != VK_SUCCESS)
+      throw runtime_error("Failed to create bindless set layout.");
+
+    if (vk_->vkCreateDescriptorPool(device, &poolInfo, allocator_,
+                                    &bindlessPool_) != VK_SUCCESS)
+      throw runtime_error("Failed to create bindless descriptor pool.");
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = bindlessPool_;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &bindlessSetLayout_;
+
+    if (vk_->vkAllocateDescriptorSets(device, &allocInfo, &bindlessSet_) !=
+        VK_SUCCESS)
+      throw runtime_error("Failed to allocate bindless descriptor set.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    shutdown();
+    return false;
+  }
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Bindless table created with "
+    << capacities[SampledImages] << " images / "
+    << capacities[StorageBuffers] << " buffers / " << capacities[Samplers]
+    << " samplers..." << endl;
+  return true;
+}
+
+void JlVulkanBindless::shutdown() {
+  if (bindlessPool_ != VK_NULL_HANDLE)
+    vk_->vkDestroyDescriptorPool(bindlessDevice_, bindlessPool_, allocator_);
+  if (bindlessSetLayout_ != VK_NULL_HANDLE)
+    vk_->vkDestroyDescriptorSetLayout(bindlessDevice_, bindlessSetLayout_,
+                                      allocator_);
+
+  bindlessPool_ = VK_NULL_HANDLE;
+  bindlessSetLayout_ = VK_NULL_HANDLE;
+  bindlessSet_ = VK_NULL_HANDLE;
+}
+
+bool JlVulkanBindless::isAvailable() { return bindlessSet_ != VK_NULL_HANDLE; }
+
+uint32_t JlVulkanBindless::registerSampledImage(VkImageView imageView,
+                                                VkImageLayout layout) {
+  uint32_t index = allocateSlot(SampledImages);
+  if (index != invalidIndex) updateSampledImage(index, imageView, layout);
+  return index;
+}
+
+uint32_t JlVulkanBindless::registerStorageBuffer(VkBuffer buffer,
+                                                 VkDeviceSize offset,
+                                                 VkDeviceSize range) {
+  uint32_t index = allocateSlot(StorageBuffers);
+  if (index != invalidIndex)
+    updateStorageBuffer(index, buffer, offset, range);
+  return index;
+}
+
+uint32_t JlVulkanBindless::registerSampler(VkSampler sampler) {
+  uint32_t index = allocateSlot(Samplers);
+  if (index == invalidIndex) return index;
+
+  VkDescriptorImageInfo imageInfo{};
+  imageInfo.sampler = sampler;
+  writeDescriptor(Samplers, index, &imageInfo, nullptr);
+  return index;
+}
+
+void JlVulkanBindless::updateSampledImage(uint32_t index,
+                                          VkImageView imageView,
+                                          VkImageLayout layout) {
+  VkDescriptorImageInfo imageInfo{};
+  imageInfo.imageView = imageView;
+  imageInfo.imageLayout = layout;
+  writeDescriptor(SampledImages, index, &imageInfo, nullptr);
+}
+
+void JlVulkanBindless::updateStorageBuffer(uint32_t index, VkBuffer buffer,
+                                           VkDeviceSize offset,
+                                           VkDeviceSize range) {
+  VkDescriptorBufferInfo bufferInfo{};
+  bufferInfo.buffer = buffer;
+  bufferInfo.offset = offset;
+  bufferInfo.range = range;
+  writeDescriptor(StorageBuffers, index, nullptr, &bufferInfo);
+}
+
+void JlVulkanBindless::release(Binding binding, uint32_t index) {
+  if (index == invalidIndex) return;
+
+  JlVulkanTimeline::destroyLater([binding, index]() {
+    lock_guard<mutex> lock(bindlessMutex_);
+    SlotTable& table = bindlessSlots_[binding];
+    table.freeSlots.push_back(index);
+    table.used--;
+  });
+}
+
+VkDescriptorSetLayout JlVulkanBindless::getSetLayout() {
+  return bindlessSetLayout_;
+}
+
+VkDescriptorSet JlVulkanBindless::getSet() { return bindlessSet_; }
+
+VkPushConstantRange JlVulkanBindless::getPushConstantRange() {
+  VkPushConstantRange range{};
+  range.stageFlags = VK_SHADER_STAGE_ALL;
+  range.offset = 0;
+  range.size = sizeof(DrawIndices);
+  return range;
+}
+
+void JlVulkanBindless::bind(VkCommandBuffer commandBuffer,
+                            VkPipelineBindPoint bindPoint,
+                            VkPipelineLayout layout) {
+  if (bindlessSet_ == VK_NULL_HANDLE) return;
+  vk_->vkCmdBindDescriptorSets(commandBuffer, bindPoint, layout, 0, 1,
+                               &bindlessSet_, 0, nullptr);
+}
+
+JlVulkanBindless::Stats JlVulkanBindless::getStats(Binding binding) {
+  lock_guard<mutex> lock(bindlessMutex_);
+  const SlotTable& table = bindlessSlots_[binding];
+
+  Stats stats;
+  stats.capacity = table.capacity;
+  stats.used = table.used;
+  stats.peakUsed = table.peakUsed;
+  stats.updates = table.updates;
+  return stats;
+}
+
+void JlVulkanBindless::reportStats() {
+  if (bindlessSet_ == VK_NULL_HANDLE) return;
+
+  const char* names[BindingCount] = { "images", "buffers", "samplers" };
+  for (uint32_t i = 0; i < BindingCount; i++) {
+    Stats stats = getStats(static_cast<Binding>(i));
+    cout << JlEngineReports::jlGraphicsVulkan << "Bindless " << names[i]
+      << ": " << stats.used << " / " << stats.capacity << " used, "
+      << stats.peakUsed << " peak, " << stats.updates << " updates." << endl;
+  }
+}
+
+uint32_t JlVulkanBindless::allocateSlot(Binding binding) {
+  if (bindlessSet_ == VK_NULL_HANDLE) return invalidIndex;
+
+  lock_guard<mutex> lock(bindlessMutex_);
+  SlotTable& table = bindlessSlots_[binding];
+
+  uint32_t index = invalidIndex;
+  if (!table.freeSlots.empty()) {
+    index = table.freeSlots.back();
+    table.freeSlots.pop_back();
+  }
+  else if (table.next < table.capacity) {
+    index = table.next++;
+  }
+  else {
+    cerr << JlEngineReports::jlGraphicsVulkan
+      << "Bindless table is full, binding " << binding << "." << endl;
+    return invalidIndex;
+  }
+
+  table.used++;
+  table.peakUsed = max(table.peakUsed, table.used);
+  return index;
+}
+
+void JlVulkanBindless::writeDescriptor(
+  Binding binding, uint32_t index, const VkDescriptorImageInfo* imageInfo,
+  const VkDescriptorBufferInfo* bufferInfo) {
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = bindlessSet_;
+  write.dstBinding = binding;
+  write.dstArrayElement = index;
+  write.descriptorCount = 1;
+  write.descriptorType = bindlessTypes_[binding];
+  write.pImageInfo = imageInfo;
+  write.pBufferInfo = bufferInfo;
+
+  // The set is shared by every thread, writes to it must not overlap.
+  lock_guard<mutex> lock(bindlessMutex_);
+  vk_->vkUpdateDescriptorSets(bindlessDevice_, 1, &write, 0, nullptr);
+  bindlessSlots_[binding].updates++;
+}
@@ -0,0 +1,144 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#include "graphics/jl_vulkan_commands.h"
+#include "graphics/jl_vulkan_dispatch.h"
+#include "graphics/jl_vulkan_memory.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "defines.h"
+
+using namespace std;
+
+const VkAllocationCallbacks* const allocator_ =
+  JlVulkanMemory::getAllocationCallbacks();
+const JlVulkanDispatch* const vk_ = &JlVulkanDispatch::get();
+
+JlVulkanCommandRecorder::JlVulkanCommandRecorder(VkDevice device,
+                                                 uint32_t queueFamily,
+                                                 uint32_t framesInFlight,
+                                                 uint32_t workerCount)
+  : device_(device), workers_(workerCount) {
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  poolInfo.queueFamilyIndex = queueFamily;
+
+  pools_.resize(framesInFlight);
+  for (vector<ThreadCommandPool>& framePools : pools_) {
+    framePools.resize(workers_.getWorkerCount());
+
+    for (ThreadCommandPool& threadPool : framePools) {
+      try {
+        if (vk_->vkCreateCommandPool(device_, &poolInfo, allocator_,
+                                     &threadPool.pool) != VK_SUCCESS)
+          throw runtime_error("Failed to create worker command pool.");
+      }
+      catch (runtime_error& e) {
+        cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+        threadPool.pool = VK_NULL_HANDLE;
+      }
+    }
+  }
+}
+
+JlVulkanCommandRecorder::~JlVulkanCommandRecorder() {
+  // Destroying a pool frees every command buffer allocated from it.
+  for (vector<ThreadCommandPool>& framePools : pools_)
+    for (ThreadCommandPool& threadPool : framePools)
+      if (threadPool.pool != VK_NULL_HANDLE)
+        vk_->vkDestroyCommandPool(device_, threadPool.pool, allocator_);
+}
+
+void JlVulkanCommandRecorder::resetFrame(uint32_t frameIndex) {
+  // One reset per pool recycles all of that frame's secondaries at once.
+  for (ThreadCommandPool& threadPool : pools_[frameIndex]) {
+    if (threadPool.used == 0) continue;
+
+    vk_->vkResetCommandPool(device_, threadPool.pool, 0);
+    threadPool.used = 0;
+  }
+}
+
+vector<VkCommandBuffer> JlVulkanCommandRecorder::recordSecondary(
+  uint32_t frameIndex, const VkCommandBufferInheritanceInfo& inheritance,
+  const vector<RecordTask>& tasks) {
+  vector<VkCommandBuffer> commandBuffers(tasks.size(), VK_NULL_HANDLE);
+  vector<ThreadCommandPool>& framePools = pools_[frameIndex];
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  if (inheritance.renderPass != VK_NULL_HANDLE)
+    beginInfo.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+
+  // Dynamic rendering continues the primary's vkCmdBeginRendering instead.
+  for (const VkBaseInStructure* next =
+         static_cast<const VkBaseInStructure*>(inheritance.pNext);
+       next != nullptr; next = next->pNext)
+    if (next->sType ==
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO)
+      beginInfo.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+  beginInfo.pInheritanceInfo = &inheritance;
+
+  workers_.parallelFor(
+    static_cast<uint32_t>(tasks.size()),
+    [&](uint32_t index, uint32_t worker) {
+      VkCommandBuffer commandBuffer = acquireBuffer(framePools[worker]);
+      if (commandBuffer == VK_NULL_HANDLE) return;
+
+      vk_->vkBeginCommandBuffer(commandBuffer, &beginInfo);
+      tasks[index](commandBuffer);
+      vk_->vkEndCommandBuffer(commandBuffer);
+
+      commandBuffers[index] = commandBuffer;
+    });
+
+  // Tasks that failed to get a command buffer are dropped from the list.
+  commandBuffers.erase(
+    remove(commandBuffers.begin(), commandBuffers.end(), VK_NULL_HANDLE),
+    commandBuffers.end());
+  return commandBuffers;
+}
+
+void JlVulkanCommandRecorder::executeSecondary(
+  VkCommandBuffer primary, const vector<VkCommandBuffer>& secondaries) {
+  if (secondaries.empty()) return;
+
+  vk_->vkCmdExecuteCommands(primary, static_cast<uint32_t>(secondaries.size()),
+                            secondaries.data());
+}
+
+uint32_t JlVulkanCommandRecorder::getWorkerCount() const {
+  return workers_.getWorkerCount();
+}
+
+VkCommandBuffer JlVulkanCommandRecorder::acquireBuffer(
+  ThreadCommandPool& threadPool) {
+  if (threadPool.pool == VK_NULL_HANDLE) return VK_NULL_HANDLE;
+
+  if (threadPool.used == threadPool.buffers.size()) {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = threadPool.pool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    if (vk_->vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer) !=
+        VK_SUCCESS)
+      return VK_NULL_HANDLE;
+
+    threadPool.buffers.push_back(commandBuffer);
+  }
+
+  return threadPool.buffers[threadPool.used++];
+}
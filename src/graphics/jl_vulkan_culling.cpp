@@ -0,0 +1,447 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#include "graphics/jl_vulkan_culling.h"
+#include "graphics/jl_vulkan_dispatch.h"
+#include "graphics/jl_vulkan_memory.h"
+#include "graphics/jl_vulkan_pipeline_cache.h"
+#include "graphics/jl_vulkan_timeline.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "defines.h"
+
+using namespace std;
+using namespace filesystem;
+
+const VkAllocationCallbacks* const allocator_ =
+  JlVulkanMemory::getAllocationCallbacks();
+const JlVulkanDispatch* const vk_ = &JlVulkanDispatch::get();
+
+const uint32_t cullGroupSize_ = 64;
+
+// Corner n of the unit cube sits at bit 0 = x, bit 1 = y, bit 2 = z.
+const uint16_t cubeIndices_[] = {
+  0, 2, 6, 0, 6, 4,  1, 5, 7, 1, 7, 3,
+  0, 4, 5, 0, 5, 1,  2, 3, 7, 2, 7, 6,
+  0, 1, 3, 0, 3, 2,  4, 6, 7, 4, 7, 5 };
+
+JlVulkanCulling::JlVulkanCulling(VkDevice device, bool drawIndirectCount)
+  : device_(device), drawIndirectCount_(drawIndirectCount) {}
+
+JlVulkanCulling::~JlVulkanCulling() {
+  destroyInstanceBuffers();
+  if (indexBuffer_ != VK_NULL_HANDLE)
+    JlVulkanTimeline::destroyBuffer(indexBuffer_, indexAllocation_);
+  if (countBuffer_ != VK_NULL_HANDLE)
+    JlVulkanTimeline::destroyBuffer(countBuffer_, countAllocation_);
+
+  JlVulkanTimeline::destroyPipeline(cullPipeline_);
+  JlVulkanTimeline::destroyPipeline(drawPipeline_);
+  JlVulkanTimeline::destroyPipelineLayout(cullLayout_);
+  JlVulkanTimeline::destroyPipelineLayout(drawLayout_);
+
+  VkDevice device = device_;
+  VkDescriptorPool descriptorPool = descriptorPool_;
+  VkDescriptorSetLayout setLayout = setLayout_;
+  JlVulkanTimeline::destroyLater([device, descriptorPool, setLayout]() {
+    vk_->vkDestroyDescriptorPool(device, descriptorPool, allocator_);
+    vk_->vkDestroyDescriptorSetLayout(device, setLayout, allocator_);
+  });
+}
+
+bool JlVulkanCulling::init(const path& shaderDir, VkFormat colorFormat,
+                           VkRenderPass renderPass) {
+  if (!createDescriptors()) return false;
+  if (!createPipelines(shaderDir, colorFormat, renderPass)) return false;
+
+  if (!createBuffer(sizeof(cubeIndices_), VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indexBuffer_,
+                    indexAllocation_))
+    return false;
+  memcpy(indexAllocation_.mapped, cubeIndices_, sizeof(cubeIndices_));
+
+  if (!createBuffer(sizeof(uint32_t),
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                      VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                      VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                    0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &countBuffer_,
+                    countAllocation_))
+    return false;
+
+  return true;
+}
+
+bool JlVulkanCulling::setInstances(const vector<Instance>& instances) {
+  instanceCount_ = static_cast<uint32_t>(instances.size());
+  if (instanceCount_ == 0) return true;
+
+  // Rewritten in place, the GPU has to be done with earlier recordings.
+  if (instanceCount_ > instanceCapacity_) {
+    destroyInstanceBuffers();
+
+    VkDeviceSize instanceSize = sizeof(Instance) * instanceCount_;
+    VkDeviceSize drawSize =
+      sizeof(VkDrawIndexedIndirectCommand) * instanceCount_;
+
+    if (!createBuffer(instanceSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &instanceBuffer_,
+                      instanceAllocation_) ||
+        !createBuffer(drawSize,
+                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                      0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &drawBuffer_,
+                      drawAllocation_)) {
+      instanceCount_ = 0;
+      return false;
+    }
+
+    instanceCapacity_ = instanceCount_;
+    writeDescriptors();
+  }
+
+  memcpy(instanceAllocation_.mapped, instances.data(),
+         sizeof(Instance) * instanceCount_);
+  return true;
+}
+
+uint32_t JlVulkanCulling::getInstanceCount() const { return instanceCount_; }
+
+uint32_t JlVulkanCulling::getCubeIndexCount() {
+  return static_cast<uint32_t>(sizeof(cubeIndices_) / sizeof(uint16_t));
+}
+
+void JlVulkanCulling::recordReset(VkCommandBuffer commandBuffer) {
+  vk_->vkCmdFillBuffer(commandBuffer, countBuffer_, 0, sizeof(uint32_t), 0);
+}
+
+void JlVulkanCulling::recordCull(VkCommandBuffer commandBuffer,
+                                 const glm::mat4& viewProjection) {
+  if (instanceCount_ == 0) return;
+
+  // Gribb-Hartmann planes for Vulkan's 0..w depth range, normalized so
+  // the sphere radius compares against true distances.
+  glm::mat4 m = glm::transpose(viewProjection);
+  CullConstants constants{};
+  constants.planes[0] = m[3] + m[0];
+  constants.planes[1] = m[3] - m[0];
+  constants.planes[2] = m[3] + m[1];
+  constants.planes[3] = m[3] - m[1];
+  constants.planes[4] = m[2];
+  constants.planes[5] = m[3] - m[2];
+  for (glm::vec4& plane : constants.planes)
+    plane /= glm::length(glm::vec3(plane));
+  constants.instanceCount = instanceCount_;
+  constants.compact = drawIndirectCount_ ? 1 : 0;
+
+  vk_->vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                         cullPipeline_);
+  vk_->vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                               cullLayout_, 0, 1, &descriptorSet_, 0, nullptr);
+  vk_->vkCmdPushConstants(commandBuffer, cullLayout_,
+                          VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                          sizeof(CullConstants), &constants);
+  vk_->vkCmdDispatch(commandBuffer,
+                     (instanceCount_ + cullGroupSize_ - 1) / cullGroupSize_,
+                     1, 1);
+}
+
+void JlVulkanCulling::recordDraw(VkCommandBuffer commandBuffer,
+                                 const glm::mat4& viewProjection) {
+  if (instanceCount_ == 0) return;
+
+  vk_->vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                         drawPipeline_);
+  vk_->vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                               drawLayout_, 0, 1, &descriptorSet_, 0, nullptr);
+  vk_->vkCmdPushConstants(commandBuffer, drawLayout_,
+                          VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4),
+                          &viewProjection);
+  vk_->vkCmdBindIndexBuffer(commandBuffer, indexBuffer_, 0,
+                            VK_INDEX_TYPE_UINT16);
+
+  if (drawIndirectCount_)
+    vk_->vkCmdDrawIndexedIndirectCount(commandBuffer, drawBuffer_, 0,
+                                       countBuffer_, 0, instanceCount_,
+                                       sizeof(VkDrawIndexedIndirectCommand));
+  else
+    vk_->vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer_, 0, instanceCount_,
+                                  sizeof(VkDrawIndexedIndirectCommand));
+}
+
+VkBuffer JlVulkanCulling::getDrawBuffer() const { return drawBuffer_; }
+
+VkBuffer JlVulkanCulling::getCountBuffer() const { return countBuffer_; }
+
+bool JlVulkanCulling::createDescriptors() {
+  // Instances, draws and the draw count. Draws only read the instances.
+  VkDescriptorSetLayoutBinding bindings[3]{};
+  for (uint32_t i = 0; i < 3; i++) {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+  bindings[0].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = 3;
+  layoutInfo.pBindings = bindings;
+
+  VkDescriptorPoolSize poolSize{};
+  poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSize.descriptorCount = 3;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = 1;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &poolSize;
+
+  try {
+    if (vk_->vkCreateDescriptorSetLayout(device_, &layoutInfo, allocator_,
+                                         &setLayout_) != VK_SUCCESS)
+      throw runtime_error("Failed to create culling set layout.");
+
+    if (vk_->vkCreateDescriptorPool(device_, &poolInfo, allocator_,
+                                    &descriptorPool_) != VK_SUCCESS)
+      throw runtime_error("Failed to create culling descriptor pool.");
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool_;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &setLayout_;
+
+    if (vk_->vkAllocateDescriptorSets(device_, &allocInfo, &descriptorSet_) !=
+        VK_SUCCESS)
+      throw runtime_error("Failed to allocate culling descriptor set.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool JlVulkanCulling::createPipelines(const path& shaderDir,
+                                      VkFormat colorFormat,
+                                      VkRenderPass renderPass) {
+  VkShaderModule cullShader = loadShader(shaderDir / "cull.comp.spv");
+  VkShaderModule vertShader = loadShader(shaderDir / "instanced.vert.spv");
+  VkShaderModule fragShader = loadShader(shaderDir / "base.frag.spv");
+
+  bool success = true;
+  try {
+    if (cullShader == VK_NULL_HANDLE || vertShader == VK_NULL_HANDLE ||
+        fragShader == VK_NULL_HANDLE)
+      throw runtime_error("Failed to load the culling shaders.");
+
+    VkPushConstantRange cullRange{ VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                   sizeof(CullConstants) };
+    VkPushConstantRange drawRange{ VK_SHADER_STAGE_VERTEX_BIT, 0,
+                                   sizeof(glm::mat4) };
+
+    VkPipelineLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &setLayout_;
+    layoutInfo.pushConstantRangeCount = 1;
+
+    layoutInfo.pPushConstantRanges = &cullRange;
+    if (vk_->vkCreatePipelineLayout(device_, &layoutInfo, allocator_,
+                                    &cullLayout_) != VK_SUCCESS)
+      throw runtime_error("Failed to create culling pipeline layout.");
+
+    layoutInfo.pPushConstantRanges = &drawRange;
+    if (vk_->vkCreatePipelineLayout(device_, &layoutInfo, allocator_,
+                                    &drawLayout_) != VK_SUCCESS)
+      throw runtime_error("Failed to create culling pipeline layout.");
+
+    VkComputePipelineCreateInfo cullInfo{};
+    cullInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    cullInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    cullInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    cullInfo.stage.module = cullShader;
+    cullInfo.stage.pName = "main";
+    cullInfo.layout = cullLayout_;
+
+    if (JlVulkanPipelineCache::createComputePipeline(
+          cullInfo, &cullPipeline_) != VK_SUCCESS)
+      throw runtime_error("Failed to create culling pipeline.");
+
+    VkPipelineShaderStageCreateInfo stages[2]{};
+    stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[0].module = vertShader;
+    stages[0].pName = "main";
+    stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[1].module = fragShader;
+    stages[1].pName = "main";
+
+    VkPipelineVertexInputStateCreateInfo vertexInput{};
+    vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
+    rasterizer.lineWidth = 1.0f;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineColorBlendAttachmentState blendAttachment{};
+    blendAttachment.colorWriteMask =
+      VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+      VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &blendAttachment;
+
+    VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT,
+                                       VK_DYNAMIC_STATE_SCISSOR };
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = 2;
+    dynamicState.pDynamicStates = dynamicStates;
+
+    VkPipelineRenderingCreateInfo renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachmentFormats = &colorFormat;
+
+    VkGraphicsPipelineCreateInfo drawInfo{};
+    drawInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    drawInfo.pNext = renderPass == VK_NULL_HANDLE ? &renderingInfo : nullptr;
+    drawInfo.stageCount = 2;
+    drawInfo.pStages = stages;
+    drawInfo.pVertexInputState = &vertexInput;
+    drawInfo.pInputAssemblyState = &inputAssembly;
+    drawInfo.pViewportState = &viewportState;
+    drawInfo.pRasterizationState = &rasterizer;
+    drawInfo.pMultisampleState = &multisampling;
+    drawInfo.pColorBlendState = &colorBlending;
+    drawInfo.pDynamicState = &dynamicState;
+    drawInfo.layout = drawLayout_;
+    drawInfo.renderPass = renderPass;
+
+    if (JlVulkanPipelineCache::createGraphicsPipeline(
+          drawInfo, &drawPipeline_) != VK_SUCCESS)
+      throw runtime_error("Failed to create instanced draw pipeline.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    success = false;
+  }
+
+  vk_->vkDestroyShaderModule(device_, cullShader, allocator_);
+  vk_->vkDestroyShaderModule(device_, vertShader, allocator_);
+  vk_->vkDestroyShaderModule(device_, fragShader, allocator_);
+  return success;
+}
+
+bool JlVulkanCulling::createBuffer(VkDeviceSize size,
+                                   VkBufferUsageFlags usage,
+                                   VkMemoryPropertyFlags requiredFlags,
+                                   VkMemoryPropertyFlags preferredFlags,
+                                   VkBuffer* buffer,
+                                   JlVulkanMemory::Allocation& allocation) {
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = usage;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  try {
+    if (JlVulkanMemory::createBuffer(bufferInfo, requiredFlags,
+                                     preferredFlags, JlVulkanMemory::Buddy,
+                                     buffer, allocation) != VK_SUCCESS)
+      throw runtime_error("Failed to create culling buffer.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return false;
+  }
+
+  return true;
+}
+
+void JlVulkanCulling::destroyInstanceBuffers() {
+  if (instanceBuffer_ != VK_NULL_HANDLE)
+    JlVulkanTimeline::destroyBuffer(instanceBuffer_, instanceAllocation_);
+  if (drawBuffer_ != VK_NULL_HANDLE)
+    JlVulkanTimeline::destroyBuffer(drawBuffer_, drawAllocation_);
+
+  instanceBuffer_ = VK_NULL_HANDLE;
+  drawBuffer_ = VK_NULL_HANDLE;
+  instanceCapacity_ = 0;
+}
+
+void JlVulkanCulling::writeDescriptors() {
+  VkDescriptorBufferInfo bufferInfos[3] = {
+    { instanceBuffer_, 0, VK_WHOLE_SIZE },
+    { drawBuffer_, 0, VK_WHOLE_SIZE },
+    { countBuffer_, 0, VK_WHOLE_SIZE } };
+
+  VkWriteDescriptorSet writes[3]{};
+  for (uint32_t i = 0; i < 3; i++) {
+    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet = descriptorSet_;
+    writes[i].dstBinding = i;
+    writes[i].descriptorCount = 1;
+    writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[i].pBufferInfo = &bufferInfos[i];
+  }
+
+  vk_->vkUpdateDescriptorSets(device_, 3, writes, 0, nullptr);
+}
+
+VkShaderModule JlVulkanCulling::loadShader(const path& file) {
+  ifstream in(file, ios::ate | ios::binary);
+  if (!in.is_open()) return VK_NULL_HANDLE;
+
+  vector<char> code(static_cast<size_t>(in.tellg()));
+  in.seekg(0);
+  in.read(code.data(), code.size());
+
+  VkShaderModuleCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  createInfo.codeSize = code.size();
+  createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+  VkShaderModule shaderModule = VK_NULL_HANDLE;
+  vk_->vkCreateShaderModule(device_, &createInfo, allocator_, &shaderModule);
+  return shaderModule;
+}
@@ -0,0 +1,400 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#include "graphics/jl_vulkan_descriptors.h"
+#include "graphics/jl_vulkan_dispatch.h"
+#include "graphics/jl_vulkan_memory.h"
+#include "engine/jl_hash.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "defines.h"
+
+using namespace std;
+
+const VkAllocationCallbacks* const allocator_ =
+  JlVulkanMemory::getAllocationCallbacks();
+const JlVulkanDispatch* const vk_ = &JlVulkanDispatch::get();
+
+// Descriptors of each type a transient pool holds per set.
+const VkDescriptorPoolSize transientSetSizes_[] = {
+  { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 },
+  { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 },
+  { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 },
+  { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 2 },
+  { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+  { VK_DESCRIPTOR_TYPE_SAMPLER, 1 }
+};
+
+// Cached layouts get pools sized for them, growing from this many sets.
+const uint32_t cachedSetsPerPool_ = 16;
+
+VkDevice descriptorCacheDevice_ = VK_NULL_HANDLE;
+unordered_map<uint64_t, VkDescriptorSetLayout> cachedLayouts_;
+unordered_map<VkDescriptorSetLayout, JlVulkanDescriptorCache::LayoutPools>
+  layoutPools_;
+unordered_map<uint64_t, vector<JlVulkanDescriptorCache::CachedSet>>
+  cachedSets_;
+JlVulkanDescriptorCache::Stats descriptorCacheStats_;
+
+static bool isSameWrite(const JlVulkanDescriptorCache::Write& a,
+                        const JlVulkanDescriptorCache::Write& b) {
+  return a.binding == b.binding && a.type == b.type &&
+         a.buffer.buffer == b.buffer.buffer &&
+         a.buffer.offset == b.buffer.offset &&
+         a.buffer.range == b.buffer.range &&
+         a.image.sampler == b.image.sampler &&
+         a.image.imageView == b.image.imageView &&
+         a.image.imageLayout == b.image.imageLayout;
+}
+
+JlVulkanDescriptorAllocator::JlVulkanDescriptorAllocator(
+  VkDevice device, uint32_t framesInFlight, uint32_t threadCount,
+  uint32_t setsPerPool)
+  : device_(device), setsPerPool_(max(setsPerPool, 1u)) {
+  pools_.resize(framesInFlight);
+  for (vector<ThreadPools>& framePools : pools_)
+    framePools.resize(max(threadCount, 1u));
+}
+
+JlVulkanDescriptorAllocator::~JlVulkanDescriptorAllocator() {
+  // Destroying a pool frees every set allocated from it.
+  for (vector<ThreadPools>& framePools : pools_)
+    for (ThreadPools& threadPools : framePools)
+      for (VkDescriptorPool pool : threadPools.pools)
+        vk_->vkDestroyDescriptorPool(device_, pool, allocator_);
+}
+
+void JlVulkanDescriptorAllocator::resetFrame(uint32_t frameIndex) {
+  uint32_t frameSets = 0;
+
+  // One reset per used pool recycles all of that frame's sets at once.
+  for (ThreadPools& threadPools : pools_[frameIndex]) {
+    uint32_t usedPools =
+      min(threadPools.current + 1,
+          static_cast<uint32_t>(threadPools.pools.size()));
+    if (threadPools.sets > 0)
+      for (uint32_t i = 0; i < usedPools; i++)
+        vk_->vkResetDescriptorPool(device_, threadPools.pools[i], 0);
+
+    frameSets += threadPools.sets;
+    stats_.sets += threadPools.sets;
+    stats_.failed += threadPools.failed;
+    stats_.maxSetsPerThread = max(stats_.maxSetsPerThread, threadPools.sets);
+    stats_.maxPoolsPerThread =
+      max(stats_.maxPoolsPerThread,
+          static_cast<uint32_t>(threadPools.pools.size()));
+
+    threadPools.current = 0;
+    threadPools.sets = 0;
+    threadPools.failed = 0;
+  }
+
+  stats_.frames++;
+  stats_.maxSetsPerFrame = max(stats_.maxSetsPerFrame, frameSets);
+}
+
+VkDescriptorSet JlVulkanDescriptorAllocator::allocate(
+  uint32_t frameIndex, uint32_t thread, VkDescriptorSetLayout layout) {
+  ThreadPools& threadPools = pools_[frameIndex][thread];
+
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &layout;
+
+  for (;;) {
+    bool created = false;
+    if (threadPools.current == threadPools.pools.size()) {
+      VkDescriptorPool pool = createPool();
+      if (pool == VK_NULL_HANDLE) break;
+
+      threadPools.pools.push_back(pool);
+      created = true;
+    }
+
+    allocInfo.descriptorPool = threadPools.pools[threadPools.current];
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    VkResult result =
+      vk_->vkAllocateDescriptorSets(device_, &allocInfo, &descriptorSet);
+    if (result == VK_SUCCESS) {
+      threadPools.sets++;
+      return descriptorSet;
+    }
+
+    // A full pool moves on to the next, a set not fitting an empty pool
+    // never will.
+    if (created || (result != VK_ERROR_OUT_OF_POOL_MEMORY &&
+                    result != VK_ERROR_FRAGMENTED_POOL))
+      break;
+    threadPools.current++;
+  }
+
+  threadPools.failed++;
+  return VK_NULL_HANDLE;
+}
+
+JlVulkanDescriptorAllocator::Stats
+JlVulkanDescriptorAllocator::getStats() const {
+  Stats stats = stats_;
+  for (const vector<ThreadPools>& framePools : pools_)
+    for (const ThreadPools& threadPools : framePools)
+      stats.pools += static_cast<uint32_t>(threadPools.pools.size());
+  return stats;
+}
+
+void JlVulkanDescriptorAllocator::reportStats(const char* name) const {
+  Stats stats = getStats();
+  if (stats.sets == 0) return;
+
+  cout << JlEngineReports::jlGraphicsVulkan << name << " descriptors: "
+    << stats.sets << " sets over " << stats.frames << " frames, "
+    << stats.failed << " failed, high-water " << stats.maxSetsPerFrame
+    << " sets per frame / " << stats.maxSetsPerThread
+    << " per thread in " << stats.maxPoolsPerThread << " pools of "
+    << setsPerPool_ << " sets, " << stats.pools << " pools in total."
+    << endl;
+}
+
+VkDescriptorPool JlVulkanDescriptorAllocator::createPool() {
+  VkDescriptorPoolSize poolSizes[size(transientSetSizes_)];
+  for (size_t i = 0; i < size(transientSetSizes_); i++) {
+    poolSizes[i].type = transientSetSizes_[i].type;
+    poolSizes[i].descriptorCount =
+      transientSetSizes_[i].descriptorCount * setsPerPool_;
+  }
+
+  // Sets are never freed on their own, the pool doesn't need to track them.
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = setsPerPool_;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(size(poolSizes));
+  poolInfo.pPoolSizes = poolSizes;
+
+  VkDescriptorPool pool = VK_NULL_HANDLE;
+  try {
+    if (vk_->vkCreateDescriptorPool(device_, &poolInfo, allocator_, &pool) !=
+        VK_SUCCESS)
+      throw runtime_error("Failed to create transient descriptor pool.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return VK_NULL_HANDLE;
+  }
+
+  return pool;
+}
+
+void JlVulkanDescriptorCache::init(VkDevice device) {
+  descriptorCacheDevice_ = device;
+  descriptorCacheStats_ = {};
+}
+
+void JlVulkanDescriptorCache::shutdown() {
+  if (descriptorCacheDevice_ == VK_NULL_HANDLE) return;
+
+  for (auto& [layout, layoutPools] : layoutPools_)
+    for (VkDescriptorPool pool : layoutPools.pools)
+      vk_->vkDestroyDescriptorPool(descriptorCacheDevice_, pool, allocator_);
+  layoutPools_.clear();
+  cachedSets_.clear();
+
+  for (auto& [hash, layout] : cachedLayouts_)
+    vk_->vkDestroyDescriptorSetLayout(descriptorCacheDevice_, layout,
+                                      allocator_);
+  cachedLayouts_.clear();
+
+  descriptorCacheDevice_ = VK_NULL_HANDLE;
+}
+
+VkDescriptorSetLayout JlVulkanDescriptorCache::getLayout(
+  const vector<VkDescriptorSetLayoutBinding>& bindings) {
+  uint64_t hash = JlHash::value(JlHash::offsetBasis, bindings.size());
+  for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+    hash = JlHash::value(hash, binding.binding);
+    hash = JlHash::value(hash, binding.descriptorType);
+    hash = JlHash::value(hash, binding.descriptorCount);
+    hash = JlHash::value(hash, binding.stageFlags);
+    hash = JlHash::value(hash, binding.pImmutableSamplers);
+  }
+
+  auto found = cachedLayouts_.find(hash);
+  if (found != cachedLayouts_.end()) return found->second;
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+  layoutInfo.pBindings = bindings.data();
+
+  VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+  try {
+    if (vk_->vkCreateDescriptorSetLayout(descriptorCacheDevice_, &layoutInfo,
+                                         allocator_, &layout) != VK_SUCCESS)
+      throw runtime_error("Failed to create cached descriptor set layout.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return VK_NULL_HANDLE;
+  }
+
+  // What one set of the layout takes, pools are sized in multiples of it.
+  LayoutPools& layoutPools = layoutPools_[layout];
+  for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+    auto setSize = find_if(layoutPools.setSizes.begin(),
+                           layoutPools.setSizes.end(),
+                           [&](const VkDescriptorPoolSize& poolSize) {
+                             return poolSize.type == binding.descriptorType;
+                           });
+    if (setSize != layoutPools.setSizes.end())
+      setSize->descriptorCount += binding.descriptorCount;
+    else
+      layoutPools.setSizes.push_back(
+        { binding.descriptorType, binding.descriptorCount });
+  }
+
+  cachedLayouts_[hash] = layout;
+  descriptorCacheStats_.layouts++;
+  return layout;
+}
+
+VkDescriptorSet JlVulkanDescriptorCache::getSet(VkDescriptorSetLayout layout,
+                                                const vector<Write>& writes) {
+  uint64_t hash = JlHash::value(JlHash::offsetBasis, layout);
+  for (const Write& write : writes) {
+    hash = JlHash::value(hash, write.binding);
+    hash = JlHash::value(hash, write.type);
+    hash = JlHash::value(hash, write.buffer.buffer);
+    hash = JlHash::value(hash, write.buffer.offset);
+    hash = JlHash::value(hash, write.buffer.range);
+    hash = JlHash::value(hash, write.image.sampler);
+    hash = JlHash::value(hash, write.image.imageView);
+    hash = JlHash::value(hash, write.image.imageLayout);
+  }
+
+  vector<CachedSet>& candidates = cachedSets_[hash];
+  for (const CachedSet& candidate : candidates) {
+    if (candidate.layout == layout &&
+        equal(candidate.writes.begin(), candidate.writes.end(),
+              writes.begin(), writes.end(), isSameWrite)) {
+      descriptorCacheStats_.hits++;
+      return candidate.set;
+    }
+  }
+  if (!candidates.empty()) descriptorCacheStats_.collisions++;
+
+  auto layoutPools = layoutPools_.find(layout);
+  if (layoutPools == layoutPools_.end()) {
+    cerr << JlEngineReports::jlGraphicsVulkan
+      << "Descriptor set layout wasn't created by the cache." << endl;
+    return VK_NULL_HANDLE;
+  }
+
+  LayoutPools& pools = layoutPools->second;
+  if (pools.sets == pools.capacity && !growPool(pools))
+    return VK_NULL_HANDLE;
+
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = pools.pools.back();
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &layout;
+
+  VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+  try {
+    if (vk_->vkAllocateDescriptorSets(descriptorCacheDevice_, &allocInfo,
+                                      &descriptorSet) != VK_SUCCESS)
+      throw runtime_error("Failed to allocate cached descriptor set.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return VK_NULL_HANDLE;
+  }
+
+  vector<VkWriteDescriptorSet> descriptorWrites(writes.size());
+  for (size_t i = 0; i < writes.size(); i++) {
+    VkWriteDescriptorSet& descriptorWrite = descriptorWrites[i];
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = descriptorSet;
+    descriptorWrite.dstBinding = writes[i].binding;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.descriptorType = writes[i].type;
+
+    switch (writes[i].type) {
+      case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+      case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+      case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+      case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+        descriptorWrite.pBufferInfo = &writes[i].buffer;
+        break;
+      default:
+        descriptorWrite.pImageInfo = &writes[i].image;
+        break;
+    }
+  }
+  vk_->vkUpdateDescriptorSets(descriptorCacheDevice_,
+                              static_cast<uint32_t>(descriptorWrites.size()),
+                              descriptorWrites.data(), 0, nullptr);
+
+  pools.sets++;
+  candidates.push_back({ layout, writes, descriptorSet });
+  descriptorCacheStats_.sets++;
+  descriptorCacheStats_.maxSetsPerLayout =
+    max(descriptorCacheStats_.maxSetsPerLayout, pools.sets);
+  return descriptorSet;
+}
+
+JlVulkanDescriptorCache::Stats JlVulkanDescriptorCache::getStats() {
+  return descriptorCacheStats_;
+}
+
+void JlVulkanDescriptorCache::reportStats() {
+  if (descriptorCacheStats_.layouts == 0) return;
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Descriptor cache: "
+    << descriptorCacheStats_.layouts << " layouts, "
+    << descriptorCacheStats_.sets << " sets, " << descriptorCacheStats_.hits
+    << " hits, " << descriptorCacheStats_.collisions << " collisions, "
+    << descriptorCacheStats_.pools << " pools, high-water "
+    << descriptorCacheStats_.maxSetsPerLayout << " sets per layout." << endl;
+}
+
+bool JlVulkanDescriptorCache::growPool(LayoutPools& layoutPools) {
+  // Each pool holds as many sets as all before it, so the pool count only
+  // grows with the log of the sets.
+  uint32_t poolSets = max(layoutPools.capacity, cachedSetsPerPool_);
+
+  vector<VkDescriptorPoolSize> poolSizes = layoutPools.setSizes;
+  for (VkDescriptorPoolSize& poolSize : poolSizes)
+    poolSize.descriptorCount *= poolSets;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = poolSets;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  poolInfo.pPoolSizes = poolSizes.data();
+
+  VkDescriptorPool pool = VK_NULL_HANDLE;
+  try {
+    if (vk_->vkCreateDescriptorPool(descriptorCacheDevice_, &poolInfo,
+                                    allocator_, &pool) != VK_SUCCESS)
+      throw runtime_error("Failed to create cached descriptor pool.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return false;
+  }
+
+  layoutPools.pools.push_back(pool);
+  layoutPools.capacity += poolSets;
+  descriptorCacheStats_.pools++;
+  return true;
+}
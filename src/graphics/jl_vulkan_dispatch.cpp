@@ -0,0 +1,84 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#include "graphics/jl_vulkan_dispatch.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+
+#include "defines.h"
+
+using namespace std;
+
+JlVulkanDispatch vulkanDispatch_;
+
+bool JlVulkanDispatch::loadGlobal() {
+#define JL_VULKAN_LOAD_FUNCTION(name)                                        \
+  vulkanDispatch_.name = reinterpret_cast<PFN_##name>(                       \
+    vkGetInstanceProcAddr(VK_NULL_HANDLE, #name));
+  JL_VULKAN_GLOBAL_FUNCTIONS(JL_VULKAN_LOAD_FUNCTION)
+#undef JL_VULKAN_LOAD_FUNCTION
+
+  try {
+    if (vulkanDispatch_.vkCreateInstance == nullptr)
+      throw runtime_error("Failed to load the Vulkan loader's entry points.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool JlVulkanDispatch::loadInstance(VkInstance instance) {
+#define JL_VULKAN_LOAD_FUNCTION(name)                                        \
+  vulkanDispatch_.name = reinterpret_cast<PFN_##name>(                       \
+    vkGetInstanceProcAddr(instance, #name));
+  JL_VULKAN_INSTANCE_FUNCTIONS(JL_VULKAN_LOAD_FUNCTION)
+#undef JL_VULKAN_LOAD_FUNCTION
+
+  try {
+    if (vulkanDispatch_.vkGetDeviceProcAddr == nullptr)
+      throw runtime_error("Failed to load instance functions.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool JlVulkanDispatch::loadDevice(VkDevice device) {
+  uint32_t loaded = 0, missing = 0;
+
+#define JL_VULKAN_LOAD_FUNCTION(name)                                        \
+  vulkanDispatch_.name = reinterpret_cast<PFN_##name>(                       \
+    vulkanDispatch_.vkGetDeviceProcAddr(device, #name));                     \
+  if (vulkanDispatch_.name != nullptr)                                       \
+    loaded++;                                                                \
+  else                                                                       \
+    missing++;
+  JL_VULKAN_DEVICE_FUNCTIONS(JL_VULKAN_LOAD_FUNCTION)
+#undef JL_VULKAN_LOAD_FUNCTION
+
+  try {
+    if (vulkanDispatch_.vkQueueSubmit == nullptr)
+      throw runtime_error("Failed to load device functions.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return false;
+  }
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Device dispatch table loaded, "
+    << loaded << " functions, " << missing << " unavailable..." << endl;
+  return true;
+}
+
+const JlVulkanDispatch& JlVulkanDispatch::get() { return vulkanDispatch_; }
@@ -0,0 +1,284 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#include "graphics/jl_vulkan_features.h"
+#include "graphics/jl_vulkan_dispatch.h"
+#include "engine/jl_engine.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "defines.h"
+
+using namespace std;
+
+const JlVulkanDispatch* const vk_ = &JlVulkanDispatch::get();
+
+JlVulkanFeatures::Capabilities deviceCapabilities_;
+
+static bool hasExtension(const vector<VkExtensionProperties>& available,
+                         const char* name) {
+  for (const VkExtensionProperties& extension : available)
+    if (strcmp(extension.extensionName, name) == 0) return true;
+  return false;
+}
+
+// Appends a feature struct to the chain ending at next.
+template <typename T>
+static void chainFeatures(void**& next, T& features) {
+  *next = &features;
+  next = &features.pNext;
+}
+
+void JlVulkanFeatures::negotiate(VkPhysicalDevice physicalDevice,
+                                 const vector<const char*>& requiredExtensions,
+                                 bool presenting, DeviceSetup& setup,
+                                 VkDeviceCreateInfo& createInfo) {
+  VkPhysicalDeviceProperties properties;
+  vk_->vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+  Capabilities& caps = deviceCapabilities_;
+  caps = {};
+  caps.apiVersion = properties.apiVersion;
+
+  uint32_t extensionCount;
+  vk_->vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr,
+                                            &extensionCount, nullptr);
+  vector<VkExtensionProperties> available(extensionCount);
+  vk_->vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr,
+                                            &extensionCount, available.data());
+
+  // Feature structs only chain through features2 (1.1), the per version
+  // structs need the device to be at least that version.
+  bool features2 = properties.apiVersion >= VK_API_VERSION_1_1;
+  bool core12 = properties.apiVersion >= VK_API_VERSION_1_2;
+  bool core13 = properties.apiVersion >= VK_API_VERSION_1_3;
+  bool presentWaitExtensions =
+    features2 && presenting &&
+    hasExtension(available, VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+    hasExtension(available, VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+  bool pipelineLibraryExtensions =
+    features2 && JlEngineSettings::pipelineLibraries &&
+    hasExtension(available, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) &&
+    hasExtension(available, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+
+  // Everything that could be enabled, queried in one go.
+  VkPhysicalDeviceFeatures2 supported{};
+  supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  VkPhysicalDeviceVulkan11Features supported11{};
+  supported11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+  VkPhysicalDeviceVulkan12Features supported12{};
+  supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  VkPhysicalDeviceVulkan13Features supported13{};
+  supported13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+  VkPhysicalDevicePresentIdFeaturesKHR supportedPresentId{};
+  supportedPresentId.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+  VkPhysicalDevicePresentWaitFeaturesKHR supportedPresentWait{};
+  supportedPresentWait.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+  VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT supportedLibrary{};
+  supportedLibrary.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+
+  void** next = &supported.pNext;
+  if (core12) {
+    chainFeatures(next, supported11);
+    chainFeatures(next, supported12);
+  }
+  if (core13) chainFeatures(next, supported13);
+  if (presentWaitExtensions) {
+    chainFeatures(next, supportedPresentId);
+    chainFeatures(next, supportedPresentWait);
+  }
+  if (pipelineLibraryExtensions) chainFeatures(next, supportedLibrary);
+
+  if (features2)
+    vk_->vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+  else
+    vk_->vkGetPhysicalDeviceFeatures(physicalDevice, &supported.features);
+
+  setup.features = {};
+  setup.features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  setup.features11 = {};
+  setup.features11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+  setup.features12 = {};
+  setup.features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  setup.features13 = {};
+  setup.features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+  setup.presentId = {};
+  setup.presentId.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+  setup.presentWait = {};
+  setup.presentWait.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+  setup.pipelineLibrary = {};
+  setup.pipelineLibrary.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+  setup.extensions = requiredExtensions;
+
+  VkPhysicalDeviceFeatures& features = setup.features.features;
+  if (supported.features.multiDrawIndirect &&
+      supported.features.drawIndirectFirstInstance) {
+    features.multiDrawIndirect = VK_TRUE;
+    features.drawIndirectFirstInstance = VK_TRUE;
+    caps.multiDrawIndirect = true;
+  }
+  features.shaderInt16 = supported.features.shaderInt16;
+  caps.shaderInt16 = features.shaderInt16 == VK_TRUE;
+
+  if (core12) {
+    setup.features11.storageBuffer16BitAccess =
+      supported11.storageBuffer16BitAccess;
+    caps.storage16Bit = setup.features11.storageBuffer16BitAccess == VK_TRUE;
+
+    VkPhysicalDeviceVulkan12Features& features12 = setup.features12;
+    features12.timelineSemaphore = supported12.timelineSemaphore;
+    features12.drawIndirectCount = supported12.drawIndirectCount;
+    features12.bufferDeviceAddress = supported12.bufferDeviceAddress;
+    features12.storageBuffer8BitAccess = supported12.storageBuffer8BitAccess;
+    features12.shaderInt8 = supported12.shaderInt8;
+    features12.shaderFloat16 = supported12.shaderFloat16;
+
+    // Everything the bindless table needs, or none of it.
+    if (supported12.descriptorIndexing &&
+        supported12.runtimeDescriptorArray &&
+        supported12.descriptorBindingPartiallyBound &&
+        supported12.descriptorBindingUpdateUnusedWhilePending &&
+        supported12.descriptorBindingSampledImageUpdateAfterBind &&
+        supported12.descriptorBindingStorageBufferUpdateAfterBind &&
+        supported12.shaderSampledImageArrayNonUniformIndexing &&
+        supported12.shaderStorageBufferArrayNonUniformIndexing) {
+      features12.descriptorIndexing = VK_TRUE;
+      features12.runtimeDescriptorArray = VK_TRUE;
+      features12.descriptorBindingPartiallyBound = VK_TRUE;
+      features12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+      features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+      features12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+      features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+      features12.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+    }
+
+    caps.timelineSemaphore = features12.timelineSemaphore == VK_TRUE;
+    caps.drawIndirectCount = features12.drawIndirectCount == VK_TRUE;
+    caps.bufferDeviceAddress = features12.bufferDeviceAddress == VK_TRUE;
+    caps.storage8Bit = features12.storageBuffer8BitAccess == VK_TRUE;
+    caps.shaderInt8 = features12.shaderInt8 == VK_TRUE;
+    caps.shaderFloat16 = features12.shaderFloat16 == VK_TRUE;
+    caps.descriptorIndexing = features12.descriptorIndexing == VK_TRUE;
+  }
+
+  if (core13) {
+    setup.features13.synchronization2 = supported13.synchronization2;
+    setup.features13.dynamicRendering =
+      supported13.dynamicRendering && !JlEngineSettings::legacyRenderPasses;
+
+    caps.synchronization2 = setup.features13.synchronization2 == VK_TRUE;
+    caps.dynamicRendering = setup.features13.dynamicRendering == VK_TRUE;
+    // Core in 1.3, without a feature to switch on.
+    caps.pipelineCreationFeedback = true;
+  }
+
+  // Extensions that only add entry points or queries.
+  if (hasExtension(available, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME)) {
+    setup.extensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+    caps.calibratedTimestamps = true;
+  }
+  if (features2 &&
+      hasExtension(available, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+    setup.extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    caps.memoryBudget = true;
+  }
+
+  // Present wait needs present ids to name what it waits for, the frame
+  // pacer and latency metrics need both.
+  if (presentWaitExtensions && supportedPresentId.presentId &&
+      supportedPresentWait.presentWait) {
+    setup.extensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+    setup.extensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+    setup.presentId.presentId = VK_TRUE;
+    setup.presentWait.presentWait = VK_TRUE;
+    caps.presentWait = true;
+  }
+
+  // Pipeline parts compiled once and linked per permutation.
+  if (pipelineLibraryExtensions && supportedLibrary.graphicsPipelineLibrary) {
+    setup.extensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+    setup.extensions.push_back(
+      VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+    setup.pipelineLibrary.graphicsPipelineLibrary = VK_TRUE;
+    caps.graphicsPipelineLibrary = true;
+  }
+
+  // The enabled chain mirrors the queried one.
+  next = &setup.features.pNext;
+  if (core12) {
+    chainFeatures(next, setup.features11);
+    chainFeatures(next, setup.features12);
+  }
+  if (core13) chainFeatures(next, setup.features13);
+  if (caps.presentWait) {
+    chainFeatures(next, setup.presentId);
+    chainFeatures(next, setup.presentWait);
+  }
+  if (caps.graphicsPipelineLibrary) chainFeatures(next, setup.pipelineLibrary);
+
+  if (features2) {
+    createInfo.pNext = &setup.features;
+    createInfo.pEnabledFeatures = nullptr;
+  }
+  else {
+    createInfo.pNext = nullptr;
+    createInfo.pEnabledFeatures = &setup.features.features;
+  }
+  createInfo.enabledExtensionCount =
+    static_cast<uint32_t>(setup.extensions.size());
+  createInfo.ppEnabledExtensionNames = setup.extensions.data();
+}
+
+const JlVulkanFeatures::Capabilities& JlVulkanFeatures::get() {
+  return deviceCapabilities_;
+}
+
+void JlVulkanFeatures::reportCapabilities() {
+  const Capabilities& caps = deviceCapabilities_;
+  const pair<const char*, bool> paths[] = {
+    { "multi draw indirect", caps.multiDrawIndirect },
+    { "draw indirect count", caps.drawIndirectCount },
+    { "timeline semaphores", caps.timelineSemaphore },
+    { "synchronization2", caps.synchronization2 },
+    { "dynamic rendering", caps.dynamicRendering },
+    { "descriptor indexing", caps.descriptorIndexing },
+    { "buffer device address", caps.bufferDeviceAddress },
+    { "8 bit storage", caps.storage8Bit },
+    { "16 bit storage", caps.storage16Bit },
+    { "int8", caps.shaderInt8 },
+    { "int16", caps.shaderInt16 },
+    { "float16", caps.shaderFloat16 },
+    { "creation feedback", caps.pipelineCreationFeedback },
+    { "memory budget", caps.memoryBudget },
+    { "calibrated timestamps", caps.calibratedTimestamps },
+    { "present wait", caps.presentWait },
+    { "pipeline libraries", caps.graphicsPipelineLibrary }
+  };
+
+  string active, missing;
+  for (const auto& [name, enabled] : paths) {
+    string& list = enabled ? active : missing;
+    if (!list.empty()) list += ", ";
+    list += name;
+  }
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Device features: "
+    << (active.empty() ? "none" : active) << "..." << endl;
+  if (!missing.empty())
+    cout << JlEngineReports::jlGraphicsVulkan << "Unavailable: " << missing
+      << "..." << endl;
+}
@@ -0,0 +1,242 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#include "graphics/jl_vulkan_frame_pacer.h"
+#include "graphics/jl_vulkan_dispatch.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "defines.h"
+
+using namespace std;
+
+const JlVulkanDispatch* const vk_ = &JlVulkanDispatch::get();
+
+const uint32_t latencyHistorySize_ = 256;
+const uint32_t refreshHistorySize_ = 32;
+// Present completions further apart than this many refreshes missed one.
+const double missedRefreshRatio_ = 1.5;
+// Start delay grows by this each frame on time, and halves on a miss.
+const double delayStepMs_ = 0.1;
+// Never starts closer to the vblank than this.
+const double delayMarginMs_ = 1.0;
+const uint64_t presentTimeoutNs_ = 100000000;
+
+VkDevice pacerDevice_ = VK_NULL_HANDLE;
+PFN_vkWaitForPresentKHR waitForPresent_ = nullptr;
+VkSwapchainKHR pacerSwapChain_ = VK_NULL_HANDLE;
+bool pacing_ = false;
+
+uint64_t nextPresentId_ = 1;
+deque<JlVulkanFramePacer::PendingPresent> pendingPresents_;
+
+chrono::steady_clock::time_point pacerEpoch_;
+double lastPresentUs_ = 0.0;
+vector<double> refreshIntervals_;
+uint32_t nextRefreshInterval_ = 0;
+double startDelayMs_ = 0.0;
+
+vector<double> latencyHistory_;
+uint32_t nextLatency_ = 0;
+double lastLatencyMs_ = 0.0;
+JlVulkanFramePacer::Stats pacerStats_;
+
+static double getRefreshMs() {
+  if (refreshIntervals_.empty()) return 0.0;
+  return *min_element(refreshIntervals_.begin(), refreshIntervals_.end());
+}
+
+void JlVulkanFramePacer::init(VkDevice device, bool presentWait) {
+  pacerDevice_ = device;
+  pacerEpoch_ = chrono::steady_clock::now();
+
+  if (presentWait) waitForPresent_ = vk_->vkWaitForPresentKHR;
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Frame pacer created, "
+    << (waitForPresent_ != nullptr ? "present wait" : "no present wait")
+    << "..." << endl;
+}
+
+void JlVulkanFramePacer::shutdown() {
+  pendingPresents_.clear();
+  pacerSwapChain_ = VK_NULL_HANDLE;
+  waitForPresent_ = nullptr;
+  pacerDevice_ = VK_NULL_HANDLE;
+}
+
+bool JlVulkanFramePacer::hasPresentWait() {
+  return waitForPresent_ != nullptr;
+}
+
+void JlVulkanFramePacer::setSwapChain(VkSwapchainKHR swapChain,
+                                      bool pacing) {
+  pacerSwapChain_ = swapChain;
+  pacing_ = pacing && waitForPresent_ != nullptr;
+  nextPresentId_ = 1;
+  pendingPresents_.clear();
+
+  // A new swap chain may present at a different rate.
+  lastPresentUs_ = 0.0;
+  refreshIntervals_.clear();
+  nextRefreshInterval_ = 0;
+  startDelayMs_ = 0.0;
+}
+
+void JlVulkanFramePacer::beginFrame() {
+  if (waitForPresent_ == nullptr || pacerSwapChain_ == VK_NULL_HANDLE) return;
+
+  double beginUs = nowUs();
+
+  // Pacing, the previous frame has to reach the display first. Anything
+  // older is only polled.
+  while (!pendingPresents_.empty()) {
+    PendingPresent present = pendingPresents_.front();
+    bool blocking = pacing_ && pendingPresents_.size() == 1;
+
+    VkResult result = waitForPresent_(pacerDevice_, pacerSwapChain_,
+                                      present.id,
+                                      blocking ? presentTimeoutNs_ : 0);
+    if (result == VK_TIMEOUT) break;
+
+    pendingPresents_.pop_front();
+    if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)
+      completePresent(present, nowUs());
+  }
+
+  double waitedUs = nowUs() - beginUs;
+  pacerStats_.waitMs += waitedUs / 1000.0;
+
+  if (!pacing_ || !pendingPresents_.empty()) return;
+
+  // Right after a present, the next vblank is a refresh away. Starting as
+  // late as frames still make it keeps the input they sample fresh.
+  double refreshMs = getRefreshMs();
+  double limitMs = max(refreshMs - delayMarginMs_, 0.0);
+  startDelayMs_ = min(startDelayMs_, limitMs);
+  if (startDelayMs_ > 0.0) {
+    double sinceUs = nowUs() - lastPresentUs_;
+    double sleepUs = startDelayMs_ * 1000.0 - sinceUs;
+    if (sleepUs > 0.0)
+      this_thread::sleep_for(chrono::duration<double, micro>(sleepUs));
+  }
+
+  pacerStats_.pacedFrames++;
+  pacerStats_.delayMs += startDelayMs_;
+}
+
+uint64_t JlVulkanFramePacer::markSubmit() {
+  if (waitForPresent_ == nullptr || pacerSwapChain_ == VK_NULL_HANDLE)
+    return 0;
+
+  PendingPresent present;
+  present.id = nextPresentId_++;
+  present.submitUs = nowUs();
+  pendingPresents_.push_back(present);
+  return present.id;
+}
+
+void JlVulkanFramePacer::cancelPresent(uint64_t presentId) {
+  pendingPresents_.erase(
+    remove_if(pendingPresents_.begin(), pendingPresents_.end(),
+              [presentId](const PendingPresent& present) {
+                return present.id == presentId;
+              }),
+    pendingPresents_.end());
+}
+
+JlVulkanFramePacer::Latency JlVulkanFramePacer::getLatency() {
+  Latency latency;
+  if (latencyHistory_.empty()) return latency;
+
+  vector<double> sorted = latencyHistory_;
+  sort(sorted.begin(), sorted.end());
+
+  double total = 0.0;
+  for (double sample : sorted) total += sample;
+
+  auto percentile = [&sorted](double p) {
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+  };
+
+  latency.samples = static_cast<uint32_t>(sorted.size());
+  latency.lastMs = lastLatencyMs_;
+  latency.averageMs = total / sorted.size();
+  latency.p50Ms = percentile(0.50);
+  latency.p95Ms = percentile(0.95);
+  latency.p99Ms = percentile(0.99);
+  return latency;
+}
+
+void JlVulkanFramePacer::reportStats() {
+  if (waitForPresent_ == nullptr && pacerStats_.presented == 0) {
+    cout << JlEngineReports::jlGraphicsVulkan
+      << "Present latency unavailable without present wait." << endl;
+    return;
+  }
+
+  Latency latency = getLatency();
+  cout << JlEngineReports::jlGraphicsVulkan << "Submit to present: "
+    << latency.averageMs << " ms avg / " << latency.p50Ms << " p50 / "
+    << latency.p95Ms << " p95 / " << latency.p99Ms << " p99 over "
+    << latency.samples << " frames, " << pacerStats_.missed
+    << " missed refreshes." << endl;
+
+  if (pacerStats_.pacedFrames > 0) {
+    double frames = static_cast<double>(pacerStats_.pacedFrames);
+    cout << JlEngineReports::jlGraphicsVulkan << "Paced "
+      << pacerStats_.pacedFrames << " frames, "
+      << pacerStats_.delayMs / frames << " ms avg start delay, "
+      << pacerStats_.waitMs / frames << " ms avg present wait, "
+      << getRefreshMs() << " ms refresh." << endl;
+  }
+}
+
+void JlVulkanFramePacer::completePresent(const PendingPresent& present,
+                                         double nowUs) {
+  lastLatencyMs_ = (nowUs - present.submitUs) / 1000.0;
+  if (latencyHistory_.size() < latencyHistorySize_)
+    latencyHistory_.push_back(lastLatencyMs_);
+  else
+    latencyHistory_[nextLatency_] = lastLatencyMs_;
+  nextLatency_ = (nextLatency_ + 1) % latencyHistorySize_;
+  pacerStats_.presented++;
+
+  // Polled completions are only seen a frame late, they say nothing
+  // about the refresh rate.
+  if (!pacing_) return;
+
+  if (lastPresentUs_ > 0.0) {
+    double intervalMs = (nowUs - lastPresentUs_) / 1000.0;
+    double refreshMs = getRefreshMs();
+
+    if (refreshMs > 0.0 && intervalMs > refreshMs * missedRefreshRatio_) {
+      pacerStats_.missed++;
+      startDelayMs_ *= 0.5;
+    }
+    else {
+      startDelayMs_ += delayStepMs_;
+    }
+
+    if (refreshIntervals_.size() < refreshHistorySize_)
+      refreshIntervals_.push_back(intervalMs);
+    else
+      refreshIntervals_[nextRefreshInterval_] = intervalMs;
+    nextRefreshInterval_ = (nextRefreshInterval_ + 1) % refreshHistorySize_;
+  }
+  lastPresentUs_ = nowUs;
+}
+
+double JlVulkanFramePacer::nowUs() {
+  return chrono::duration<double, micro>(chrono::steady_clock::now() -
+                                         pacerEpoch_).count();
+}
@@ -0,0 +1,630 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#include "graphics/jl_vulkan_memory.h"
+#include "graphics/jl_vulkan_dispatch.h"
+#include "graphics/jl_vulkan_features.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "defines.h"
+
+using namespace std;
+
+const JlVulkanDispatch* const vk_ = &JlVulkanDispatch::get();
+
+constexpr VkDeviceSize minBuddyNodeSize_ = 256;
+constexpr VkDeviceSize largeHeapBlockSize_ = 64ull * 1024 * 1024;
+constexpr VkDeviceSize minBlockSize_ = 1ull * 1024 * 1024;
+constexpr uint32_t hostScopeCount_ = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+VkPhysicalDevice memoryPhysicalDevice_ = VK_NULL_HANDLE;
+VkDevice memoryDevice_ = VK_NULL_HANDLE;
+VkPhysicalDeviceMemoryProperties memoryProperties_;
+VkDeviceSize bufferImageGranularity_ = 1;
+uint32_t maxMemoryAllocationCount_ = 4096;
+uint32_t deviceAllocationCount_ = 0;
+
+mutex memoryMutex_;
+vector<unique_ptr<JlVulkanMemory::Block>> memoryBlocks_;
+
+struct HostAllocationHeader
+{
+  void* raw;
+  size_t size;
+  VkSystemAllocationScope scope;
+};
+
+atomic<uint64_t> hostAllocations_[hostScopeCount_];
+atomic<uint64_t> hostLiveAllocations_[hostScopeCount_];
+atomic<size_t> hostLiveBytes_[hostScopeCount_];
+atomic<size_t> hostPeakBytes_[hostScopeCount_];
+
+bool JlVulkanMemory::init(VkPhysicalDevice physicalDevice, VkDevice device) {
+  memoryPhysicalDevice_ = physicalDevice;
+  memoryDevice_ = device;
+  vk_->vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties_);
+
+  VkPhysicalDeviceProperties properties;
+  vk_->vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  bufferImageGranularity_ = properties.limits.bufferImageGranularity;
+  maxMemoryAllocationCount_ = properties.limits.maxMemoryAllocationCount;
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Memory allocator created ("
+    << memoryProperties_.memoryTypeCount << " memory types, granularity "
+    << bufferImageGranularity_ << ")..." << endl;
+  return true;
+}
+
+void JlVulkanMemory::shutdown() {
+  lock_guard<mutex> lock(memoryMutex_);
+
+  uint64_t leaked = 0;
+  for (unique_ptr<Block>& block : memoryBlocks_) {
+    leaked += block->allocations;
+    destroyBlock(block.get());
+  }
+  memoryBlocks_.clear();
+
+  if (leaked > 0)
+    cerr << JlEngineReports::jlGraphicsVulkan << leaked
+      << " device allocations were never freed." << endl;
+
+  cout << JlEngineReports::jlGraphicsVulkan
+    << "Memory allocator destroyed..." << endl;
+}
+
+bool JlVulkanMemory::allocate(const VkMemoryRequirements& requirements,
+                              VkMemoryPropertyFlags requiredFlags,
+                              VkMemoryPropertyFlags preferredFlags,
+                              ResourceClass resourceClass, Strategy strategy,
+                              Allocation& allocation) {
+  lock_guard<mutex> lock(memoryMutex_);
+
+  uint32_t memoryType = findMemoryType(requirements.memoryTypeBits,
+                                       requiredFlags, preferredFlags);
+  try {
+    if (memoryType == UINT32_MAX)
+      throw runtime_error("Failed to find a suitable memory type.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return false;
+  }
+
+  if (bufferImageGranularity_ <= 1) resourceClass = LinearResource;
+
+  VkDeviceSize blockSize = getBlockSize(memoryType);
+  VkDeviceSize offset = 0;
+  VkDeviceSize reserved = 0;
+  Block* target = nullptr;
+
+  // Anything this large would mostly waste a shared block.
+  if (requirements.size > blockSize / 2) {
+    target = createBlock(memoryType, requirements.size, resourceClass,
+                         strategy, true);
+    if (target == nullptr) return false;
+
+    reserved = requirements.size;
+    target->usedNodes[0] = reserved;
+  } else {
+    for (unique_ptr<Block>& block : memoryBlocks_) {
+      if (block->dedicated || block->memoryType != memoryType ||
+          block->resourceClass != resourceClass ||
+          block->strategy != strategy)
+        continue;
+
+      if (allocateFromBlock(*block, requirements.size, requirements.alignment,
+                            offset, reserved)) {
+        target = block.get();
+        break;
+      }
+    }
+
+    if (target == nullptr) {
+      target = createBlock(memoryType, blockSize, resourceClass, strategy,
+                           false);
+      if (target == nullptr ||
+          !allocateFromBlock(*target, requirements.size,
+                             requirements.alignment, offset, reserved))
+        return false;
+    }
+  }
+
+  target->allocations++;
+  target->usedBytes += requirements.size;
+  target->reservedBytes += reserved;
+
+  allocation.memory = target->memory;
+  allocation.offset = offset;
+  allocation.size = requirements.size;
+  allocation.mapped = target->mapped != nullptr
+                        ? static_cast<char*>(target->mapped) + offset
+                        : nullptr;
+  allocation.memoryType = memoryType;
+  allocation.block = target;
+  return true;
+}
+
+void JlVulkanMemory::free(Allocation& allocation) {
+  if (allocation.block == nullptr) return;
+
+  lock_guard<mutex> lock(memoryMutex_);
+
+  Block* block = allocation.block;
+  block->reservedBytes -= block->usedNodes[allocation.offset];
+  block->usedBytes -= allocation.size;
+  block->allocations--;
+  freeFromBlock(*block, allocation.offset);
+
+  allocation = {};
+
+  if (block->allocations > 0) return;
+
+  // Keep one empty block per kind around so a steady alloc/free pattern
+  // doesn't bounce on vkAllocateMemory.
+  bool keep = !block->dedicated;
+  if (keep) {
+    for (unique_ptr<Block>& other : memoryBlocks_) {
+      if (other.get() != block && !other->dedicated &&
+          other->memoryType == block->memoryType &&
+          other->resourceClass == block->resourceClass &&
+          other->strategy == block->strategy) {
+        keep = false;
+        break;
+      }
+    }
+  }
+  if (keep) return;
+
+  destroyBlock(block);
+  memoryBlocks_.erase(
+    remove_if(memoryBlocks_.begin(), memoryBlocks_.end(),
+              [block](const unique_ptr<Block>& b) { return b.get() == block; }),
+    memoryBlocks_.end());
+}
+
+VkResult JlVulkanMemory::createBuffer(const VkBufferCreateInfo& createInfo,
+                                      VkMemoryPropertyFlags requiredFlags,
+                                      VkMemoryPropertyFlags preferredFlags,
+                                      Strategy strategy, VkBuffer* buffer,
+                                      Allocation& allocation) {
+  VkResult result = vk_->vkCreateBuffer(memoryDevice_, &createInfo,
+                                        getAllocationCallbacks(), buffer);
+  if (result != VK_SUCCESS) return result;
+
+  VkMemoryRequirements requirements;
+  vk_->vkGetBufferMemoryRequirements(memoryDevice_, *buffer, &requirements);
+
+  if (!allocate(requirements, requiredFlags, preferredFlags, LinearResource,
+                strategy, allocation)) {
+    vk_->vkDestroyBuffer(memoryDevice_, *buffer, getAllocationCallbacks());
+    *buffer = VK_NULL_HANDLE;
+    return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+  }
+
+  return vk_->vkBindBufferMemory(memoryDevice_, *buffer, allocation.memory,
+                                 allocation.offset);
+}
+
+void JlVulkanMemory::destroyBuffer(VkBuffer buffer, Allocation& allocation) {
+  vk_->vkDestroyBuffer(memoryDevice_, buffer, getAllocationCallbacks());
+  free(allocation);
+}
+
+VkResult JlVulkanMemory::createImage(const VkImageCreateInfo& createInfo,
+                                     VkMemoryPropertyFlags requiredFlags,
+                                     Strategy strategy, VkImage* image,
+                                     Allocation& allocation) {
+  VkResult result = vk_->vkCreateImage(memoryDevice_, &createInfo,
+                                       getAllocationCallbacks(), image);
+  if (result != VK_SUCCESS) return result;
+
+  VkMemoryRequirements requirements;
+  vk_->vkGetImageMemoryRequirements(memoryDevice_, *image, &requirements);
+
+  ResourceClass resourceClass = createInfo.tiling == VK_IMAGE_TILING_OPTIMAL
+                                  ? OptimalImage
+                                  : LinearResource;
+
+  if (!allocate(requirements, requiredFlags, 0, resourceClass, strategy,
+                allocation)) {
+    vk_->vkDestroyImage(memoryDevice_, *image, getAllocationCallbacks());
+    *image = VK_NULL_HANDLE;
+    return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+  }
+
+  return vk_->vkBindImageMemory(memoryDevice_, *image, allocation.memory,
+                                allocation.offset);
+}
+
+void JlVulkanMemory::destroyImage(VkImage image, Allocation& allocation) {
+  vk_->vkDestroyImage(memoryDevice_, image, getAllocationCallbacks());
+  free(allocation);
+}
+
+JlVulkanMemory::Stats JlVulkanMemory::getStats(uint32_t memoryType) {
+  lock_guard<mutex> lock(memoryMutex_);
+
+  Stats stats;
+  VkDeviceSize freeBytes = 0;
+  VkDeviceSize largestRangeBytes = 0;
+  for (unique_ptr<Block>& block : memoryBlocks_) {
+    if (block->memoryType != memoryType) continue;
+
+    stats.deviceAllocations++;
+    stats.allocations += block->allocations;
+    stats.blockBytes += block->size;
+    stats.usedBytes += block->usedBytes;
+    stats.reservedBytes += block->reservedBytes;
+
+    if (block->dedicated) {
+      stats.dedicatedAllocations++;
+      continue;
+    }
+
+    VkDeviceSize largestRange = getLargestFreeRange(*block);
+    stats.blocks++;
+    stats.largestFreeRange = max(stats.largestFreeRange, largestRange);
+    freeBytes += block->size - block->reservedBytes;
+    largestRangeBytes += largestRange;
+  }
+
+  // 0 when every block's free memory is one range, approaching 1 as it
+  // splinters into pieces too small to serve larger requests.
+  if (freeBytes > 0)
+    stats.fragmentation =
+      1.0 - static_cast<double>(largestRangeBytes) / freeBytes;
+
+  return stats;
+}
+
+JlVulkanMemory::Stats JlVulkanMemory::getTotalStats() {
+  Stats total;
+  double weightedFragmentation = 0.0;
+  VkDeviceSize freeBytes = 0;
+
+  for (uint32_t i = 0; i < memoryProperties_.memoryTypeCount; i++) {
+    Stats stats = getStats(i);
+    total.deviceAllocations += stats.deviceAllocations;
+    total.blocks += stats.blocks;
+    total.dedicatedAllocations += stats.dedicatedAllocations;
+    total.allocations += stats.allocations;
+    total.blockBytes += stats.blockBytes;
+    total.usedBytes += stats.usedBytes;
+    total.reservedBytes += stats.reservedBytes;
+    total.largestFreeRange = max(total.largestFreeRange, stats.largestFreeRange);
+
+    VkDeviceSize typeFree = stats.blockBytes - stats.reservedBytes;
+    weightedFragmentation += stats.fragmentation * typeFree;
+    freeBytes += typeFree;
+  }
+
+  if (freeBytes > 0) total.fragmentation = weightedFragmentation / freeBytes;
+  return total;
+}
+
+void JlVulkanMemory::reportStats() {
+  for (uint32_t i = 0; i < memoryProperties_.memoryTypeCount; i++) {
+    Stats stats = getStats(i);
+    if (stats.deviceAllocations == 0) continue;
+
+    cout << JlEngineReports::jlGraphicsVulkan << "Memory type " << i << ": "
+      << stats.allocations << " allocations in " << stats.blocks
+      << " blocks + " << stats.dedicatedAllocations << " dedicated / "
+      << stats.usedBytes << " of " << stats.blockBytes << " bytes used / "
+      << stats.reservedBytes - stats.usedBytes << " bytes padding / "
+      << stats.fragmentation * 100.0 << "% fragmented." << endl;
+  }
+
+  // What the driver reports for every process on the heap, next to what
+  // this one may still use.
+  if (JlVulkanFeatures::get().memoryBudget) {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+    budget.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties.pNext = &budget;
+    vk_->vkGetPhysicalDeviceMemoryProperties2(memoryPhysicalDevice_,
+                                              &properties);
+
+    for (uint32_t i = 0; i < properties.memoryProperties.memoryHeapCount; i++)
+      cout << JlEngineReports::jlGraphicsVulkan << "Memory heap " << i
+        << ": " << budget.heapUsage[i] << " of " << budget.heapBudget[i]
+        << " budget bytes used / "
+        << properties.memoryProperties.memoryHeaps[i].size
+        << " bytes total." << endl;
+  }
+
+  HostStats host{};
+  for (uint32_t scope = 0; scope < hostScopeCount_; scope++) {
+    HostStats scopeStats =
+      getHostStats(static_cast<VkSystemAllocationScope>(scope));
+    host.allocations += scopeStats.allocations;
+    host.liveAllocations += scopeStats.liveAllocations;
+    host.liveBytes += scopeStats.liveBytes;
+    host.peakBytes += scopeStats.peakBytes;
+  }
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Host memory: "
+    << host.allocations << " driver allocations / " << host.liveBytes
+    << " bytes live / " << host.peakBytes << " bytes peak." << endl;
+}
+
+const VkAllocationCallbacks* JlVulkanMemory::getAllocationCallbacks() {
+  static const VkAllocationCallbacks callbacks = {
+    nullptr, hostAllocate, hostReallocate, hostFree, nullptr, nullptr };
+  return &callbacks;
+}
+
+JlVulkanMemory::HostStats JlVulkanMemory::getHostStats(
+  VkSystemAllocationScope scope) {
+  HostStats stats;
+  stats.allocations = hostAllocations_[scope];
+  stats.liveAllocations = hostLiveAllocations_[scope];
+  stats.liveBytes = hostLiveBytes_[scope];
+  stats.peakBytes = hostPeakBytes_[scope];
+  return stats;
+}
+
+uint32_t JlVulkanMemory::findMemoryType(uint32_t typeBits,
+                                        VkMemoryPropertyFlags requiredFlags,
+                                        VkMemoryPropertyFlags preferredFlags) {
+  VkMemoryPropertyFlags wanted[] = { requiredFlags | preferredFlags,
+                                     requiredFlags };
+
+  for (VkMemoryPropertyFlags flags : wanted) {
+    for (uint32_t i = 0; i < memoryProperties_.memoryTypeCount; i++) {
+      if ((typeBits & (1u << i)) &&
+          (memoryProperties_.memoryTypes[i].propertyFlags & flags) == flags)
+        return i;
+    }
+  }
+
+  return UINT32_MAX;
+}
+
+VkDeviceSize JlVulkanMemory::getBlockSize(uint32_t memoryType) {
+  uint32_t heapIndex = memoryProperties_.memoryTypes[memoryType].heapIndex;
+  VkDeviceSize heapSize = memoryProperties_.memoryHeaps[heapIndex].size;
+
+  if (heapSize >= 1024ull * 1024 * 1024) return largeHeapBlockSize_;
+
+  // Small heaps (e.g. the 256 MiB BAR window) get an eighth, rounded down to
+  // a power of two so the buddy levels line up.
+  VkDeviceSize blockSize = minBlockSize_;
+  while (blockSize * 2 <= heapSize / 8) blockSize *= 2;
+  return blockSize;
+}
+
+JlVulkanMemory::Block* JlVulkanMemory::createBlock(uint32_t memoryType,
+                                                   VkDeviceSize size,
+                                                   ResourceClass resourceClass,
+                                                   Strategy strategy,
+                                                   bool dedicated) {
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = size;
+  allocInfo.memoryTypeIndex = memoryType;
+
+  // Buffers may be bound anywhere in a linear block, any of them may need
+  // its device address.
+  VkMemoryAllocateFlagsInfo allocFlagsInfo{};
+  allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+  allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+  if (JlVulkanFeatures::get().bufferDeviceAddress &&
+      resourceClass == LinearResource)
+    allocInfo.pNext = &allocFlagsInfo;
+
+  unique_ptr<Block> block = make_unique<Block>();
+  try {
+    if (deviceAllocationCount_ >= maxMemoryAllocationCount_)
+      throw runtime_error("Reached maxMemoryAllocationCount.");
+
+    if (vk_->vkAllocateMemory(memoryDevice_, &allocInfo,
+                              getAllocationCallbacks(),
+                              &block->memory) != VK_SUCCESS)
+      throw runtime_error("Failed to allocate device memory.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return nullptr;
+  }
+  deviceAllocationCount_++;
+
+  block->size = size;
+  block->memoryType = memoryType;
+  block->resourceClass = resourceClass;
+  block->strategy = strategy;
+  block->dedicated = dedicated;
+
+  // Host visible blocks stay mapped for their whole lifetime.
+  if (memoryProperties_.memoryTypes[memoryType].propertyFlags &
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    vk_->vkMapMemory(memoryDevice_, block->memory, 0, VK_WHOLE_SIZE, 0,
+                     &block->mapped);
+
+  if (!dedicated && strategy == Buddy) {
+    block->freeNodes.resize(getBuddyLevelCount(size));
+    block->freeNodes[0].insert(0);
+  }
+
+  memoryBlocks_.push_back(move(block));
+  return memoryBlocks_.back().get();
+}
+
+void JlVulkanMemory::destroyBlock(Block* block) {
+  if (block->mapped != nullptr)
+    vk_->vkUnmapMemory(memoryDevice_, block->memory);
+
+  vk_->vkFreeMemory(memoryDevice_, block->memory, getAllocationCallbacks());
+  deviceAllocationCount_--;
+}
+
+bool JlVulkanMemory::allocateFromBlock(Block& block, VkDeviceSize size,
+                                       VkDeviceSize alignment,
+                                       VkDeviceSize& offset,
+                                       VkDeviceSize& reserved) {
+  if (block.strategy == Linear) {
+    VkDeviceSize start =
+      (block.linearOffset + alignment - 1) & ~(alignment - 1);
+    if (start + size > block.size) return false;
+
+    offset = start;
+    reserved = start + size - block.linearOffset;
+    block.linearOffset = start + size;
+    block.usedNodes[offset] = reserved;
+    return true;
+  }
+
+  // Nodes are aligned to their own size, so rounding up to the alignment
+  // covers it as well.
+  VkDeviceSize nodeSize = max({ size, alignment, minBuddyNodeSize_ });
+  VkDeviceSize rounded = minBuddyNodeSize_;
+  while (rounded < nodeSize) rounded *= 2;
+  if (rounded > block.size) return false;
+
+  uint32_t targetLevel = 0;
+  while ((block.size >> targetLevel) > rounded) targetLevel++;
+
+  int level = static_cast<int>(targetLevel);
+  while (level >= 0 && block.freeNodes[level].empty()) level--;
+  if (level < 0) return false;
+
+  VkDeviceSize node = *block.freeNodes[level].begin();
+  block.freeNodes[level].erase(block.freeNodes[level].begin());
+
+  // Split down, handing the upper halves back as free buddies.
+  for (uint32_t l = static_cast<uint32_t>(level); l < targetLevel; l++)
+    block.freeNodes[l + 1].insert(node + (block.size >> (l + 1)));
+
+  offset = node;
+  reserved = rounded;
+  block.usedNodes[offset] = reserved;
+  return true;
+}
+
+void JlVulkanMemory::freeFromBlock(Block& block, VkDeviceSize offset) {
+  auto used = block.usedNodes.find(offset);
+  if (used == block.usedNodes.end()) return;
+
+  VkDeviceSize nodeSize = used->second;
+  block.usedNodes.erase(used);
+
+  if (block.dedicated) return;
+
+  if (block.strategy == Linear) {
+    if (block.usedNodes.empty()) block.linearOffset = 0;
+    return;
+  }
+
+  uint32_t level = 0;
+  while ((block.size >> level) > nodeSize) level++;
+
+  // Merge with the buddy for as long as it is free as well.
+  while (level > 0) {
+    VkDeviceSize buddy = offset ^ (block.size >> level);
+    auto it = block.freeNodes[level].find(buddy);
+    if (it == block.freeNodes[level].end()) break;
+
+    block.freeNodes[level].erase(it);
+    offset = min(offset, buddy);
+    level--;
+  }
+
+  block.freeNodes[level].insert(offset);
+}
+
+uint32_t JlVulkanMemory::getBuddyLevelCount(VkDeviceSize blockSize) {
+  uint32_t levels = 1;
+  while ((blockSize >> levels) >= minBuddyNodeSize_) levels++;
+  return levels;
+}
+
+VkDeviceSize JlVulkanMemory::getLargestFreeRange(const Block& block) {
+  if (block.strategy == Linear) return block.size - block.linearOffset;
+
+  for (uint32_t level = 0; level < block.freeNodes.size(); level++)
+    if (!block.freeNodes[level].empty()) return block.size >> level;
+
+  return 0;
+}
+
+void* VKAPI_CALL JlVulkanMemory::hostAllocate(void*, size_t size,
+                                              size_t alignment,
+                                              VkSystemAllocationScope scope) {
+  if (size == 0) return nullptr;
+
+  alignment = max(alignment, alignof(HostAllocationHeader));
+  char* raw = static_cast<char*>(
+    malloc(size + alignment + sizeof(HostAllocationHeader)));
+  if (raw == nullptr) return nullptr;
+
+  uintptr_t start = reinterpret_cast<uintptr_t>(raw) +
+                    sizeof(HostAllocationHeader);
+  uintptr_t aligned = (start + alignment - 1) & ~(uintptr_t(alignment) - 1);
+
+  HostAllocationHeader* header =
+    reinterpret_cast<HostAllocationHeader*>(aligned) - 1;
+  header->raw = raw;
+  header->size = size;
+  header->scope = scope;
+
+  hostAllocations_[scope]++;
+  hostLiveAllocations_[scope]++;
+  size_t live = hostLiveBytes_[scope] += size;
+
+  size_t peak = hostPeakBytes_[scope];
+  while (live > peak && !hostPeakBytes_[scope].compare_exchange_weak(peak, live))
+    ;
+
+  return reinterpret_cast<void*>(aligned);
+}
+
+void* VKAPI_CALL JlVulkanMemory::hostReallocate(void* userData,
+                                                void* original, size_t size,
+                                                size_t alignment,
+                                                VkSystemAllocationScope scope) {
+  if (original == nullptr)
+    return hostAllocate(userData, size, alignment, scope);
+
+  if (size == 0) {
+    hostFree(userData, original);
+    return nullptr;
+  }
+
+  void* memory = hostAllocate(userData, size, alignment, scope);
+  if (memory == nullptr) return nullptr;
+
+  const HostAllocationHeader* header =
+    static_cast<const HostAllocationHeader*>(original) - 1;
+  memcpy(memory, original, min(size, header->size));
+
+  hostFree(userData, original);
+  return memory;
+}
+
+void VKAPI_CALL JlVulkanMemory::hostFree(void*, void* memory) {
+  if (memory == nullptr) return;
+
+  HostAllocationHeader* header =
+    static_cast<HostAllocationHeader*>(memory) - 1;
+
+  hostLiveAllocations_[header->scope]--;
+  hostLiveBytes_[header->scope] -= header->size;
+
+  ::free(header->raw);
+}
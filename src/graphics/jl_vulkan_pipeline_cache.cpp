@@ -0,0 +1,301 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#include "graphics/jl_vulkan_pipeline_cache.h"
+#include "graphics/jl_vulkan_dispatch.h"
+#include "graphics/jl_vulkan_features.h"
+#include "graphics/jl_vulkan_memory.h"
+#include "engine/jl_hash.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "defines.h"
+#include "engine/jl_engine.h"
+
+using namespace std;
+
+constexpr uint32_t cacheMagic_ = 0x434C504A;  // "JPLC"
+constexpr uint32_t cacheVersion_ = 1;
+
+const VkAllocationCallbacks* const allocator_ =
+  JlVulkanMemory::getAllocationCallbacks();
+const JlVulkanDispatch* const vk_ = &JlVulkanDispatch::get();
+
+VkPhysicalDeviceProperties cacheDeviceProperties_;
+VkDevice cacheDevice_ = VK_NULL_HANDLE;
+VkPipelineCache pipelineCache_ = VK_NULL_HANDLE;
+bool creationFeedback_ = false;
+JlVulkanPipelineCache::Stats cacheStats_;
+// Pipelines are also created on worker threads, see JlVulkanPipelineCompiler.
+mutex cacheStatsMutex_;
+
+bool JlVulkanPipelineCache::load(VkPhysicalDevice physicalDevice,
+                                 VkDevice device) {
+  using clock = chrono::steady_clock;
+  clock::time_point loadStart = clock::now();
+
+  cacheDevice_ = device;
+  cacheStats_ = {};
+  vk_->vkGetPhysicalDeviceProperties(physicalDevice, &cacheDeviceProperties_);
+
+  // Creation feedback is how hits and misses are counted.
+  creationFeedback_ = JlVulkanFeatures::get().pipelineCreationFeedback;
+
+  vector<char> data;
+  string cachePath = getCachePath();
+  if (readCacheFile(cachePath, data)) {
+    cacheStats_.warmStart = true;
+    cacheStats_.loadedBytes = data.size();
+  } else {
+    data.clear();
+  }
+
+  VkPipelineCacheCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  createInfo.initialDataSize = data.size();
+  createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+  try {
+    if (vk_->vkCreatePipelineCache(cacheDevice_, &createInfo, allocator_,
+                                   &pipelineCache_) != VK_SUCCESS)
+      throw runtime_error("Failed to create pipeline cache.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    pipelineCache_ = VK_NULL_HANDLE;
+    return false;
+  }
+
+  cacheStats_.loadMs =
+    chrono::duration<double, milli>(clock::now() - loadStart).count();
+
+  if (cacheStats_.warmStart)
+    cout << JlEngineReports::jlGraphicsVulkan << "Pipeline cache loaded ("
+      << cacheStats_.loadedBytes << " bytes)..." << endl;
+  else
+    cout << JlEngineReports::jlGraphicsVulkan
+      << "Pipeline cache created empty..." << endl;
+  return true;
+}
+
+void JlVulkanPipelineCache::save() {
+  if (pipelineCache_ == VK_NULL_HANDLE) return;
+
+  size_t dataSize = 0;
+  vk_->vkGetPipelineCacheData(cacheDevice_, pipelineCache_, &dataSize, nullptr);
+
+  vector<char> data(dataSize);
+  if (dataSize == 0 ||
+      vk_->vkGetPipelineCacheData(cacheDevice_, pipelineCache_, &dataSize,
+                                  data.data()) != VK_SUCCESS) {
+    cerr << JlEngineReports::jlGraphicsVulkan
+      << "Failed to read pipeline cache data, nothing saved." << endl;
+    return;
+  }
+
+  FileHeader header{};
+  header.magic = cacheMagic_;
+  header.version = cacheVersion_;
+  header.vendorID = cacheDeviceProperties_.vendorID;
+  header.deviceID = cacheDeviceProperties_.deviceID;
+  header.driverVersion = cacheDeviceProperties_.driverVersion;
+  memcpy(header.pipelineCacheUUID, cacheDeviceProperties_.pipelineCacheUUID,
+         VK_UUID_SIZE);
+  header.dataSize = dataSize;
+  header.dataHash = hashData(data.data(), dataSize);
+
+  // Written next to the real file and swapped in, so a crash mid-write
+  // leaves the previous cache intact.
+  string cachePath = getCachePath();
+  string tempPath = cachePath + ".tmp";
+  try {
+    {
+      ofstream file(tempPath, ios::binary | ios::trunc);
+      if (!file.is_open())
+        throw runtime_error("Failed to open \"" + tempPath + "\".");
+
+      file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      file.write(data.data(), dataSize);
+      if (!file.good())
+        throw runtime_error("Failed to write \"" + tempPath + "\".");
+    }
+
+    error_code ec;
+    rename(tempPath, cachePath, ec);
+    if (ec) throw runtime_error("Failed to replace \"" + cachePath + "\".");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return;
+  }
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Pipeline cache saved ("
+    << dataSize << " bytes)..." << endl;
+}
+
+void JlVulkanPipelineCache::destroy() {
+  if (pipelineCache_ == VK_NULL_HANDLE) return;
+
+  vk_->vkDestroyPipelineCache(cacheDevice_, pipelineCache_, allocator_);
+  pipelineCache_ = VK_NULL_HANDLE;
+
+  cout << JlEngineReports::jlGraphicsVulkan
+    << "Pipeline cache destroyed..." << endl;
+}
+
+VkPipelineCache JlVulkanPipelineCache::get() { return pipelineCache_; }
+
+VkResult JlVulkanPipelineCache::createGraphicsPipeline(
+  const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline* pipeline) {
+  VkGraphicsPipelineCreateInfo pipelineInfo = createInfo;
+
+  VkPipelineCreationFeedback pipelineFeedback{};
+  VkPipelineCreationFeedbackCreateInfo feedbackInfo{};
+  if (creationFeedback_) {
+    feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+    feedbackInfo.pNext = pipelineInfo.pNext;
+    feedbackInfo.pPipelineCreationFeedback = &pipelineFeedback;
+    pipelineInfo.pNext = &feedbackInfo;
+  }
+
+  using clock = chrono::steady_clock;
+  clock::time_point createStart = clock::now();
+
+  VkResult result = vk_->vkCreateGraphicsPipelines(
+    cacheDevice_, pipelineCache_, 1, &pipelineInfo, allocator_, pipeline);
+
+  lock_guard<mutex> lock(cacheStatsMutex_);
+  cacheStats_.createMs +=
+    chrono::duration<double, milli>(clock::now() - createStart).count();
+
+  if (result == VK_SUCCESS) countFeedback(pipelineFeedback);
+  return result;
+}
+
+VkResult JlVulkanPipelineCache::createComputePipeline(
+  const VkComputePipelineCreateInfo& createInfo, VkPipeline* pipeline) {
+  VkComputePipelineCreateInfo pipelineInfo = createInfo;
+
+  VkPipelineCreationFeedback pipelineFeedback{};
+  VkPipelineCreationFeedbackCreateInfo feedbackInfo{};
+  if (creationFeedback_) {
+    feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+    feedbackInfo.pNext = pipelineInfo.pNext;
+    feedbackInfo.pPipelineCreationFeedback = &pipelineFeedback;
+    pipelineInfo.pNext = &feedbackInfo;
+  }
+
+  using clock = chrono::steady_clock;
+  clock::time_point createStart = clock::now();
+
+  VkResult result = vk_->vkCreateComputePipelines(
+    cacheDevice_, pipelineCache_, 1, &pipelineInfo, allocator_, pipeline);
+
+  lock_guard<mutex> lock(cacheStatsMutex_);
+  cacheStats_.createMs +=
+    chrono::duration<double, milli>(clock::now() - createStart).count();
+
+  if (result == VK_SUCCESS) countFeedback(pipelineFeedback);
+  return result;
+}
+
+void JlVulkanPipelineCache::countFeedback(
+  const VkPipelineCreationFeedback& feedback) {
+  if (!(feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT)) return;
+
+  if (feedback.flags &
+      VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT)
+    cacheStats_.hits++;
+  else
+    cacheStats_.misses++;
+}
+
+const JlVulkanPipelineCache::Stats& JlVulkanPipelineCache::getStats() {
+  return cacheStats_;
+}
+
+void JlVulkanPipelineCache::reportStats() {
+  cout << JlEngineReports::jlGraphicsVulkan << "Pipeline cache "
+    << (cacheStats_.warmStart ? "warm" : "cold") << " start. Load "
+    << cacheStats_.loadMs << " ms / " << cacheStats_.hits << " hits / "
+    << cacheStats_.misses << " misses / pipeline creation "
+    << cacheStats_.createMs << " ms." << endl;
+}
+
+string JlVulkanPipelineCache::getCachePath() {
+  return JlEngineDirectories::appDir.string() + "pipeline.cache";
+}
+
+bool JlVulkanPipelineCache::readCacheFile(const string& filename,
+                                          vector<char>& data) {
+  ifstream file(filename, ios::ate | ios::binary);
+  if (!file.is_open()) return false;
+
+  size_t fileSize = static_cast<size_t>(file.tellg());
+  if (fileSize < sizeof(FileHeader)) {
+    cerr << JlEngineReports::jlGraphicsVulkan
+      << "Pipeline cache file is truncated, discarding it." << endl;
+    return false;
+  }
+
+  FileHeader header{};
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+  data.resize(fileSize - sizeof(FileHeader));
+  file.read(data.data(), data.size());
+
+  if (!file.good() || !isHeaderValid(header, data)) {
+    cerr << JlEngineReports::jlGraphicsVulkan
+      << "Pipeline cache doesn't match this device or driver, discarding it."
+      << endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool JlVulkanPipelineCache::isHeaderValid(const FileHeader& header,
+                                          const vector<char>& data) {
+  if (header.magic != cacheMagic_ || header.version != cacheVersion_)
+    return false;
+
+  if (header.vendorID != cacheDeviceProperties_.vendorID ||
+      header.deviceID != cacheDeviceProperties_.deviceID ||
+      header.driverVersion != cacheDeviceProperties_.driverVersion ||
+      memcmp(header.pipelineCacheUUID,
+             cacheDeviceProperties_.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    return false;
+
+  if (header.dataSize != data.size() ||
+      header.dataHash != hashData(data.data(), data.size()))
+    return false;
+
+  // The driver blob carries its own header, check it agrees as well.
+  VkPipelineCacheHeaderVersionOne blobHeader{};
+  if (data.size() < sizeof(blobHeader)) return false;
+  memcpy(&blobHeader, data.data(), sizeof(blobHeader));
+
+  return blobHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         blobHeader.vendorID == cacheDeviceProperties_.vendorID &&
+         blobHeader.deviceID == cacheDeviceProperties_.deviceID &&
+         memcmp(blobHeader.pipelineCacheUUID,
+                cacheDeviceProperties_.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+uint64_t JlVulkanPipelineCache::hashData(const void* data, size_t size) {
+  // Enough to catch truncated or corrupted files.
+  return JlHash::bytes(JlHash::offsetBasis, data, size);
+}
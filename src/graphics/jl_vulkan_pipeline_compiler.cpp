@@ -0,0 +1,624 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#include "graphics/jl_vulkan_pipeline_compiler.h"
+#include "graphics/jl_vulkan_dispatch.h"
+#include "graphics/jl_vulkan_memory.h"
+#include "graphics/jl_vulkan_pipeline_cache.h"
+#include "graphics/jl_vulkan_timeline.h"
+#include "engine/jl_hash.h"
+#include "engine/jl_worker_pool.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "defines.h"
+
+using namespace std;
+
+const VkAllocationCallbacks* const allocator_ =
+  JlVulkanMemory::getAllocationCallbacks();
+const JlVulkanDispatch* const vk_ = &JlVulkanDispatch::get();
+
+VkDevice compilerDevice_ = VK_NULL_HANDLE;
+unique_ptr<JlWorkerPool> compilerWorkers_;
+
+unordered_map<uint64_t, VkShaderModule> shaderModules_;
+unordered_map<JlVulkanPipelineCompiler::Key, JlVulkanPipelineCompiler::Entry>
+  compiledPipelines_;
+
+// Filled by the workers, drained by beginFrame().
+mutex compiledMutex_;
+vector<JlVulkanPipelineCompiler::Compiled> compiledQueue_;
+
+// Shared by every state using the same part, built by whichever worker
+// needs it first.
+bool compilerLibrary_ = false;
+mutex libraryMutex_;
+unordered_map<JlVulkanPipelineCompiler::Key, VkPipeline> libraryParts_;
+
+const VkGraphicsPipelineLibraryFlagsEXT libraryPartFlags_[] = {
+  VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+  VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+  VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+  VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT
+};
+
+bool frameUsedFallback_ = false;
+JlVulkanPipelineCompiler::Stats compilerStats_;
+
+template <typename T>
+static uint64_t hashVector(uint64_t hash, const vector<T>& values) {
+  hash = JlHash::value(hash, values.size());
+  return values.empty()
+           ? hash
+           : JlHash::bytes(hash, values.data(), values.size() * sizeof(T));
+}
+
+void JlVulkanPipelineCompiler::init(VkDevice device, uint32_t workerCount,
+                                    bool pipelineLibrary) {
+  compilerDevice_ = device;
+  compilerWorkers_ = make_unique<JlWorkerPool>(workerCount);
+  compilerLibrary_ = pipelineLibrary;
+  compilerStats_ = {};
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Pipeline compiler created, "
+    << compilerWorkers_->getWorkerCount() << " workers"
+    << (compilerLibrary_ ? ", fast-linking pipeline libraries..." : "...")
+    << endl;
+}
+
+void JlVulkanPipelineCompiler::shutdown() {
+  if (compilerWorkers_ == nullptr) return;
+
+  compilerWorkers_->waitIdle();
+  compilerWorkers_.reset();
+
+  // The GPU timeline is gone by now, nothing left over was ever used.
+  for (const Compiled& result : compiledQueue_)
+    vk_->vkDestroyPipeline(compilerDevice_, result.pipeline, allocator_);
+  compiledQueue_.clear();
+
+  for (auto& [key, entry] : compiledPipelines_)
+    vk_->vkDestroyPipeline(compilerDevice_, entry.pipeline, allocator_);
+  compiledPipelines_.clear();
+
+  // Linked pipelines don't need their libraries anymore.
+  for (auto& [key, library] : libraryParts_)
+    vk_->vkDestroyPipeline(compilerDevice_, library, allocator_);
+  libraryParts_.clear();
+
+  for (auto& [hash, module] : shaderModules_)
+    vk_->vkDestroyShaderModule(compilerDevice_, module, allocator_);
+  shaderModules_.clear();
+
+  compilerDevice_ = VK_NULL_HANDLE;
+}
+
+VkShaderModule JlVulkanPipelineCompiler::loadShader(const vector<char>& code) {
+  uint64_t hash = JlHash::bytes(JlHash::offsetBasis, code.data(), code.size());
+
+  auto found = shaderModules_.find(hash);
+  if (found != shaderModules_.end()) return found->second;
+
+  VkShaderModuleCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  createInfo.codeSize = code.size();
+  createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+  VkShaderModule module = VK_NULL_HANDLE;
+  if (vk_->vkCreateShaderModule(compilerDevice_, &createInfo, allocator_,
+                                &module) != VK_SUCCESS) {
+    cerr << JlEngineReports::jlGraphicsVulkan
+      << "Failed to create shader module." << endl;
+    return VK_NULL_HANDLE;
+  }
+
+  shaderModules_[hash] = module;
+  return module;
+}
+
+JlVulkanPipelineCompiler::Key JlVulkanPipelineCompiler::getKey(
+  const GraphicsState& state) {
+  uint64_t hash = JlHash::offsetBasis;
+  hash = JlHash::value(hash, state.vertexShader);
+  hash = JlHash::value(hash, state.fragmentShader);
+  hash = JlHash::value(hash, state.layout);
+  hash = hashVector(hash, state.vertexBindings);
+  hash = hashVector(hash, state.vertexAttributes);
+  hash = JlHash::value(hash, state.topology);
+  hash = JlHash::value(hash, state.polygonMode);
+  hash = JlHash::value(hash, state.cullMode);
+  hash = JlHash::value(hash, state.frontFace);
+  hash = JlHash::value(hash, state.depthTest);
+  hash = JlHash::value(hash, state.depthWrite);
+  hash = JlHash::value(hash, state.depthCompare);
+  hash = JlHash::value(hash, state.blend);
+  hash = JlHash::value(hash, state.srcColorFactor);
+  hash = JlHash::value(hash, state.dstColorFactor);
+  hash = JlHash::value(hash, state.colorOp);
+  hash = hashVector(hash, state.colorFormats);
+  hash = JlHash::value(hash, state.depthFormat);
+  hash = JlHash::value(hash, state.renderPass);
+
+  // Zero means no fallback.
+  return hash != 0 ? hash : 1;
+}
+
+JlVulkanPipelineCompiler::Key JlVulkanPipelineCompiler::registerFallback(
+  const GraphicsState& state) {
+  Key key = getKey(state);
+  Entry& entry = compiledPipelines_[key];
+  if (entry.status == Ready) return key;
+
+  if (buildPipeline(state, &entry.pipeline) == VK_SUCCESS) {
+    entry.status = Ready;
+    return key;
+  }
+
+  cerr << JlEngineReports::jlGraphicsVulkan
+    << "Failed to create fallback pipeline." << endl;
+  entry.status = Failed;
+  return 0;
+}
+
+VkPipeline JlVulkanPipelineCompiler::getPipeline(const GraphicsState& state,
+                                                 Key fallback) {
+  compilerStats_.requests++;
+
+  Key key = getKey(state);
+  auto found = compiledPipelines_.find(key);
+  if (found != compiledPipelines_.end() && found->second.status == Ready)
+    return found->second.pipeline;
+
+  // Linking parts that are all known is cheap enough to do right here.
+  VkPipeline libraries[LibraryPartCount];
+  if (found == compiledPipelines_.end() && compilerLibrary_ &&
+      findLibraries(state, false, libraries)) {
+    using clock = chrono::steady_clock;
+    clock::time_point start = clock::now();
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if (linkLibraries(state, libraries, false, &pipeline) == VK_SUCCESS) {
+      double linkMs =
+        chrono::duration<double, milli>(clock::now() - start).count();
+      compilerStats_.fastLinks++;
+      compilerStats_.fastLinkMs += linkMs;
+      compilerStats_.maxFastLinkMs =
+        max(compilerStats_.maxFastLinkMs, linkMs);
+
+      Entry& entry = compiledPipelines_[key];
+      entry.status = Ready;
+      entry.pipeline = pipeline;
+      entry.optimized = false;
+
+      compilerStats_.pendingOptimizations++;
+      compilerWorkers_->submit([key, state, libraries](uint32_t) {
+        linkOptimized(key, state, libraries);
+      });
+      return pipeline;
+    }
+  }
+
+  if (found == compiledPipelines_.end()) {
+    compiledPipelines_[key] = Entry();
+    compilerStats_.queued++;
+    compilerStats_.queueDepth++;
+    compilerStats_.maxQueueDepth =
+      max(compilerStats_.maxQueueDepth, compilerStats_.queueDepth);
+
+    // The state is copied, the caller's may be gone by the time a worker
+    // gets to it.
+    compilerWorkers_->submit([key, state](uint32_t) {
+      using clock = chrono::steady_clock;
+      clock::time_point start = clock::now();
+
+      // Missing parts are built and fast-linked first, so the pipeline is
+      // usable before its optimized link is.
+      VkPipeline pipeline = VK_NULL_HANDLE;
+      VkPipeline libraries[LibraryPartCount];
+      VkResult result =
+        !compilerLibrary_ ? buildPipeline(state, &pipeline)
+        : findLibraries(state, true, libraries)
+          ? linkLibraries(state, libraries, false, &pipeline)
+          : VK_ERROR_INITIALIZATION_FAILED;
+      if (result != VK_SUCCESS) pipeline = VK_NULL_HANDLE;
+
+      Compiled compiled{
+        key, pipeline,
+        chrono::duration<double, milli>(clock::now() - start).count(),
+        !compilerLibrary_ };
+      {
+        lock_guard<mutex> lock(compiledMutex_);
+        compiledQueue_.push_back(compiled);
+      }
+
+      if (compilerLibrary_ && pipeline != VK_NULL_HANDLE)
+        linkOptimized(key, state, libraries);
+    });
+  }
+
+  auto fallbackEntry = compiledPipelines_.find(fallback);
+  if (fallback != 0 && fallbackEntry != compiledPipelines_.end() &&
+      fallbackEntry->second.status == Ready) {
+    compilerStats_.fallbackDraws++;
+    frameUsedFallback_ = true;
+    return fallbackEntry->second.pipeline;
+  }
+
+  compilerStats_.skippedDraws++;
+  return VK_NULL_HANDLE;
+}
+
+bool JlVulkanPipelineCompiler::isReady(const GraphicsState& state) {
+  auto found = compiledPipelines_.find(getKey(state));
+  return found != compiledPipelines_.end() && found->second.status == Ready;
+}
+
+bool JlVulkanPipelineCompiler::usesPipelineLibrary() {
+  return compilerLibrary_;
+}
+
+void JlVulkanPipelineCompiler::beginFrame() {
+  compilerStats_.frames++;
+  if (frameUsedFallback_) compilerStats_.fallbackFrames++;
+  frameUsedFallback_ = false;
+
+  collectCompiled();
+}
+
+JlVulkanPipelineCompiler::Stats JlVulkanPipelineCompiler::getStats() {
+  Stats stats = compilerStats_;
+  lock_guard<mutex> lock(libraryMutex_);
+  stats.libraryParts = libraryParts_.size();
+  return stats;
+}
+
+void JlVulkanPipelineCompiler::reportStats() {
+  if (compilerStats_.queued == 0) return;
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Pipeline compiler: "
+    << compilerStats_.compiled << " compiled, " << compilerStats_.failed
+    << " failed, " << compilerStats_.compileMs << " ms on workers (max "
+    << compilerStats_.maxCompileMs << " ms), queue depth max "
+    << compilerStats_.maxQueueDepth << "." << endl;
+  cout << JlEngineReports::jlGraphicsVulkan << "Fallback used in "
+    << compilerStats_.fallbackFrames << " of " << compilerStats_.frames
+    << " frames, " << compilerStats_.fallbackDraws << " fallback draws, "
+    << compilerStats_.skippedDraws << " skipped draws." << endl;
+
+  if (!compilerLibrary_) return;
+
+  Stats stats = getStats();
+  cout << JlEngineReports::jlGraphicsVulkan << "Pipeline libraries: "
+    << stats.libraryParts << " parts, " << stats.fastLinks
+    << " fast links on the render thread, "
+    << (stats.fastLinks > 0 ? stats.fastLinkMs / stats.fastLinks : 0.0)
+    << " ms average (max " << stats.maxFastLinkMs << " ms), "
+    << stats.optimizedLinks << " optimized links, "
+    << stats.optimizedLinkMs << " ms on workers." << endl;
+}
+
+void JlVulkanPipelineCompiler::collectCompiled() {
+  vector<Compiled> compiled;
+  {
+    lock_guard<mutex> lock(compiledMutex_);
+    compiled.swap(compiledQueue_);
+  }
+
+  for (const Compiled& result : compiled) {
+    Entry& entry = compiledPipelines_[result.key];
+
+    if (result.optimized && compilerLibrary_) {
+      compilerStats_.pendingOptimizations--;
+
+      // Registered as a fallback meanwhile, or the link failed.
+      if (result.pipeline == VK_NULL_HANDLE) continue;
+      if (entry.status != Ready || entry.optimized) {
+        vk_->vkDestroyPipeline(compilerDevice_, result.pipeline, allocator_);
+        continue;
+      }
+
+      // Frames in flight may still draw with the fast-linked pipeline.
+      JlVulkanTimeline::destroyPipeline(entry.pipeline);
+      entry.pipeline = result.pipeline;
+      entry.optimized = true;
+      compilerStats_.optimizedLinks++;
+      compilerStats_.optimizedLinkMs += result.compileMs;
+      continue;
+    }
+
+    // The worker goes on to link it optimized.
+    if (!result.optimized && result.pipeline != VK_NULL_HANDLE)
+      compilerStats_.pendingOptimizations++;
+
+    // Registered as a fallback while its compile was queued.
+    if (entry.status == Ready) {
+      vk_->vkDestroyPipeline(compilerDevice_, result.pipeline, allocator_);
+      compilerStats_.queueDepth--;
+      continue;
+    }
+
+    entry.pipeline = result.pipeline;
+    entry.status = result.pipeline != VK_NULL_HANDLE ? Ready : Failed;
+    entry.optimized = result.optimized;
+
+    compilerStats_.queueDepth--;
+    compilerStats_.compileMs += result.compileMs;
+    compilerStats_.maxCompileMs =
+      max(compilerStats_.maxCompileMs, result.compileMs);
+    if (entry.status == Ready)
+      compilerStats_.compiled++;
+    else
+      compilerStats_.failed++;
+  }
+}
+
+VkResult JlVulkanPipelineCompiler::buildPipeline(
+  const GraphicsState& state, VkPipeline* pipeline,
+  VkGraphicsPipelineLibraryFlagsEXT parts) {
+  VkPipelineShaderStageCreateInfo shaderStages[2]{};
+  shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  shaderStages[0].module = state.vertexShader;
+  shaderStages[0].pName = "main";
+  shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  shaderStages[1].module = state.fragmentShader;
+  shaderStages[1].pName = "main";
+
+  VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+  vertexInputInfo.sType =
+    VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertexInputInfo.vertexBindingDescriptionCount =
+    static_cast<uint32_t>(state.vertexBindings.size());
+  vertexInputInfo.pVertexBindingDescriptions = state.vertexBindings.data();
+  vertexInputInfo.vertexAttributeDescriptionCount =
+    static_cast<uint32_t>(state.vertexAttributes.size());
+  vertexInputInfo.pVertexAttributeDescriptions = state.vertexAttributes.data();
+
+  VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+  inputAssembly.sType =
+    VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  inputAssembly.topology = state.topology;
+
+  VkPipelineViewportStateCreateInfo viewportState{};
+  viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewportState.viewportCount = 1;
+  viewportState.scissorCount = 1;
+
+  VkPipelineRasterizationStateCreateInfo rasterizer{};
+  rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  rasterizer.polygonMode = state.polygonMode;
+  rasterizer.lineWidth = 1.0f;
+  rasterizer.cullMode = state.cullMode;
+  rasterizer.frontFace = state.frontFace;
+
+  VkPipelineMultisampleStateCreateInfo multisampling{};
+  multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+  VkPipelineDepthStencilStateCreateInfo depthStencil{};
+  depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  depthStencil.depthTestEnable = state.depthTest;
+  depthStencil.depthWriteEnable = state.depthWrite;
+  depthStencil.depthCompareOp = state.depthCompare;
+
+  VkPipelineColorBlendAttachmentState blendAttachment{};
+  blendAttachment.colorWriteMask =
+    VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+    VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  blendAttachment.blendEnable = state.blend;
+  blendAttachment.srcColorBlendFactor = state.srcColorFactor;
+  blendAttachment.dstColorBlendFactor = state.dstColorFactor;
+  blendAttachment.colorBlendOp = state.colorOp;
+  blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+  blendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+  blendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+  vector<VkPipelineColorBlendAttachmentState> blendAttachments(
+    max<size_t>(state.colorFormats.size(), 1), blendAttachment);
+
+  VkPipelineColorBlendStateCreateInfo colorBlending{};
+  colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  colorBlending.attachmentCount =
+    static_cast<uint32_t>(blendAttachments.size());
+  colorBlending.pAttachments = blendAttachments.data();
+
+  VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT,
+                                     VK_DYNAMIC_STATE_SCISSOR };
+
+  VkPipelineDynamicStateCreateInfo dynamicState{};
+  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = 2;
+  dynamicState.pDynamicStates = dynamicStates;
+
+  VkPipelineRenderingCreateInfo renderingInfo{};
+  renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+  renderingInfo.colorAttachmentCount =
+    static_cast<uint32_t>(state.colorFormats.size());
+  renderingInfo.pColorAttachmentFormats = state.colorFormats.data();
+  renderingInfo.depthAttachmentFormat = state.depthFormat;
+
+  VkGraphicsPipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipelineInfo.pNext =
+    state.renderPass == VK_NULL_HANDLE ? &renderingInfo : nullptr;
+  pipelineInfo.stageCount = 2;
+  pipelineInfo.pStages = shaderStages;
+  pipelineInfo.pVertexInputState = &vertexInputInfo;
+  pipelineInfo.pInputAssemblyState = &inputAssembly;
+  pipelineInfo.pViewportState = &viewportState;
+  pipelineInfo.pRasterizationState = &rasterizer;
+  pipelineInfo.pMultisampleState = &multisampling;
+  pipelineInfo.pDepthStencilState = &depthStencil;
+  pipelineInfo.pColorBlendState = &colorBlending;
+  pipelineInfo.pDynamicState = &dynamicState;
+  pipelineInfo.layout = state.layout;
+  pipelineInfo.renderPass = state.renderPass;
+
+  // A library only gets the state of its own parts, and keeps what the
+  // optimized link needs.
+  VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+  if (parts != 0) {
+    libraryInfo.sType =
+      VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+    libraryInfo.pNext = pipelineInfo.pNext;
+    libraryInfo.flags = parts;
+    pipelineInfo.pNext = &libraryInfo;
+    pipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR |
+      VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+
+    bool vertexInput =
+      parts & VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT;
+    bool preRasterization =
+      parts & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT;
+    bool fragmentShader =
+      parts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT;
+    bool fragmentOutput =
+      parts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT;
+
+    uint32_t firstStage = preRasterization ? 0 : 1;
+    uint32_t endStage = fragmentShader ? 2 : 1;
+    pipelineInfo.stageCount = endStage - firstStage;
+    pipelineInfo.pStages = shaderStages + firstStage;
+
+    if (!vertexInput) {
+      pipelineInfo.pVertexInputState = nullptr;
+      pipelineInfo.pInputAssemblyState = nullptr;
+    }
+    if (!preRasterization) {
+      pipelineInfo.pViewportState = nullptr;
+      pipelineInfo.pRasterizationState = nullptr;
+      pipelineInfo.pDynamicState = nullptr;
+    }
+    if (!fragmentShader) pipelineInfo.pDepthStencilState = nullptr;
+    if (!fragmentOutput) pipelineInfo.pColorBlendState = nullptr;
+    if (!fragmentShader && !fragmentOutput)
+      pipelineInfo.pMultisampleState = nullptr;
+    if (!preRasterization && !fragmentShader)
+      pipelineInfo.layout = VK_NULL_HANDLE;
+  }
+
+  return JlVulkanPipelineCache::createGraphicsPipeline(pipelineInfo, pipeline);
+}
+
+JlVulkanPipelineCompiler::Key JlVulkanPipelineCompiler::getLibraryKey(
+  LibraryPart part, const GraphicsState& state) {
+  uint64_t hash = JlHash::value(JlHash::offsetBasis, part);
+
+  switch (part) {
+    case VertexInputPart:
+      hash = hashVector(hash, state.vertexBindings);
+      hash = hashVector(hash, state.vertexAttributes);
+      hash = JlHash::value(hash, state.topology);
+      break;
+    case PreRasterizationPart:
+      hash = JlHash::value(hash, state.vertexShader);
+      hash = JlHash::value(hash, state.layout);
+      hash = JlHash::value(hash, state.polygonMode);
+      hash = JlHash::value(hash, state.cullMode);
+      hash = JlHash::value(hash, state.frontFace);
+      hash = JlHash::value(hash, state.renderPass);
+      break;
+    case FragmentShaderPart:
+      hash = JlHash::value(hash, state.fragmentShader);
+      hash = JlHash::value(hash, state.layout);
+      hash = JlHash::value(hash, state.depthTest);
+      hash = JlHash::value(hash, state.depthWrite);
+      hash = JlHash::value(hash, state.depthCompare);
+      hash = hashVector(hash, state.colorFormats);
+      hash = JlHash::value(hash, state.depthFormat);
+      hash = JlHash::value(hash, state.renderPass);
+      break;
+    default:
+      hash = JlHash::value(hash, state.blend);
+      hash = JlHash::value(hash, state.srcColorFactor);
+      hash = JlHash::value(hash, state.dstColorFactor);
+      hash = JlHash::value(hash, state.colorOp);
+      hash = hashVector(hash, state.colorFormats);
+      hash = JlHash::value(hash, state.depthFormat);
+      hash = JlHash::value(hash, state.renderPass);
+      break;
+  }
+
+  return hash;
+}
+
+bool JlVulkanPipelineCompiler::findLibraries(
+  const GraphicsState& state, bool build,
+  VkPipeline libraries[LibraryPartCount]) {
+  for (uint32_t i = 0; i < LibraryPartCount; i++) {
+    LibraryPart part = static_cast<LibraryPart>(i);
+    Key key = getLibraryKey(part, state);
+    {
+      lock_guard<mutex> lock(libraryMutex_);
+      auto found = libraryParts_.find(key);
+      if (found != libraryParts_.end()) {
+        libraries[part] = found->second;
+        continue;
+      }
+    }
+    if (!build) return false;
+
+    // Built outside the lock, workers needing other parts carry on.
+    VkPipeline library = VK_NULL_HANDLE;
+    if (buildPipeline(state, &library, libraryPartFlags_[part]) !=
+        VK_SUCCESS) {
+      cerr << JlEngineReports::jlGraphicsVulkan
+        << "Failed to create pipeline library." << endl;
+      return false;
+    }
+
+    // Another worker may have built the same part meanwhile.
+    lock_guard<mutex> lock(libraryMutex_);
+    auto [found, inserted] = libraryParts_.emplace(key, library);
+    if (!inserted) vk_->vkDestroyPipeline(compilerDevice_, library, allocator_);
+    libraries[part] = found->second;
+  }
+
+  return true;
+}
+
+VkResult JlVulkanPipelineCompiler::linkLibraries(
+  const GraphicsState& state, const VkPipeline libraries[LibraryPartCount],
+  bool optimized, VkPipeline* pipeline) {
+  VkPipelineLibraryCreateInfoKHR linkInfo{};
+  linkInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+  linkInfo.libraryCount = LibraryPartCount;
+  linkInfo.pLibraries = libraries;
+
+  VkGraphicsPipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipelineInfo.pNext = &linkInfo;
+  pipelineInfo.flags =
+    optimized ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+  pipelineInfo.layout = state.layout;
+
+  return JlVulkanPipelineCache::createGraphicsPipeline(pipelineInfo, pipeline);
+}
+
+void JlVulkanPipelineCompiler::linkOptimized(
+  Key key, const GraphicsState& state,
+  const VkPipeline libraries[LibraryPartCount]) {
+  using clock = chrono::steady_clock;
+  clock::time_point start = clock::now();
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  if (linkLibraries(state, libraries, true, &pipeline) != VK_SUCCESS)
+    pipeline = VK_NULL_HANDLE;
+
+  Compiled compiled{
+    key, pipeline,
+    chrono::duration<double, milli>(clock::now() - start).count(), true };
+  lock_guard<mutex> lock(compiledMutex_);
+  compiledQueue_.push_back(compiled);
+}
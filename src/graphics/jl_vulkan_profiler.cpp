@@ -0,0 +1,476 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#include "graphics/jl_vulkan_profiler.h"
+#include "graphics/jl_vulkan_dispatch.h"
+#include "graphics/jl_vulkan_memory.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "defines.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+using namespace std;
+using namespace filesystem;
+
+const VkAllocationCallbacks* const allocator_ =
+  JlVulkanMemory::getAllocationCallbacks();
+const JlVulkanDispatch* const vk_ = &JlVulkanDispatch::get();
+
+const uint32_t queriesPerFrame_ = 256;
+const uint32_t historySize_ = 256;
+const size_t maxTraceEvents_ = 1 << 20;
+const uint32_t calibrationInterval_ = 120;
+const uint32_t calibrationAttempts_ = 3;
+// Samples whose device and host reads lie further apart are dropped.
+const double maxCalibrationDeviationUs_ = 50.0;
+const uint32_t cpuThread_ = 0;
+const uint32_t gpuThread_ = 1;
+
+VkDevice profilerDevice_ = VK_NULL_HANDLE;
+vector<JlVulkanProfiler::FrameQueries> profilerFrames_;
+uint32_t profilerFrameIndex_ = 0;
+bool profilerRecording_ = false;
+
+double timestampPeriod_ = 1.0;
+uint64_t timestampMask_ = UINT64_MAX;
+
+vector<string> scopeNames_;
+unordered_map<string, uint32_t> scopeIds_;
+vector<JlVulkanProfiler::History> scopeHistory_;
+
+bool tracing_ = false;
+vector<JlVulkanProfiler::TraceEvent> traceEvents_;
+
+chrono::steady_clock::time_point profilerEpoch_;
+PFN_vkGetCalibratedTimestampsEXT getCalibratedTimestamps_ = nullptr;
+VkTimeDomainEXT hostTimeDomain_ = VK_TIME_DOMAIN_DEVICE_EXT;
+uint32_t framesSinceCalibration_ = 0;
+uint32_t calibrationSamples_ = 0;
+uint32_t calibrationRejects_ = 0;
+double gpuToCpuUs_ = 0.0;
+bool gpuToCpuValid_ = false;
+
+// The host domain calibrated against, the one the OS timer reads.
+static VkTimeDomainEXT findHostTimeDomain(VkPhysicalDevice physicalDevice) {
+  if (vk_->vkGetPhysicalDeviceCalibrateableTimeDomainsEXT == nullptr)
+    return VK_TIME_DOMAIN_DEVICE_EXT;
+
+  uint32_t domainCount = 0;
+  vk_->vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(physicalDevice,
+                                                      &domainCount, nullptr);
+  vector<VkTimeDomainEXT> domains(domainCount);
+  vk_->vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(
+    physicalDevice, &domainCount, domains.data());
+
+  auto has = [&](VkTimeDomainEXT domain) {
+    return find(domains.begin(), domains.end(), domain) != domains.end();
+  };
+  if (!has(VK_TIME_DOMAIN_DEVICE_EXT)) return VK_TIME_DOMAIN_DEVICE_EXT;
+
+#ifdef _WIN32
+  if (has(VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT))
+    return VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#else
+  // Raw isn't slewed by NTP, so it drifts less between calibrations.
+  if (has(VK_TIME_DOMAIN_CLOCK_MONOTONIC_RAW_EXT))
+    return VK_TIME_DOMAIN_CLOCK_MONOTONIC_RAW_EXT;
+  if (has(VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT))
+    return VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#endif
+  return VK_TIME_DOMAIN_DEVICE_EXT;
+}
+
+// Host domain ticks to microseconds, QPC counts on Windows, nanoseconds
+// elsewhere.
+static double hostTicksToUs(uint64_t ticks) {
+#ifdef _WIN32
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+  return ticks * 1000000.0 / frequency.QuadPart;
+#else
+  return ticks / 1000.0;
+#endif
+}
+
+static uint64_t readHostTicks() {
+#ifdef _WIN32
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return counter.QuadPart;
+#else
+  timespec now;
+  clock_gettime(hostTimeDomain_ == VK_TIME_DOMAIN_CLOCK_MONOTONIC_RAW_EXT
+                  ? CLOCK_MONOTONIC_RAW
+                  : CLOCK_MONOTONIC,
+                &now);
+  return now.tv_sec * 1000000000ull + now.tv_nsec;
+#endif
+}
+
+static uint32_t getScopeId(const string& name) {
+  auto found = scopeIds_.find(name);
+  if (found != scopeIds_.end()) return found->second;
+
+  uint32_t id = static_cast<uint32_t>(scopeNames_.size());
+  scopeNames_.push_back(name);
+  scopeIds_.emplace(name, id);
+
+  JlVulkanProfiler::History history;
+  history.name = name;
+  scopeHistory_.push_back(history);
+  return id;
+}
+
+bool JlVulkanProfiler::init(VkPhysicalDevice physicalDevice, VkDevice device,
+                            uint32_t queueFamily, uint32_t framesInFlight,
+                            bool calibratedTimestamps) {
+  profilerDevice_ = device;
+  profilerEpoch_ = chrono::steady_clock::now();
+
+  uint32_t queueFamilyCount = 0;
+  vk_->vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice,
+                                                &queueFamilyCount, nullptr);
+  vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vk_->vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice,
+                                                &queueFamilyCount,
+                                                queueFamilies.data());
+
+  uint32_t validBits = queueFamilies[queueFamily].timestampValidBits;
+  if (validBits == 0) {
+    cout << JlEngineReports::jlGraphicsVulkan
+      << "Timestamps unsupported on the graphics queue, GPU profiling off..."
+      << endl;
+    return true;
+  }
+  timestampMask_ = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+
+  VkPhysicalDeviceProperties properties;
+  vk_->vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  timestampPeriod_ = properties.limits.timestampPeriod;
+
+  // One pool more than frames in flight, so a pool is only read after its
+  // frame's fence has already been waited on.
+  profilerFrames_.resize(framesInFlight + 1);
+  profilerFrameIndex_ = 0;
+
+  VkQueryPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  poolInfo.queryCount = queriesPerFrame_;
+
+  try {
+    for (FrameQueries& frame : profilerFrames_)
+      if (vk_->vkCreateQueryPool(device, &poolInfo, allocator_, &frame.pool) !=
+          VK_SUCCESS)
+        throw runtime_error("Failed to create timestamp query pool.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    shutdown();
+    return false;
+  }
+
+  if (calibratedTimestamps)
+    hostTimeDomain_ = findHostTimeDomain(physicalDevice);
+  if (hostTimeDomain_ != VK_TIME_DOMAIN_DEVICE_EXT) {
+    getCalibratedTimestamps_ = vk_->vkGetCalibratedTimestampsEXT;
+    calibrate();
+  }
+
+  cout << JlEngineReports::jlGraphicsVulkan << "GPU profiler created, "
+    << profilerFrames_.size() << " query pools, "
+    << (getCalibratedTimestamps_ != nullptr ? "calibrated" : "estimated")
+    << " CPU alignment..." << endl;
+  return true;
+}
+
+void JlVulkanProfiler::shutdown() {
+  // The device is idle by now, so whatever is still pending is available.
+  for (FrameQueries& frame : profilerFrames_) {
+    if (frame.pending) resolve(frame);
+    if (frame.pool != VK_NULL_HANDLE)
+      vk_->vkDestroyQueryPool(profilerDevice_, frame.pool, allocator_);
+  }
+  profilerFrames_.clear();
+  profilerRecording_ = false;
+  getCalibratedTimestamps_ = nullptr;
+  hostTimeDomain_ = VK_TIME_DOMAIN_DEVICE_EXT;
+  gpuToCpuValid_ = false;
+}
+
+bool JlVulkanProfiler::isEnabled() { return !profilerFrames_.empty(); }
+
+void JlVulkanProfiler::beginFrame(VkCommandBuffer commandBuffer) {
+  if (profilerFrames_.empty()) return;
+
+  FrameQueries& frame = profilerFrames_[profilerFrameIndex_];
+  if (frame.pending) resolve(frame);
+
+  frame.scopes.clear();
+  frame.queryCount = 0;
+  frame.cpuBeginUs = nowUs();
+
+  vk_->vkCmdResetQueryPool(commandBuffer, frame.pool, 0, queriesPerFrame_);
+  profilerRecording_ = true;
+
+  // GPU and CPU clocks drift apart, so the offset is refreshed now and then.
+  if (getCalibratedTimestamps_ != nullptr &&
+      ++framesSinceCalibration_ >= calibrationInterval_)
+    calibrate();
+}
+
+void JlVulkanProfiler::endFrame() {
+  if (!profilerRecording_) return;
+
+  FrameQueries& frame = profilerFrames_[profilerFrameIndex_];
+  frame.cpuSubmitUs = nowUs();
+  frame.pending = true;
+
+  if (tracing_ && traceEvents_.size() < maxTraceEvents_)
+    traceEvents_.push_back({ getScopeId("frame (cpu)"), frame.cpuBeginUs,
+                             frame.cpuSubmitUs - frame.cpuBeginUs,
+                             cpuThread_ });
+
+  profilerFrameIndex_ =
+    (profilerFrameIndex_ + 1) % static_cast<uint32_t>(profilerFrames_.size());
+  profilerRecording_ = false;
+}
+
+uint32_t JlVulkanProfiler::beginScope(VkCommandBuffer commandBuffer,
+                                      const string& name) {
+  if (!profilerRecording_) return UINT32_MAX;
+
+  FrameQueries& frame = profilerFrames_[profilerFrameIndex_];
+  if (frame.queryCount + 2 > queriesPerFrame_) return UINT32_MAX;
+
+  ScopeRecord scope{ getScopeId(name), frame.queryCount,
+                     frame.queryCount + 1 };
+  frame.queryCount += 2;
+  frame.scopes.push_back(scope);
+
+  vk_->vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                           frame.pool, scope.beginQuery);
+  return static_cast<uint32_t>(frame.scopes.size() - 1);
+}
+
+void JlVulkanProfiler::endScope(VkCommandBuffer commandBuffer,
+                                uint32_t scope) {
+  if (!profilerRecording_ || scope == UINT32_MAX) return;
+
+  FrameQueries& frame = profilerFrames_[profilerFrameIndex_];
+  vk_->vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                           frame.pool, frame.scopes[scope].endQuery);
+}
+
+JlVulkanProfiler::Scope::Scope(VkCommandBuffer commandBuffer,
+                               const string& name)
+  : commandBuffer_(commandBuffer),
+    scope_(beginScope(commandBuffer, name)) {}
+
+JlVulkanProfiler::Scope::~Scope() { endScope(commandBuffer_, scope_); }
+
+bool JlVulkanProfiler::getTimings(const string& name, Timings& timings) {
+  auto found = scopeIds_.find(name);
+  if (found == scopeIds_.end()) return false;
+
+  vector<double> samples = scopeHistory_[found->second].samples;
+  if (samples.empty()) return false;
+
+  timings.samples = static_cast<uint32_t>(samples.size());
+
+  double total = 0.0;
+  for (double sample : samples) total += sample;
+  timings.averageMs = total / samples.size();
+
+  auto percentile = [&](double p) {
+    size_t index = min(samples.size() - 1,
+                       static_cast<size_t>(p * samples.size()));
+    nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+  };
+  timings.p50Ms = percentile(0.50);
+  timings.p95Ms = percentile(0.95);
+  timings.p99Ms = percentile(0.99);
+  return true;
+}
+
+void JlVulkanProfiler::reportStats() {
+  for (const History& history : scopeHistory_) {
+    Timings timings;
+    if (!getTimings(history.name, timings)) continue;
+
+    cout << JlEngineReports::jlGraphicsVulkan << "GPU " << history.name
+      << ": " << timings.averageMs << " ms avg / " << timings.p50Ms
+      << " p50 / " << timings.p95Ms << " p95 / " << timings.p99Ms
+      << " p99 over " << timings.samples << " frames." << endl;
+  }
+
+  if (calibrationSamples_ > 0)
+    cout << JlEngineReports::jlGraphicsVulkan << "GPU clock calibrated "
+      << calibrationSamples_ << " times, " << calibrationRejects_
+      << " rejected for a deviation over " << maxCalibrationDeviationUs_
+      << " us." << endl;
+}
+
+bool JlVulkanProfiler::exportTrace(const path& file) {
+  try {
+    ofstream out(file, ios::trunc);
+    if (!out.is_open())
+      throw runtime_error("Failed to open \"" + file.string() + "\".");
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":"
+      << cpuThread_ << ",\"args\":{\"name\":\"CPU\"}},\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":"
+      << gpuThread_ << ",\"args\":{\"name\":\"GPU\"}}";
+
+    out.setf(ios::fixed);
+    out.precision(3);
+    for (const TraceEvent& event : traceEvents_) {
+      string name;
+      for (char c : scopeNames_[event.name]) {
+        if (c == '"' || c == '\\') name += '\\';
+        name += c;
+      }
+
+      out << ",\n{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":"
+        << event.thread << ",\"ts\":" << event.startUs
+        << ",\"dur\":" << event.durationUs << "}";
+    }
+    out << "\n]}\n";
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return false;
+  }
+
+  cout << JlEngineReports::jlGraphicsVulkan << "GPU trace with "
+    << traceEvents_.size() << " events written to " << file.string() << "."
+    << endl;
+  return true;
+}
+
+void JlVulkanProfiler::setTracing(bool enabled) {
+  tracing_ = enabled;
+  if (enabled) traceEvents_.reserve(4096);
+}
+
+void JlVulkanProfiler::resolve(FrameQueries& frame) {
+  frame.pending = false;
+  if (frame.queryCount == 0) return;
+
+  // Value and availability pairs, nothing here ever waits on the GPU.
+  vector<uint64_t> results(frame.queryCount * 2);
+  vk_->vkGetQueryPoolResults(profilerDevice_, frame.pool, 0, frame.queryCount,
+                             results.size() * sizeof(uint64_t), results.data(),
+                             2 * sizeof(uint64_t),
+                             VK_QUERY_RESULT_64_BIT |
+                               VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+  // Without calibration the GPU is assumed to start the frame as soon as
+  // it's submitted, which is fixed once so the timelines stay consistent.
+  if (!gpuToCpuValid_ && results[1] != 0) {
+    gpuToCpuUs_ = frame.cpuSubmitUs - results[0] * timestampPeriod_ / 1000.0;
+    gpuToCpuValid_ = true;
+  }
+
+  for (const ScopeRecord& scope : frame.scopes) {
+    const uint64_t* begin = &results[scope.beginQuery * 2];
+    const uint64_t* end = &results[scope.endQuery * 2];
+    if (begin[1] == 0 || end[1] == 0) continue;
+
+    uint64_t ticks = (end[0] - begin[0]) & timestampMask_;
+    double durationMs = ticks * timestampPeriod_ / 1000000.0;
+
+    History& history = scopeHistory_[scope.name];
+    if (history.samples.size() < historySize_)
+      history.samples.push_back(durationMs);
+    else
+      history.samples[history.next] = durationMs;
+    history.next = (history.next + 1) % historySize_;
+
+    if (tracing_ && traceEvents_.size() < maxTraceEvents_)
+      traceEvents_.push_back(
+        { scope.name, begin[0] * timestampPeriod_ / 1000.0 + gpuToCpuUs_,
+          durationMs * 1000.0, gpuThread_ });
+  }
+}
+
+void JlVulkanProfiler::calibrate() {
+  framesSinceCalibration_ = 0;
+  if (getCalibratedTimestamps_ == nullptr) return;
+
+  // Device and host read in one call, the driver bounds how far apart.
+  VkCalibratedTimestampInfoEXT timestampInfos[2]{};
+  timestampInfos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+  timestampInfos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+  timestampInfos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+  timestampInfos[1].timeDomain = hostTimeDomain_;
+
+  // A read preempted halfway shows up as a large deviation, the tightest
+  // of a few is kept.
+  uint64_t timestamps[2] = {};
+  uint64_t deviation = UINT64_MAX;
+  for (uint32_t i = 0; i < calibrationAttempts_; i++) {
+    uint64_t sample[2] = {};
+    uint64_t sampleDeviation = 0;
+    if (getCalibratedTimestamps_(profilerDevice_, 2, timestampInfos, sample,
+                                 &sampleDeviation) != VK_SUCCESS) {
+      getCalibratedTimestamps_ = nullptr;
+      return;
+    }
+
+    if (sampleDeviation < deviation) {
+      deviation = sampleDeviation;
+      timestamps[0] = sample[0];
+      timestamps[1] = sample[1];
+    }
+  }
+
+  calibrationSamples_++;
+  if (deviation / 1000.0 > maxCalibrationDeviationUs_) {
+    calibrationRejects_++;
+    return;
+  }
+
+  // The trace runs on steady_clock, which needn't be the host domain.
+  // Reading both back to back maps one onto the other.
+  double before = nowUs();
+  double hostUs = hostTicksToUs(readHostTicks());
+  double after = nowUs();
+  double hostToTraceUs = (before + after) / 2.0 - hostUs;
+
+  gpuToCpuUs_ = hostTicksToUs(timestamps[1]) + hostToTraceUs -
+                timestamps[0] * timestampPeriod_ / 1000.0;
+  gpuToCpuValid_ = true;
+}
+
+double JlVulkanProfiler::nowUs() {
+  return chrono::duration<double, micro>(chrono::steady_clock::now() -
+                                         profilerEpoch_)
+    .count();
+}
@@ -0,0 +1,441 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#include "graphics/jl_vulkan_queue_scheduler.h"
+#include "graphics/jl_vulkan_dispatch.h"
+#include "graphics/jl_vulkan_memory.h"
+#include "graphics/jl_vulkan_render_graph.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "defines.h"
+
+using namespace std;
+
+const VkAllocationCallbacks* const allocator_ =
+  JlVulkanMemory::getAllocationCallbacks();
+const JlVulkanDispatch* const vk_ = &JlVulkanDispatch::get();
+
+// Two timestamps per batch, per queue and frame.
+const uint32_t schedulerQueryCount_ = 64;
+
+enum SchedulerQueue
+{
+  GraphicsIndex,
+  ComputeIndex
+};
+
+VkDevice schedulerDevice_ = VK_NULL_HANDLE;
+bool schedulerSync2_ = false;
+VkQueue schedulerQueues_[2] = {};
+uint32_t schedulerFamilies_[2] = { VK_QUEUE_FAMILY_IGNORED,
+                                   VK_QUEUE_FAMILY_IGNORED };
+VkSemaphore queueTimelines_[2] = {};
+uint64_t queueTimelineValues_[2] = {};
+double schedulerTimestampPeriod_ = 1.0;
+uint64_t timestampMasks_[2] = { UINT64_MAX, UINT64_MAX };
+
+vector<JlVulkanQueueScheduler::QueueFrame> queueFrames_;
+JlVulkanQueueScheduler::Stats schedulerStats_;
+
+// Reused between frames so submit() doesn't allocate.
+vector<uint64_t> batchValues_;
+vector<VkSemaphoreSubmitInfo> batchWaits_;
+vector<VkSemaphoreSubmitInfo> batchSignals_;
+
+static VkSemaphoreSubmitInfo getSemaphoreInfo(VkSemaphore semaphore,
+                                              uint64_t value,
+                                              VkPipelineStageFlags2 stages) {
+  VkSemaphoreSubmitInfo info{};
+  info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+  info.semaphore = semaphore;
+  info.value = value;
+  info.stageMask = stages;
+  return info;
+}
+
+bool JlVulkanQueueScheduler::init(VkPhysicalDevice physicalDevice,
+                                  VkDevice device, uint32_t graphicsFamily,
+                                  VkQueue graphicsQueue,
+                                  uint32_t computeFamily,
+                                  VkQueue computeQueue,
+                                  uint32_t framesInFlight,
+                                  bool synchronization2) {
+  schedulerDevice_ = device;
+  schedulerSync2_ = synchronization2;
+  schedulerQueues_[GraphicsIndex] = graphicsQueue;
+  schedulerQueues_[ComputeIndex] = computeQueue;
+  schedulerFamilies_[GraphicsIndex] = graphicsFamily;
+  schedulerFamilies_[ComputeIndex] = computeFamily;
+  schedulerStats_ = {};
+
+  VkPhysicalDeviceProperties properties;
+  vk_->vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  schedulerTimestampPeriod_ = properties.limits.timestampPeriod;
+
+  uint32_t familyCount = 0;
+  vk_->vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount,
+                                                nullptr);
+  vector<VkQueueFamilyProperties> families(familyCount);
+  vk_->vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount,
+                                                families.data());
+
+  VkSemaphoreTypeCreateInfo timelineInfo{};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  timelineInfo.initialValue = 0;
+
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreInfo.pNext = &timelineInfo;
+
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+  VkQueryPoolCreateInfo queryInfo{};
+  queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  queryInfo.queryCount = schedulerQueryCount_;
+
+  queueFrames_.resize(framesInFlight);
+
+  try {
+    for (uint32_t queue = 0; queue < 2; queue++) {
+      queueTimelineValues_[queue] = 0;
+      if (vk_->vkCreateSemaphore(device, &semaphoreInfo, allocator_,
+                                 &queueTimelines_[queue]) != VK_SUCCESS)
+        throw runtime_error("Failed to create queue timeline semaphore.");
+
+      poolInfo.queueFamilyIndex = schedulerFamilies_[queue];
+      uint32_t validBits =
+        families[schedulerFamilies_[queue]].timestampValidBits;
+      bool timestamps = validBits > 0;
+      timestampMasks_[queue] =
+        validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+
+      for (QueueFrame& frame : queueFrames_) {
+        if (vk_->vkCreateCommandPool(device, &poolInfo, allocator_,
+                                     &frame.commandPools[queue]) != VK_SUCCESS)
+          throw runtime_error("Failed to create queue command pool.");
+
+        if (timestamps &&
+            vk_->vkCreateQueryPool(device, &queryInfo, allocator_,
+                                   &frame.queryPools[queue]) != VK_SUCCESS)
+          throw runtime_error("Failed to create queue query pool.");
+      }
+    }
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    shutdown();
+    return false;
+  }
+
+  cout << JlEngineReports::jlGraphicsVulkan
+    << "Queue scheduler created, async compute on family " << computeFamily
+    << "..." << endl;
+  return true;
+}
+
+void JlVulkanQueueScheduler::shutdown() {
+  if (schedulerDevice_ == VK_NULL_HANDLE) return;
+
+  for (QueueFrame& frame : queueFrames_)
+    for (uint32_t queue = 0; queue < 2; queue++) {
+      vk_->vkDestroyCommandPool(schedulerDevice_, frame.commandPools[queue],
+                                allocator_);
+      vk_->vkDestroyQueryPool(schedulerDevice_, frame.queryPools[queue],
+                              allocator_);
+    }
+  queueFrames_.clear();
+
+  for (VkSemaphore& semaphore : queueTimelines_) {
+    vk_->vkDestroySemaphore(schedulerDevice_, semaphore, allocator_);
+    semaphore = VK_NULL_HANDLE;
+  }
+
+  schedulerFamilies_[ComputeIndex] = VK_QUEUE_FAMILY_IGNORED;
+  schedulerDevice_ = VK_NULL_HANDLE;
+}
+
+bool JlVulkanQueueScheduler::isEnabled() {
+  return !queueFrames_.empty();
+}
+
+uint32_t JlVulkanQueueScheduler::getComputeFamily() {
+  return isEnabled() ? schedulerFamilies_[ComputeIndex]
+                     : VK_QUEUE_FAMILY_IGNORED;
+}
+
+void JlVulkanQueueScheduler::beginFrame(uint32_t frameIndex) {
+  if (!isEnabled()) return;
+  QueueFrame& frame = queueFrames_[frameIndex];
+
+  // The frame's last graphics batch waits on its last compute batch, this
+  // only matters when a graph left some compute work unconsumed.
+  if (frame.computeValue > 0) {
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &queueTimelines_[ComputeIndex];
+    waitInfo.pValues = &frame.computeValue;
+    vk_->vkWaitSemaphores(schedulerDevice_, &waitInfo, UINT64_MAX);
+  }
+
+  if (frame.pending) resolve(frame);
+
+  for (uint32_t queue = 0; queue < 2; queue++) {
+    if (frame.usedCommandBuffers[queue] > 0)
+      vk_->vkResetCommandPool(schedulerDevice_, frame.commandPools[queue], 0);
+    frame.usedCommandBuffers[queue] = 0;
+    frame.queryCounts[queue] = 0;
+  }
+}
+
+VkResult JlVulkanQueueScheduler::submit(JlVulkanRenderGraph& graph,
+                                        uint32_t frameIndex,
+                                        FrameSubmit& frameSubmit) {
+  const vector<JlVulkanRenderGraph::Batch>& batches = graph.getBatches();
+  QueueFrame& frame = queueFrames_[frameIndex];
+  batchValues_.assign(batches.size(), 0);
+  bool primaryUsed = false;
+  bool queueWaited[2] = {};
+  frameSubmit.waitsSubmitted = false;
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  for (uint32_t i = 0; i < batches.size(); i++) {
+    const JlVulkanRenderGraph::Batch& batch = batches[i];
+    uint32_t queue = batch.queue == JlVulkanRenderGraph::ComputeQueue
+                       ? ComputeIndex
+                       : GraphicsIndex;
+
+    VkCommandBuffer commandBuffer = frameSubmit.commandBuffer;
+    if (queue == ComputeIndex || primaryUsed) {
+      commandBuffer = nextCommandBuffer(frame, queue);
+      if (commandBuffer == VK_NULL_HANDLE) return VK_ERROR_OUT_OF_HOST_MEMORY;
+      vk_->vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    }
+    else {
+      primaryUsed = true;
+    }
+
+    VkQueryPool queries = frame.queryPools[queue];
+    uint32_t query = frame.queryCounts[queue];
+    if (query + 2 > schedulerQueryCount_) queries = VK_NULL_HANDLE;
+
+    if (queries != VK_NULL_HANDLE) {
+      if (query == 0)
+        vk_->vkCmdResetQueryPool(commandBuffer, queries, 0,
+                                 schedulerQueryCount_);
+      vk_->vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                               queries, query);
+    }
+
+    graph.executeBatch(i, commandBuffer);
+
+    if (queries != VK_NULL_HANDLE) {
+      vk_->vkCmdWriteTimestamp(commandBuffer,
+                               VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queries,
+                               query + 1);
+      frame.queryCounts[queue] += 2;
+    }
+    vk_->vkEndCommandBuffer(commandBuffer);
+
+    batchWaits_.clear();
+    batchSignals_.clear();
+
+    // Whichever batch comes first overall, nothing on either queue may run
+    // ahead of the frame's waits. A binary semaphore can only be waited on
+    // once, that's the image acquire, which only graphics batches touch.
+    if (!queueWaited[queue]) {
+      queueWaited[queue] = true;
+      for (VkSemaphoreSubmitInfo wait : frameSubmit.waits) {
+        if (queue == ComputeIndex) {
+          if (wait.value == 0) continue;
+          // Stages of the graphics pipeline don't exist on this queue.
+          wait.stageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+        }
+        batchWaits_.push_back(wait);
+      }
+    }
+
+    if (batch.waitBatch != UINT32_MAX)
+      batchWaits_.push_back(
+        getSemaphoreInfo(queueTimelines_[1 - queue],
+                         batchValues_[batch.waitBatch], batch.waitStages));
+
+    // Compute batches always signal, beginFrame() may have to wait on them.
+    if (batch.signals || queue == ComputeIndex) {
+      uint64_t value = ++queueTimelineValues_[queue];
+      batchValues_[i] = value;
+      batchSignals_.push_back(
+        getSemaphoreInfo(queueTimelines_[queue], value,
+                         VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
+      if (queue == ComputeIndex) frame.computeValue = value;
+    }
+
+    bool last = i + 1 == batches.size();
+    if (last)
+      batchSignals_.insert(batchSignals_.end(), frameSubmit.signals.begin(),
+                           frameSubmit.signals.end());
+
+    VkResult result = submitBatch(queue, commandBuffer,
+                                  last ? frameSubmit.fence : VK_NULL_HANDLE);
+    if (result != VK_SUCCESS) return result;
+    if (queue == GraphicsIndex) frameSubmit.waitsSubmitted = true;
+  }
+
+  frame.pending = true;
+  return VK_SUCCESS;
+}
+
+JlVulkanQueueScheduler::Stats JlVulkanQueueScheduler::getStats() {
+  return schedulerStats_;
+}
+
+void JlVulkanQueueScheduler::resetStats() {
+  schedulerStats_ = {};
+}
+
+void JlVulkanQueueScheduler::reportStats() {
+  if (schedulerStats_.frames == 0) return;
+
+  double frames = static_cast<double>(schedulerStats_.frames);
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Queue busy time over "
+    << schedulerStats_.frames << " frames: graphics "
+    << schedulerStats_.graphicsMs / frames << " ms, compute "
+    << schedulerStats_.computeMs / frames << " ms." << endl;
+}
+
+VkCommandBuffer JlVulkanQueueScheduler::nextCommandBuffer(QueueFrame& frame,
+                                                          uint32_t queue) {
+  vector<VkCommandBuffer>& commandBuffers = frame.commandBuffers[queue];
+  uint32_t& used = frame.usedCommandBuffers[queue];
+
+  if (used == commandBuffers.size()) {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = frame.commandPools[queue];
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    if (vk_->vkAllocateCommandBuffers(schedulerDevice_, &allocInfo,
+                                      &commandBuffer) != VK_SUCCESS) {
+      cerr << JlEngineReports::jlGraphicsVulkan
+        << "Failed to allocate queue batch command buffer." << endl;
+      return VK_NULL_HANDLE;
+    }
+    commandBuffers.push_back(commandBuffer);
+  }
+
+  return commandBuffers[used++];
+}
+
+VkResult JlVulkanQueueScheduler::submitBatch(uint32_t queue,
+                                             VkCommandBuffer commandBuffer,
+                                             VkFence fence) {
+  if (schedulerSync2_) {
+    VkCommandBufferSubmitInfo commandBufferInfo{};
+    commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+    commandBufferInfo.commandBuffer = commandBuffer;
+
+    VkSubmitInfo2 submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+    submitInfo.waitSemaphoreInfoCount =
+      static_cast<uint32_t>(batchWaits_.size());
+    submitInfo.pWaitSemaphoreInfos = batchWaits_.data();
+    submitInfo.commandBufferInfoCount = 1;
+    submitInfo.pCommandBufferInfos = &commandBufferInfo;
+    submitInfo.signalSemaphoreInfoCount =
+      static_cast<uint32_t>(batchSignals_.size());
+    submitInfo.pSignalSemaphoreInfos = batchSignals_.data();
+
+    return vk_->vkQueueSubmit2(schedulerQueues_[queue], 1, &submitInfo, fence);
+  }
+
+  // The graph only uses stages that exist in the original flags, and a
+  // wait without any stage still has to name one.
+  vector<VkSemaphore> waitSemaphores;
+  vector<uint64_t> waitValues;
+  vector<VkPipelineStageFlags> waitStages;
+  for (const VkSemaphoreSubmitInfo& wait : batchWaits_) {
+    waitSemaphores.push_back(wait.semaphore);
+    waitValues.push_back(wait.value);
+    waitStages.push_back(wait.stageMask != VK_PIPELINE_STAGE_2_NONE
+                           ? static_cast<VkPipelineStageFlags>(wait.stageMask)
+                           : static_cast<VkPipelineStageFlags>(
+                               VK_PIPELINE_STAGE_ALL_COMMANDS_BIT));
+  }
+
+  vector<VkSemaphore> signalSemaphores;
+  vector<uint64_t> signalValues;
+  for (const VkSemaphoreSubmitInfo& signal : batchSignals_) {
+    signalSemaphores.push_back(signal.semaphore);
+    signalValues.push_back(signal.value);
+  }
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo{};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.waitSemaphoreValueCount =
+    static_cast<uint32_t>(waitValues.size());
+  timelineInfo.pWaitSemaphoreValues = waitValues.data();
+  timelineInfo.signalSemaphoreValueCount =
+    static_cast<uint32_t>(signalValues.size());
+  timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.pNext = &timelineInfo;
+  submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+  submitInfo.pWaitSemaphores = waitSemaphores.data();
+  submitInfo.pWaitDstStageMask = waitStages.data();
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+  submitInfo.signalSemaphoreCount =
+    static_cast<uint32_t>(signalSemaphores.size());
+  submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+  return vk_->vkQueueSubmit(schedulerQueues_[queue], 1, &submitInfo, fence);
+}
+
+void JlVulkanQueueScheduler::resolve(QueueFrame& frame) {
+  frame.pending = false;
+
+  // Timestamps are only comparable within one queue, so each queue's busy
+  // time is summed on its own and never laid against the other's.
+  double busyMs[2] = {};
+
+  for (uint32_t queue = 0; queue < 2; queue++) {
+    uint32_t count = frame.queryCounts[queue];
+    if (count == 0) continue;
+
+    vector<uint64_t> timestamps(count);
+    if (vk_->vkGetQueryPoolResults(schedulerDevice_, frame.queryPools[queue], 0,
+                                   count, count * sizeof(uint64_t),
+                                   timestamps.data(), sizeof(uint64_t),
+                                   VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+      return;
+
+    for (uint32_t i = 0; i + 1 < count; i += 2) {
+      uint64_t ticks =
+        (timestamps[i + 1] - timestamps[i]) & timestampMasks_[queue];
+      busyMs[queue] += ticks * schedulerTimestampPeriod_ / 1000000.0;
+    }
+  }
+
+  schedulerStats_.frames++;
+  schedulerStats_.graphicsMs += busyMs[GraphicsIndex];
+  schedulerStats_.computeMs += busyMs[ComputeIndex];
+}
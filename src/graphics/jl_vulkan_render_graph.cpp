@@ -0,0 +1,971 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#include "graphics/jl_vulkan_render_graph.h"
+#include "graphics/jl_vulkan_dispatch.h"
+#include "graphics/jl_vulkan_memory.h"
+#include "graphics/jl_vulkan_profiler.h"
+#include "graphics/jl_vulkan_timeline.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "defines.h"
+
+using namespace std;
+
+const VkAllocationCallbacks* const allocator_ =
+  JlVulkanMemory::getAllocationCallbacks();
+const JlVulkanDispatch* const vk_ = &JlVulkanDispatch::get();
+
+static const char* getLayoutName(VkImageLayout layout) {
+  switch (layout) {
+    case VK_IMAGE_LAYOUT_UNDEFINED: return "undefined";
+    case VK_IMAGE_LAYOUT_GENERAL: return "general";
+    case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: return "color";
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL: return "depth";
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL: return "depth-read";
+    case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL: return "shader-read";
+    case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL: return "transfer-src";
+    case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL: return "transfer-dst";
+    case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR: return "present";
+    default: return "other";
+  }
+}
+
+JlVulkanRenderGraph::JlVulkanRenderGraph(VkDevice device,
+                                         bool synchronization2)
+  : device_(device), synchronization2_(synchronization2) {}
+
+JlVulkanRenderGraph::~JlVulkanRenderGraph() { reset(); }
+
+JlVulkanRenderGraph::ResourceHandle JlVulkanRenderGraph::createImage(
+  const string& name, const ImageDesc& desc) {
+  Resource resource;
+  resource.name = name;
+  resource.isImage = true;
+  resource.imageDesc = desc;
+
+  resources_.push_back(resource);
+  compiled_ = false;
+  return static_cast<ResourceHandle>(resources_.size() - 1);
+}
+
+JlVulkanRenderGraph::ResourceHandle JlVulkanRenderGraph::createBuffer(
+  const string& name, VkDeviceSize size, VkBufferUsageFlags usage) {
+  Resource resource;
+  resource.name = name;
+  resource.isImage = false;
+  resource.bufferSize = size;
+  resource.bufferUsage = usage;
+
+  resources_.push_back(resource);
+  compiled_ = false;
+  return static_cast<ResourceHandle>(resources_.size() - 1);
+}
+
+JlVulkanRenderGraph::ResourceHandle JlVulkanRenderGraph::importImage(
+  const string& name, VkImageAspectFlags aspect, VkImageLayout initialLayout,
+  VkPipelineStageFlags2 initialStages, VkImageLayout finalLayout) {
+  Resource resource;
+  resource.name = name;
+  resource.isImage = true;
+  resource.imported = true;
+  resource.imageDesc.aspect = aspect;
+  resource.initialLayout = initialLayout;
+  resource.initialStages = initialStages;
+  resource.finalLayout = finalLayout;
+
+  resources_.push_back(resource);
+  compiled_ = false;
+  return static_cast<ResourceHandle>(resources_.size() - 1);
+}
+
+JlVulkanRenderGraph::ResourceHandle JlVulkanRenderGraph::importBuffer(
+  const string& name, VkBuffer buffer) {
+  Resource resource;
+  resource.name = name;
+  resource.isImage = false;
+  resource.imported = true;
+  resource.buffer = buffer;
+
+  resources_.push_back(resource);
+  compiled_ = false;
+  return static_cast<ResourceHandle>(resources_.size() - 1);
+}
+
+void JlVulkanRenderGraph::setImportedImage(ResourceHandle resource,
+                                           VkImage image) {
+  resources_[resource].image = image;
+}
+
+void JlVulkanRenderGraph::setImportedBuffer(ResourceHandle resource,
+                                            VkBuffer buffer) {
+  resources_[resource].buffer = buffer;
+}
+
+uint32_t JlVulkanRenderGraph::addPass(const string& name,
+                                      ExecuteCallback execute) {
+  Pass pass;
+  pass.name = name;
+  pass.execute = move(execute);
+
+  passes_.push_back(move(pass));
+  compiled_ = false;
+  return static_cast<uint32_t>(passes_.size() - 1);
+}
+
+void JlVulkanRenderGraph::read(uint32_t pass, ResourceHandle resource,
+                               Access access) {
+  addUse(pass, resource, access, false);
+}
+
+void JlVulkanRenderGraph::write(uint32_t pass, ResourceHandle resource,
+                                Access access) {
+  addUse(pass, resource, access, true);
+}
+
+void JlVulkanRenderGraph::setSideEffects(uint32_t pass) {
+  passes_[pass].sideEffects = true;
+  compiled_ = false;
+}
+
+void JlVulkanRenderGraph::setQueue(uint32_t pass, Queue queue) {
+  passes_[pass].queue = queue;
+  compiled_ = false;
+}
+
+void JlVulkanRenderGraph::setQueueFamilies(uint32_t graphicsFamily,
+                                           uint32_t computeFamily) {
+  graphicsFamily_ = graphicsFamily;
+  computeFamily_ = computeFamily;
+  compiled_ = false;
+}
+
+bool JlVulkanRenderGraph::hasAsyncCompute() const {
+  return computeFamily_ != VK_QUEUE_FAMILY_IGNORED &&
+         computeFamily_ != graphicsFamily_;
+}
+
+uint32_t JlVulkanRenderGraph::getQueueFamily(Queue queue) const {
+  return queue == ComputeQueue && hasAsyncCompute() ? computeFamily_
+                                                    : graphicsFamily_;
+}
+
+bool JlVulkanRenderGraph::compile() {
+  destroyTransients();
+  stats_ = {};
+
+  cullPasses();
+  buildBatches();
+  computeLifetimes();
+  if (!allocateTransients()) return false;
+  computeBarriers();
+
+  compiled_ = true;
+  return true;
+}
+
+void JlVulkanRenderGraph::execute(VkCommandBuffer commandBuffer) {
+  if (!compiled_) return;
+
+  for (uint32_t i = 0; i < batches_.size(); i++)
+    executeBatch(i, commandBuffer);
+}
+
+void JlVulkanRenderGraph::executeBatch(uint32_t batchIndex,
+                                       VkCommandBuffer commandBuffer) {
+  if (!compiled_) return;
+
+  const Batch& batch = batches_[batchIndex];
+  for (uint32_t position = batch.firstPass;
+       position < batch.firstPass + batch.passCount; position++) {
+    Pass& pass = passes_[schedule_[position]];
+
+    // The profiler's queries are reset on the graphics queue, compute
+    // batches would race that reset.
+    uint32_t scope = UINT32_MAX;
+    if (batch.queue == GraphicsQueue)
+      scope = JlVulkanProfiler::beginScope(commandBuffer, pass.name);
+
+    recordBarriers(commandBuffer, pass.barriers);
+    if (pass.execute) pass.execute(commandBuffer);
+    recordBarriers(commandBuffer, pass.releases);
+
+    if (scope != UINT32_MAX) JlVulkanProfiler::endScope(commandBuffer, scope);
+  }
+
+  if (batchIndex + 1 == batches_.size())
+    recordBarriers(commandBuffer, finalBarriers_);
+}
+
+const vector<JlVulkanRenderGraph::Batch>&
+JlVulkanRenderGraph::getBatches() const {
+  return batches_;
+}
+
+void JlVulkanRenderGraph::reset() {
+  destroyTransients();
+
+  resources_.clear();
+  passes_.clear();
+  schedule_.clear();
+  batches_.clear();
+  finalBarriers_.clear();
+  stats_ = {};
+  compiled_ = false;
+}
+
+VkImage JlVulkanRenderGraph::getImage(ResourceHandle resource) const {
+  return resources_[resource].image;
+}
+
+VkImageView JlVulkanRenderGraph::getImageView(ResourceHandle resource) const {
+  return resources_[resource].imageView;
+}
+
+VkBuffer JlVulkanRenderGraph::getBuffer(ResourceHandle resource) const {
+  return resources_[resource].buffer;
+}
+
+JlVulkanRenderGraph::Stats JlVulkanRenderGraph::getStats() const {
+  return stats_;
+}
+
+void JlVulkanRenderGraph::dumpSchedule() const {
+  cout << JlEngineReports::jlGraphicsVulkan << "Render graph schedule:"
+    << endl;
+
+  for (const Pass& pass : passes_)
+    if (pass.culled)
+      cout << JlEngineReports::jlGraphicsVulkan << "  culled  " << pass.name
+        << endl;
+
+  for (size_t i = 0; i < schedule_.size(); i++) {
+    const Pass& pass = passes_[schedule_[i]];
+    const Batch& batch = batches_[pass.batch];
+    if (batch.firstPass == i)
+      cout << JlEngineReports::jlGraphicsVulkan << "  batch " << pass.batch
+        << (batch.queue == ComputeQueue ? " compute" : " graphics")
+        << (batch.waitBatch != UINT32_MAX
+              ? ", waits on " + to_string(batch.waitBatch)
+              : string())
+        << endl;
+
+    cout << JlEngineReports::jlGraphicsVulkan << "  " << i << "  "
+      << pass.name << " (" << pass.barriers.size() << " barriers";
+    if (!pass.releases.empty())
+      cout << ", " << pass.releases.size() << " releases";
+    cout << ")" << endl;
+
+    for (const Barrier& barrier : pass.barriers) {
+      const Resource& resource = resources_[barrier.resource];
+      cout << JlEngineReports::jlGraphicsVulkan << "       " << resource.name;
+      if (resource.isImage)
+        cout << " " << getLayoutName(barrier.oldLayout) << " -> "
+          << getLayoutName(barrier.newLayout);
+      if (resource.aliasSlot != UINT32_MAX)
+        cout << " [slot " << resource.aliasSlot << "]";
+      cout << endl;
+    }
+  }
+
+  for (const Barrier& barrier : finalBarriers_)
+    cout << JlEngineReports::jlGraphicsVulkan << "  end  "
+      << resources_[barrier.resource].name << " "
+      << getLayoutName(barrier.oldLayout) << " -> "
+      << getLayoutName(barrier.newLayout) << endl;
+
+  double saved = stats_.transientBytes > 0
+                   ? 100.0 * (1.0 - static_cast<double>(stats_.aliasedBytes) /
+                                      stats_.transientBytes)
+                   : 0.0;
+
+  cout << JlEngineReports::jlGraphicsVulkan << stats_.passes << " passes, "
+    << stats_.culledPasses << " culled, " << stats_.barriers
+    << " barriers in " << stats_.barrierBatches << " batches (naive "
+    << stats_.naiveBarriers << ")." << endl;
+  cout << JlEngineReports::jlGraphicsVulkan << stats_.batches
+    << " queue batches, " << stats_.crossQueueWaits << " cross queue waits, "
+    << stats_.queueTransfers << " ownership transfers." << endl;
+  cout << JlEngineReports::jlGraphicsVulkan << stats_.transientResources
+    << " transient resources in " << stats_.aliasSlots << " slots, "
+    << stats_.aliasedBytes / 1024 << " KiB instead of "
+    << stats_.transientBytes / 1024 << " KiB (" << saved << "% saved)."
+    << endl;
+}
+
+JlVulkanRenderGraph::AccessInfo JlVulkanRenderGraph::getAccessInfo(
+  Access access, bool isImage) {
+  AccessInfo info{};
+  switch (access) {
+    case ColorAttachment:
+      info = { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+               VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT |
+                 VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+               VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+      break;
+    case DepthAttachment:
+      info = { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+                 VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+               VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                 VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+               VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+      break;
+    case DepthRead:
+      info = { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+                 VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+               VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+               VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+      break;
+    case SampledGraphics:
+      info = { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+               VK_ACCESS_2_SHADER_READ_BIT,
+               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+      break;
+    case SampledCompute:
+      info = { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+               VK_ACCESS_2_SHADER_READ_BIT,
+               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+      break;
+    case StorageRead:
+      info = { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+               VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL };
+      break;
+    case StorageWrite:
+      info = { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+               VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT,
+               VK_IMAGE_LAYOUT_GENERAL };
+      break;
+    case TransferSrc:
+      info = { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT,
+               VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL };
+      break;
+    case TransferDst:
+      info = { VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+               VK_ACCESS_2_TRANSFER_WRITE_BIT,
+               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL };
+      break;
+    case VertexBuffer:
+      info = { VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT,
+               VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT,
+               VK_IMAGE_LAYOUT_UNDEFINED };
+      break;
+    case IndexBuffer:
+      info = { VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT,
+               VK_ACCESS_2_INDEX_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED };
+      break;
+    case IndirectBuffer:
+      info = { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+               VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT,
+               VK_IMAGE_LAYOUT_UNDEFINED };
+      break;
+    case UniformBuffer:
+      info = { VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT |
+                 VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+                 VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+               VK_ACCESS_2_UNIFORM_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED };
+      break;
+  }
+
+  if (!isImage) info.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+  return info;
+}
+
+void JlVulkanRenderGraph::addUse(uint32_t pass, ResourceHandle resource,
+                                 Access access, bool write) {
+  AccessInfo info = getAccessInfo(access, resources_[resource].isImage);
+
+  // A pass touching a resource twice gets a single combined use, an image
+  // can only be in one layout for the duration of a pass.
+  for (ResourceUse& use : passes_[pass].uses) {
+    if (use.resource != resource) continue;
+
+    use.info.stages |= info.stages;
+    use.info.access |= info.access;
+    use.write = use.write || write;
+    if (use.info.layout != info.layout) use.info.layout = VK_IMAGE_LAYOUT_GENERAL;
+    compiled_ = false;
+    return;
+  }
+
+  passes_[pass].uses.push_back({ resource, info, write });
+  compiled_ = false;
+}
+
+void JlVulkanRenderGraph::cullPasses() {
+  // Walk backwards from everything visible outside the graph, a pass
+  // survives if it writes something a surviving pass or the outside needs.
+  vector<bool> needed(resources_.size(), false);
+  schedule_.clear();
+
+  for (size_t i = passes_.size(); i-- > 0;) {
+    Pass& pass = passes_[i];
+
+    bool keep = pass.sideEffects;
+    for (const ResourceUse& use : pass.uses)
+      if (use.write &&
+          (resources_[use.resource].imported || needed[use.resource]))
+        keep = true;
+
+    pass.culled = !keep;
+    if (!keep) {
+      stats_.culledPasses++;
+      continue;
+    }
+
+    for (const ResourceUse& use : pass.uses) needed[use.resource] = true;
+  }
+
+  for (uint32_t i = 0; i < passes_.size(); i++)
+    if (!passes_[i].culled) schedule_.push_back(i);
+  stats_.passes = static_cast<uint32_t>(schedule_.size());
+}
+
+void JlVulkanRenderGraph::buildBatches() {
+  batches_.clear();
+
+  for (uint32_t position = 0; position < schedule_.size(); position++) {
+    Pass& pass = passes_[schedule_[position]];
+    Queue queue = pass.queue == ComputeQueue && hasAsyncCompute()
+                    ? ComputeQueue
+                    : GraphicsQueue;
+
+    if (batches_.empty() || batches_.back().queue != queue) {
+      Batch batch;
+      batch.queue = queue;
+      batch.firstPass = position;
+      batches_.push_back(batch);
+    }
+
+    batches_.back().passCount++;
+    pass.batch = static_cast<uint32_t>(batches_.size() - 1);
+  }
+
+  // The graph always ends on the graphics queue, that batch carries the
+  // final barriers and whatever signals the frame's completion.
+  if (batches_.empty() || batches_.back().queue != GraphicsQueue) {
+    Batch batch;
+    batch.firstPass = static_cast<uint32_t>(schedule_.size());
+    batches_.push_back(batch);
+  }
+  stats_.batches = static_cast<uint32_t>(batches_.size());
+}
+
+void JlVulkanRenderGraph::computeLifetimes() {
+  for (Resource& resource : resources_) {
+    resource.firstUse = UINT32_MAX;
+    resource.lastUse = 0;
+    resource.aliasSlot = UINT32_MAX;
+    resource.aliasPrevious = UINT32_MAX;
+  }
+
+  for (uint32_t position = 0; position < schedule_.size(); position++)
+    for (const ResourceUse& use : passes_[schedule_[position]].uses) {
+      Resource& resource = resources_[use.resource];
+      resource.firstUse = min(resource.firstUse, position);
+      resource.lastUse = max(resource.lastUse, position);
+    }
+}
+
+void JlVulkanRenderGraph::computeBarriers() {
+  vector<ResourceState> states(resources_.size());
+  finalBarriers_.clear();
+
+  for (uint32_t passIndex : schedule_) passes_[passIndex].releases.clear();
+
+  for (uint32_t passIndex : schedule_) {
+    Pass& pass = passes_[passIndex];
+    Batch& batch = batches_[pass.batch];
+    pass.barriers.clear();
+
+    for (const ResourceUse& use : pass.uses) {
+      const Resource& resource = resources_[use.resource];
+      ResourceState& state = states[use.resource];
+      stats_.naiveBarriers++;
+
+      if (!state.used) {
+        state.used = true;
+        state.queue = batch.queue;
+        state.batch = pass.batch;
+        if (resource.imported) {
+          state.layout = resource.initialLayout;
+          state.writeStages = resource.initialStages;
+        }
+        else if (resource.aliasPrevious != UINT32_MAX) {
+          // The memory still belongs to the previous occupant until its
+          // last access has finished.
+          const ResourceState& previous = states[resource.aliasPrevious];
+          state.writeStages = previous.writeStages | previous.readStages;
+          state.writeAccess = previous.writeAccess;
+          state.queue = previous.queue;
+          state.batch = previous.batch;
+        }
+      }
+
+      if (state.queue != batch.queue) {
+        // The other queue's batch has to finish first, a semaphore replaces
+        // the execution dependency a barrier would give.
+        if (batch.waitBatch == UINT32_MAX || batch.waitBatch < state.batch) {
+          if (batch.waitBatch == UINT32_MAX) stats_.crossQueueWaits++;
+          batch.waitBatch = state.batch;
+        }
+        batch.waitStages |= use.info.stages;
+        batches_[state.batch].signals = true;
+
+        bool transfer = state.lastPass != UINT32_MAX;
+        if (transfer) {
+          // Exclusive resources keep their contents only if the old queue
+          // releases them and the new one acquires them, with the same
+          // layout transition on both sides.
+          uint32_t srcFamily = getQueueFamily(state.queue);
+          uint32_t dstFamily = getQueueFamily(batch.queue);
+
+          passes_[state.lastPass].releases.push_back(
+            { use.resource, state.writeStages | state.readStages,
+              state.writeAccess, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE,
+              state.layout, use.info.layout, srcFamily, dstFamily });
+          pass.barriers.push_back(
+            { use.resource, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE,
+              use.info.stages, use.info.access, state.layout,
+              use.info.layout, srcFamily, dstFamily });
+          stats_.queueTransfers++;
+        }
+
+        state.queue = batch.queue;
+        state.batch = pass.batch;
+        state.lastPass = passIndex;
+        if (transfer) {
+          state.layout = use.info.layout;
+          state.writeStages = use.info.stages;
+          state.writeAccess = use.write ? use.info.access : VK_ACCESS_2_NONE;
+          state.readStages = use.write ? VK_PIPELINE_STAGE_2_NONE
+                                       : use.info.stages;
+          state.visibleStages = state.readStages;
+          state.visibleAccess = use.write ? VK_ACCESS_2_NONE
+                                          : use.info.access;
+          continue;
+        }
+
+        // Nothing left to order against on this queue.
+        state.writeStages = VK_PIPELINE_STAGE_2_NONE;
+        state.writeAccess = VK_ACCESS_2_NONE;
+        state.readStages = VK_PIPELINE_STAGE_2_NONE;
+      }
+      state.batch = pass.batch;
+      state.lastPass = passIndex;
+
+      Barrier barrier{ use.resource,
+                       state.writeStages | state.readStages,
+                       state.writeAccess,
+                       use.info.stages,
+                       use.info.access,
+                       state.layout,
+                       use.info.layout };
+
+      bool layoutChange = resource.isImage && state.layout != use.info.layout;
+      if (layoutChange || use.write) {
+        // Layout transitions count as writes, so read to read transitions
+        // also have to be ordered after earlier readers.
+        bool hazard = state.writeStages != VK_PIPELINE_STAGE_2_NONE ||
+                      state.readStages != VK_PIPELINE_STAGE_2_NONE;
+        if (layoutChange || hazard) pass.barriers.push_back(barrier);
+
+        state.layout = use.info.layout;
+        state.writeStages = use.info.stages;
+        state.writeAccess = use.write ? use.info.access : VK_ACCESS_2_NONE;
+        state.readStages = use.write ? VK_PIPELINE_STAGE_2_NONE
+                                     : use.info.stages;
+        state.visibleStages = use.write ? VK_PIPELINE_STAGE_2_NONE
+                                        : use.info.stages;
+        state.visibleAccess = use.write ? VK_ACCESS_2_NONE : use.info.access;
+        continue;
+      }
+
+      // Readers only wait on the last write, and only once per stage.
+      bool visible = (use.info.stages & ~state.visibleStages) == 0 &&
+                     (use.info.access & ~state.visibleAccess) == 0;
+      if (state.writeStages != VK_PIPELINE_STAGE_2_NONE && !visible) {
+        barrier.srcStages = state.writeStages;
+        pass.barriers.push_back(barrier);
+        state.visibleStages |= use.info.stages;
+        state.visibleAccess |= use.info.access;
+      }
+      state.readStages |= use.info.stages;
+    }
+
+    stats_.barriers += static_cast<uint32_t>(pass.barriers.size());
+    if (!pass.barriers.empty()) stats_.barrierBatches++;
+  }
+
+  // The last batch finishing has to mean the whole graph finished, so it
+  // waits on the last compute batch even without a resource between them.
+  Batch& lastBatch = batches_.back();
+  for (uint32_t i = static_cast<uint32_t>(batches_.size()); i-- > 0;) {
+    if (batches_[i].queue != ComputeQueue) continue;
+
+    if (lastBatch.waitBatch == UINT32_MAX) stats_.crossQueueWaits++;
+    if (lastBatch.waitBatch == UINT32_MAX || lastBatch.waitBatch < i)
+      lastBatch.waitBatch = i;
+    // Without a resource dependency nothing in the batch waits, but its
+    // signal still has to come after the compute work.
+    if (lastBatch.waitStages == VK_PIPELINE_STAGE_2_NONE)
+      lastBatch.waitStages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    batches_[i].signals = true;
+    break;
+  }
+
+  // Imported resources leave the graph owned by the graphics queue.
+  for (ResourceHandle i = 0; i < resources_.size(); i++) {
+    const Resource& resource = resources_[i];
+    ResourceState& state = states[i];
+    if (!resource.imported || !state.used || state.queue == GraphicsQueue)
+      continue;
+
+    lastBatch.waitStages |= VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+    VkImageLayout layout =
+      resource.isImage && resource.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED
+        ? resource.finalLayout
+        : state.layout;
+    uint32_t srcFamily = getQueueFamily(ComputeQueue);
+    uint32_t dstFamily = getQueueFamily(GraphicsQueue);
+
+    passes_[state.lastPass].releases.push_back(
+      { i, state.writeStages | state.readStages, state.writeAccess,
+        VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, state.layout, layout,
+        srcFamily, dstFamily });
+    finalBarriers_.push_back({ i, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE,
+                               VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                               VK_ACCESS_2_NONE, state.layout, layout,
+                               srcFamily, dstFamily });
+    stats_.queueTransfers++;
+    state.layout = layout;
+  }
+
+  for (ResourceHandle i = 0; i < resources_.size(); i++) {
+    const Resource& resource = resources_[i];
+    const ResourceState& state = states[i];
+    if (!resource.imported || !resource.isImage || !state.used ||
+        resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED ||
+        resource.finalLayout == state.layout)
+      continue;
+
+    finalBarriers_.push_back({ i, state.writeStages | state.readStages,
+                               state.writeAccess, VK_PIPELINE_STAGE_2_NONE,
+                               VK_ACCESS_2_NONE, state.layout,
+                               resource.finalLayout });
+  }
+
+  stats_.barriers += static_cast<uint32_t>(finalBarriers_.size());
+  if (!finalBarriers_.empty()) stats_.barrierBatches++;
+}
+
+bool JlVulkanRenderGraph::allocateTransients() {
+  vector<ResourceHandle> transients;
+
+  try {
+    for (ResourceHandle i = 0; i < resources_.size(); i++) {
+      Resource& resource = resources_[i];
+      if (resource.imported || resource.firstUse == UINT32_MAX) continue;
+
+      if (resource.isImage) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = resource.imageDesc.format;
+        imageInfo.extent = { resource.imageDesc.extent.width,
+                             resource.imageDesc.extent.height, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = resource.imageDesc.usage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if (vk_->vkCreateImage(device_, &imageInfo, allocator_,
+                               &resource.image) != VK_SUCCESS)
+          throw runtime_error("Failed to create render graph image \"" +
+                              resource.name + "\".");
+        vk_->vkGetImageMemoryRequirements(device_, resource.image,
+                                          &resource.requirements);
+      }
+      else {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = resource.bufferSize;
+        bufferInfo.usage = resource.bufferUsage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vk_->vkCreateBuffer(device_, &bufferInfo, allocator_,
+                                &resource.buffer) != VK_SUCCESS)
+          throw runtime_error("Failed to create render graph buffer \"" +
+                              resource.name + "\".");
+        vk_->vkGetBufferMemoryRequirements(device_, resource.buffer,
+                                           &resource.requirements);
+      }
+
+      transients.push_back(i);
+      stats_.transientResources++;
+      stats_.transientBytes += resource.requirements.size;
+    }
+
+    // Largest first, each resource goes into the first slot of the same
+    // kind whose occupants are all dead before it starts or born after it
+    // ends.
+    stable_sort(transients.begin(), transients.end(),
+                [&](ResourceHandle a, ResourceHandle b) {
+                  return resources_[a].requirements.size >
+                         resources_[b].requirements.size;
+                });
+
+    for (ResourceHandle handle : transients) {
+      Resource& resource = resources_[handle];
+
+      uint32_t slotIndex = UINT32_MAX;
+      for (uint32_t s = 0; s < aliasSlots_.size() && slotIndex == UINT32_MAX;
+           s++) {
+        const AliasSlot& slot = aliasSlots_[s];
+        if (slot.isImage != resource.isImage ||
+            (slot.requirements.memoryTypeBits &
+             resource.requirements.memoryTypeBits) == 0)
+          continue;
+
+        bool overlaps = false;
+        for (ResourceHandle other : slot.resources) {
+          const Resource& occupant = resources_[other];
+          if (resource.firstUse <= occupant.lastUse &&
+              occupant.firstUse <= resource.lastUse)
+            overlaps = true;
+        }
+        if (!overlaps) slotIndex = s;
+      }
+
+      if (slotIndex == UINT32_MAX) {
+        AliasSlot slot;
+        slot.isImage = resource.isImage;
+        slot.requirements = resource.requirements;
+        aliasSlots_.push_back(slot);
+        slotIndex = static_cast<uint32_t>(aliasSlots_.size() - 1);
+      }
+
+      AliasSlot& slot = aliasSlots_[slotIndex];
+      slot.requirements.size =
+        max(slot.requirements.size, resource.requirements.size);
+      slot.requirements.alignment =
+        max(slot.requirements.alignment, resource.requirements.alignment);
+      slot.requirements.memoryTypeBits &= resource.requirements.memoryTypeBits;
+      slot.resources.push_back(handle);
+      resource.aliasSlot = slotIndex;
+    }
+
+    for (AliasSlot& slot : aliasSlots_) {
+      if (!JlVulkanMemory::allocate(
+            slot.requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+            slot.isImage ? JlVulkanMemory::OptimalImage
+                         : JlVulkanMemory::LinearResource,
+            JlVulkanMemory::Buddy, slot.allocation))
+        throw runtime_error("Failed to allocate render graph memory.");
+      stats_.aliasedBytes += slot.requirements.size;
+
+      // Disjoint lifetimes sorted by start are also sorted by end, so the
+      // previous occupant is simply the one before.
+      sort(slot.resources.begin(), slot.resources.end(),
+           [&](ResourceHandle a, ResourceHandle b) {
+             return resources_[a].firstUse < resources_[b].firstUse;
+           });
+
+      for (size_t i = 0; i < slot.resources.size(); i++) {
+        Resource& resource = resources_[slot.resources[i]];
+        if (i > 0) resource.aliasPrevious = slot.resources[i - 1];
+
+        VkResult result =
+          resource.isImage
+            ? vk_->vkBindImageMemory(device_, resource.image,
+                                     slot.allocation.memory,
+                                     slot.allocation.offset)
+            : vk_->vkBindBufferMemory(device_, resource.buffer,
+                                      slot.allocation.memory,
+                                      slot.allocation.offset);
+        if (result != VK_SUCCESS)
+          throw runtime_error("Failed to bind render graph memory.");
+
+        if (!resource.isImage) continue;
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = resource.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = resource.imageDesc.format;
+        viewInfo.subresourceRange.aspectMask = resource.imageDesc.aspect;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        if (vk_->vkCreateImageView(device_, &viewInfo, allocator_,
+                                   &resource.imageView) != VK_SUCCESS)
+          throw runtime_error("Failed to create render graph image view.");
+      }
+    }
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    destroyTransients();
+    return false;
+  }
+
+  stats_.aliasSlots = static_cast<uint32_t>(aliasSlots_.size());
+  return true;
+}
+
+void JlVulkanRenderGraph::destroyTransients() {
+  vector<VkImage> images;
+  vector<VkImageView> imageViews;
+  vector<VkBuffer> buffers;
+  vector<JlVulkanMemory::Allocation> allocations;
+
+  for (Resource& resource : resources_) {
+    if (resource.imported) continue;
+
+    if (resource.imageView != VK_NULL_HANDLE)
+      imageViews.push_back(resource.imageView);
+    if (resource.image != VK_NULL_HANDLE) images.push_back(resource.image);
+    if (resource.buffer != VK_NULL_HANDLE) buffers.push_back(resource.buffer);
+
+    resource.image = VK_NULL_HANDLE;
+    resource.imageView = VK_NULL_HANDLE;
+    resource.buffer = VK_NULL_HANDLE;
+  }
+
+  for (AliasSlot& slot : aliasSlots_)
+    if (slot.allocation.block != nullptr)
+      allocations.push_back(slot.allocation);
+  aliasSlots_.clear();
+
+  if (images.empty() && buffers.empty() && allocations.empty()) return;
+
+  VkDevice device = device_;
+  JlVulkanTimeline::destroyLater([=]() mutable {
+    for (VkImageView imageView : imageViews)
+      vk_->vkDestroyImageView(device, imageView, allocator_);
+    for (VkImage image : images) vk_->vkDestroyImage(device, image, allocator_);
+    for (VkBuffer buffer : buffers)
+      vk_->vkDestroyBuffer(device, buffer, allocator_);
+    for (JlVulkanMemory::Allocation& allocation : allocations)
+      JlVulkanMemory::free(allocation);
+  });
+}
+
+void JlVulkanRenderGraph::recordBarriers(VkCommandBuffer commandBuffer,
+                                         const vector<Barrier>& barriers) {
+  if (barriers.empty()) return;
+
+  imageBarriers_.clear();
+  bufferBarriers_.clear();
+
+  for (const Barrier& barrier : barriers) {
+    const Resource& resource = resources_[barrier.resource];
+
+    if (resource.isImage) {
+      VkImageMemoryBarrier2 imageBarrier{};
+      imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+      imageBarrier.srcStageMask = barrier.srcStages;
+      imageBarrier.srcAccessMask = barrier.srcAccess;
+      imageBarrier.dstStageMask = barrier.dstStages;
+      imageBarrier.dstAccessMask = barrier.dstAccess;
+      imageBarrier.oldLayout = barrier.oldLayout;
+      imageBarrier.newLayout = barrier.newLayout;
+      imageBarrier.srcQueueFamilyIndex = barrier.srcFamily;
+      imageBarrier.dstQueueFamilyIndex = barrier.dstFamily;
+      imageBarrier.image = resource.image;
+      imageBarrier.subresourceRange.aspectMask = resource.imageDesc.aspect;
+      imageBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+      imageBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+      imageBarriers_.push_back(imageBarrier);
+    }
+    else {
+      VkBufferMemoryBarrier2 bufferBarrier{};
+      bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+      bufferBarrier.srcStageMask = barrier.srcStages;
+      bufferBarrier.srcAccessMask = barrier.srcAccess;
+      bufferBarrier.dstStageMask = barrier.dstStages;
+      bufferBarrier.dstAccessMask = barrier.dstAccess;
+      bufferBarrier.srcQueueFamilyIndex = barrier.srcFamily;
+      bufferBarrier.dstQueueFamilyIndex = barrier.dstFamily;
+      bufferBarrier.buffer = resource.buffer;
+      bufferBarrier.size = VK_WHOLE_SIZE;
+      bufferBarriers_.push_back(bufferBarrier);
+    }
+  }
+
+  if (synchronization2_) {
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.imageMemoryBarrierCount =
+      static_cast<uint32_t>(imageBarriers_.size());
+    dependencyInfo.pImageMemoryBarriers = imageBarriers_.data();
+    dependencyInfo.bufferMemoryBarrierCount =
+      static_cast<uint32_t>(bufferBarriers_.size());
+    dependencyInfo.pBufferMemoryBarriers = bufferBarriers_.data();
+
+    vk_->vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+    return;
+  }
+
+  // Every stage and access bit the graph uses exists in the original
+  // flags, the per barrier masks are merged into one dependency.
+  VkPipelineStageFlags srcStages = 0;
+  VkPipelineStageFlags dstStages = 0;
+  legacyImageBarriers_.clear();
+  legacyBufferBarriers_.clear();
+
+  for (const VkImageMemoryBarrier2& barrier2 : imageBarriers_) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = static_cast<VkAccessFlags>(barrier2.srcAccessMask);
+    barrier.dstAccessMask = static_cast<VkAccessFlags>(barrier2.dstAccessMask);
+    barrier.oldLayout = barrier2.oldLayout;
+    barrier.newLayout = barrier2.newLayout;
+    barrier.srcQueueFamilyIndex = barrier2.srcQueueFamilyIndex;
+    barrier.dstQueueFamilyIndex = barrier2.dstQueueFamilyIndex;
+    barrier.image = barrier2.image;
+    barrier.subresourceRange = barrier2.subresourceRange;
+    legacyImageBarriers_.push_back(barrier);
+
+    srcStages |= static_cast<VkPipelineStageFlags>(barrier2.srcStageMask);
+    dstStages |= static_cast<VkPipelineStageFlags>(barrier2.dstStageMask);
+  }
+
+  for (const VkBufferMemoryBarrier2& barrier2 : bufferBarriers_) {
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = static_cast<VkAccessFlags>(barrier2.srcAccessMask);
+    barrier.dstAccessMask = static_cast<VkAccessFlags>(barrier2.dstAccessMask);
+    barrier.srcQueueFamilyIndex = barrier2.srcQueueFamilyIndex;
+    barrier.dstQueueFamilyIndex = barrier2.dstQueueFamilyIndex;
+    barrier.buffer = barrier2.buffer;
+    barrier.size = VK_WHOLE_SIZE;
+    legacyBufferBarriers_.push_back(barrier);
+
+    srcStages |= static_cast<VkPipelineStageFlags>(barrier2.srcStageMask);
+    dstStages |= static_cast<VkPipelineStageFlags>(barrier2.dstStageMask);
+  }
+
+  if (srcStages == 0) srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+  if (dstStages == 0) dstStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+  vk_->vkCmdPipelineBarrier(
+    commandBuffer, srcStages, dstStages, 0, 0, nullptr,
+    static_cast<uint32_t>(legacyBufferBarriers_.size()),
+    legacyBufferBarriers_.data(),
+    static_cast<uint32_t>(legacyImageBarriers_.size()),
+    legacyImageBarriers_.data());
+}
@@ -0,0 +1,252 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#include "graphics/jl_vulkan_timeline.h"
+#include "graphics/jl_vulkan_dispatch.h"
+#include "graphics/jl_vulkan_memory.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+
+#include "defines.h"
+
+using namespace std;
+
+const VkAllocationCallbacks* const allocator_ =
+  JlVulkanMemory::getAllocationCallbacks();
+const JlVulkanDispatch* const vk_ = &JlVulkanDispatch::get();
+
+VkDevice timelineDevice_ = VK_NULL_HANDLE;
+VkSemaphore gpuTimeline_ = VK_NULL_HANDLE;
+atomic<uint64_t> timelinePending_{ 1 };
+atomic<uint64_t> timelineCompleted_{ 0 };
+
+mutex destroyMutex_;
+deque<JlVulkanTimeline::PendingDestroy> destroyQueue_;
+JlVulkanTimeline::Stats timelineStats_;
+
+template <typename T>
+static uint64_t toHandle(T handle) {
+  return (uint64_t)handle;
+}
+
+template <typename T>
+static T fromHandle(uint64_t handle) {
+  return (T)handle;
+}
+
+bool JlVulkanTimeline::init(VkDevice device, bool timelineSemaphores) {
+  timelineDevice_ = device;
+  timelinePending_ = 1;
+  timelineCompleted_ = 0;
+  timelineStats_ = {};
+
+  if (!timelineSemaphores) {
+    cout << JlEngineReports::jlGraphicsVulkan
+      << "Timeline semaphores unsupported, tracking GPU progress by fences..."
+      << endl;
+    return true;
+  }
+
+  VkSemaphoreTypeCreateInfo timelineInfo{};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  timelineInfo.initialValue = 0;
+
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreInfo.pNext = &timelineInfo;
+
+  try {
+    if (vk_->vkCreateSemaphore(timelineDevice_, &semaphoreInfo, allocator_,
+                               &gpuTimeline_) != VK_SUCCESS)
+      throw runtime_error("Failed to create GPU timeline semaphore.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    gpuTimeline_ = VK_NULL_HANDLE;
+    return false;
+  }
+
+  cout << JlEngineReports::jlGraphicsVulkan << "GPU timeline created..."
+    << endl;
+  return true;
+}
+
+void JlVulkanTimeline::shutdown() {
+  markCompleted(timelinePending_);
+  collect();
+  reportStats();
+
+  if (gpuTimeline_ != VK_NULL_HANDLE)
+    vk_->vkDestroySemaphore(timelineDevice_, gpuTimeline_, allocator_);
+  gpuTimeline_ = VK_NULL_HANDLE;
+
+  cout << JlEngineReports::jlGraphicsVulkan << "GPU timeline destroyed..."
+    << endl;
+}
+
+VkSemaphore JlVulkanTimeline::getSemaphore() { return gpuTimeline_; }
+
+uint64_t JlVulkanTimeline::getPendingValue() { return timelinePending_; }
+
+uint64_t JlVulkanTimeline::advance() { return timelinePending_++; }
+
+uint64_t JlVulkanTimeline::getCompletedValue() {
+  if (gpuTimeline_ != VK_NULL_HANDLE) {
+    uint64_t value = 0;
+    vk_->vkGetSemaphoreCounterValue(timelineDevice_, gpuTimeline_, &value);
+    markCompleted(value);
+  }
+
+  return timelineCompleted_;
+}
+
+void JlVulkanTimeline::markCompleted(uint64_t value) {
+  uint64_t completed = timelineCompleted_;
+  while (value > completed &&
+         !timelineCompleted_.compare_exchange_weak(completed, value))
+    ;
+}
+
+bool JlVulkanTimeline::wait(uint64_t value, uint64_t timeout) {
+  if (getCompletedValue() >= value) return true;
+  if (gpuTimeline_ == VK_NULL_HANDLE) return false;
+
+  timelineStats_.cpuWaits++;
+
+  VkSemaphoreWaitInfo waitInfo{};
+  waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  waitInfo.semaphoreCount = 1;
+  waitInfo.pSemaphores = &gpuTimeline_;
+  waitInfo.pValues = &value;
+
+  if (vk_->vkWaitSemaphores(timelineDevice_, &waitInfo, timeout) != VK_SUCCESS)
+    return false;
+
+  markCompleted(value);
+  return true;
+}
+
+void JlVulkanTimeline::destroyBuffer(VkBuffer buffer,
+                                     JlVulkanMemory::Allocation& allocation) {
+  enqueue({ Buffer, toHandle(buffer), allocation, nullptr, 0 });
+  allocation = {};
+}
+
+void JlVulkanTimeline::destroyImage(VkImage image,
+                                    JlVulkanMemory::Allocation& allocation) {
+  enqueue({ Image, toHandle(image), allocation, nullptr, 0 });
+  allocation = {};
+}
+
+void JlVulkanTimeline::destroyImageView(VkImageView imageView) {
+  enqueue({ ImageView, toHandle(imageView), {}, nullptr, 0 });
+}
+
+void JlVulkanTimeline::destroyFramebuffer(VkFramebuffer framebuffer) {
+  enqueue({ Framebuffer, toHandle(framebuffer), {}, nullptr, 0 });
+}
+
+void JlVulkanTimeline::destroySampler(VkSampler sampler) {
+  enqueue({ Sampler, toHandle(sampler), {}, nullptr, 0 });
+}
+
+void JlVulkanTimeline::destroyPipeline(VkPipeline pipeline) {
+  enqueue({ Pipeline, toHandle(pipeline), {}, nullptr, 0 });
+}
+
+void JlVulkanTimeline::destroyPipelineLayout(VkPipelineLayout pipelineLayout) {
+  enqueue({ PipelineLayout, toHandle(pipelineLayout), {}, nullptr, 0 });
+}
+
+void JlVulkanTimeline::destroyLater(function<void()> destroy) {
+  enqueue({ Callback, 0, {}, move(destroy), 0 });
+}
+
+void JlVulkanTimeline::collect() {
+  uint64_t completed = getCompletedValue();
+
+  // Destroy outside the lock so callbacks may queue more work.
+  deque<PendingDestroy> ready;
+  {
+    lock_guard<mutex> lock(destroyMutex_);
+    while (!destroyQueue_.empty() && destroyQueue_.front().value <= completed) {
+      ready.push_back(move(destroyQueue_.front()));
+      destroyQueue_.pop_front();
+    }
+  }
+
+  for (PendingDestroy& pending : ready) destroy(pending);
+  timelineStats_.destroyed += ready.size();
+}
+
+void JlVulkanTimeline::reportStats() {
+  cout << JlEngineReports::jlGraphicsVulkan << "GPU timeline at "
+    << timelineCompleted_ << ": " << timelineStats_.deferred
+    << " deferred destructions / " << timelineStats_.peakQueued
+    << " peak queued / " << timelineStats_.cpuWaits << " CPU waits." << endl;
+}
+
+void JlVulkanTimeline::enqueue(PendingDestroy&& pending) {
+  lock_guard<mutex> lock(destroyMutex_);
+
+  // Tagged under the lock so the queue stays sorted by value.
+  pending.value = timelinePending_;
+  destroyQueue_.push_back(move(pending));
+
+  timelineStats_.deferred++;
+  timelineStats_.peakQueued =
+    max<uint64_t>(timelineStats_.peakQueued, destroyQueue_.size());
+}
+
+void JlVulkanTimeline::destroy(PendingDestroy& pending) {
+  switch (pending.type) {
+    case Buffer:
+      JlVulkanMemory::destroyBuffer(fromHandle<VkBuffer>(pending.handle),
+                                    pending.allocation);
+      break;
+    case Image:
+      JlVulkanMemory::destroyImage(fromHandle<VkImage>(pending.handle),
+                                   pending.allocation);
+      break;
+    case ImageView:
+      vk_->vkDestroyImageView(timelineDevice_,
+                              fromHandle<VkImageView>(pending.handle),
+                              allocator_);
+      break;
+    case Framebuffer:
+      vk_->vkDestroyFramebuffer(timelineDevice_,
+                                fromHandle<VkFramebuffer>(pending.handle),
+                                allocator_);
+      break;
+    case Sampler:
+      vk_->vkDestroySampler(timelineDevice_,
+                            fromHandle<VkSampler>(pending.handle), allocator_);
+      break;
+    case Pipeline:
+      vk_->vkDestroyPipeline(timelineDevice_,
+                             fromHandle<VkPipeline>(pending.handle),
+                             allocator_);
+      break;
+    case PipelineLayout:
+      vk_->vkDestroyPipelineLayout(timelineDevice_,
+                                   fromHandle<VkPipelineLayout>(pending.handle),
+                                   allocator_);
+      break;
+    case Callback:
+      pending.callback();
+      break;
+    default:
+      break;
+  }
+}
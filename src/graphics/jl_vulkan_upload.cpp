@@ -0,0 +1,560 @@
+// Copyright (c) 2024 Jennie Scinocca
+//-----------------------------------
+
+#include "graphics/jl_vulkan_upload.h"
+#include "graphics/jl_vulkan_dispatch.h"
+#include "graphics/jl_vulkan_memory.h"
+
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "defines.h"
+
+using namespace std;
+
+const VkAllocationCallbacks* const allocator_ =
+  JlVulkanMemory::getAllocationCallbacks();
+const JlVulkanDispatch* const vk_ = &JlVulkanDispatch::get();
+
+VkDevice uploadDevice_ = VK_NULL_HANDLE;
+VkQueue uploadQueue_ = VK_NULL_HANDLE;
+uint32_t uploadFamily_ = 0;
+uint32_t uploadGraphicsFamily_ = 0;
+
+VkBuffer stagingBuffer_ = VK_NULL_HANDLE;
+JlVulkanMemory::Allocation stagingAllocation_;
+VkDeviceSize ringSize_ = 0;
+VkDeviceSize ringHead_ = 0;
+VkDeviceSize ringTail_ = 0;
+bool ringEmpty_ = true;
+
+VkCommandPool uploadCommandPool_ = VK_NULL_HANDLE;
+VkSemaphore uploadTimeline_ = VK_NULL_HANDLE;
+uint64_t uploadNextValue_ = 1;
+
+vector<JlVulkanUploader::BufferCopy> pendingBufferCopies_;
+vector<JlVulkanUploader::ImageCopy> pendingImageCopies_;
+vector<VkBufferMemoryBarrier> pendingBufferAcquires_;
+vector<VkImageMemoryBarrier> pendingImageAcquires_;
+uint64_t pendingGraphicsWait_ = 0;
+
+deque<JlVulkanUploader::Batch> inFlightBatches_;
+vector<VkCommandBuffer> freeUploadCommandBuffers_;
+JlVulkanUploader::Stats uploadStats_;
+
+bool JlVulkanUploader::init(VkDevice device, VkQueue transferQueue,
+                            uint32_t transferFamily, uint32_t graphicsFamily,
+                            VkDeviceSize ringSize) {
+  uploadDevice_ = device;
+  uploadQueue_ = transferQueue;
+  uploadFamily_ = transferFamily;
+  uploadGraphicsFamily_ = graphicsFamily;
+  ringSize_ = ringSize;
+  ringHead_ = ringTail_ = 0;
+  ringEmpty_ = true;
+  uploadNextValue_ = 1;
+  uploadStats_ = {};
+
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = ringSize_;
+  bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT |
+                   VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.queueFamilyIndex = uploadFamily_;
+
+  VkSemaphoreTypeCreateInfo timelineInfo{};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  timelineInfo.initialValue = 0;
+
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreInfo.pNext = &timelineInfo;
+
+  try {
+    if (JlVulkanMemory::createBuffer(
+          bufferInfo,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+          0, JlVulkanMemory::Buddy, &stagingBuffer_, stagingAllocation_) !=
+        VK_SUCCESS ||
+        stagingAllocation_.mapped == nullptr)
+      throw runtime_error("Failed to create staging ring buffer.");
+
+    if (vk_->vkCreateCommandPool(uploadDevice_, &poolInfo, allocator_,
+                                 &uploadCommandPool_) != VK_SUCCESS)
+      throw runtime_error("Failed to create upload command pool.");
+
+    if (vk_->vkCreateSemaphore(uploadDevice_, &semaphoreInfo, allocator_,
+                               &uploadTimeline_) != VK_SUCCESS)
+      throw runtime_error("Failed to create upload timeline semaphore.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return false;
+  }
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Upload manager created ("
+    << ringSize_ << " byte ring, "
+    << (hasDedicatedQueue() ? "dedicated transfer queue" : "graphics queue")
+    << ")..." << endl;
+  return true;
+}
+
+void JlVulkanUploader::shutdown() {
+  if (uploadDevice_ == VK_NULL_HANDLE) return;
+
+  reportStats();
+
+  if (!inFlightBatches_.empty()) wait(inFlightBatches_.back().value);
+  inFlightBatches_.clear();
+  freeUploadCommandBuffers_.clear();
+  pendingBufferCopies_.clear();
+  pendingImageCopies_.clear();
+  pendingBufferAcquires_.clear();
+  pendingImageAcquires_.clear();
+
+  if (uploadTimeline_ != VK_NULL_HANDLE)
+    vk_->vkDestroySemaphore(uploadDevice_, uploadTimeline_, allocator_);
+  if (uploadCommandPool_ != VK_NULL_HANDLE)
+    vk_->vkDestroyCommandPool(uploadDevice_, uploadCommandPool_, allocator_);
+  if (stagingBuffer_ != VK_NULL_HANDLE)
+    JlVulkanMemory::destroyBuffer(stagingBuffer_, stagingAllocation_);
+
+  uploadTimeline_ = VK_NULL_HANDLE;
+  uploadCommandPool_ = VK_NULL_HANDLE;
+  stagingBuffer_ = VK_NULL_HANDLE;
+  uploadDevice_ = VK_NULL_HANDLE;
+
+  cout << JlEngineReports::jlGraphicsVulkan << "Upload manager destroyed..."
+    << endl;
+}
+
+uint64_t JlVulkanUploader::uploadBuffer(VkBuffer buffer, VkDeviceSize offset,
+                                        const void* data, VkDeviceSize size) {
+  if (stagingBuffer_ == VK_NULL_HANDLE || size == 0) return 0;
+
+  // Larger than the ring, stream it through in ring sized pieces.
+  const char* bytes = static_cast<const char*>(data);
+  VkDeviceSize chunkSize = ringSize_ / 2;
+  size_t firstCopy = pendingBufferCopies_.size();
+  for (VkDeviceSize done = 0; done < size; done += chunkSize) {
+    VkDeviceSize chunk = min(chunkSize, size - done);
+
+    VkDeviceSize ringOffset;
+    bool reserved = reserve(chunk, 16, ringOffset);
+
+    // A stall flushes what is pending, this call's earlier chunks included,
+    // those are on their way and only the ones queued after are ours.
+    if (pendingBufferCopies_.size() < firstCopy)
+      firstCopy = pendingBufferCopies_.size();
+
+    if (!reserved) {
+      pendingBufferCopies_.erase(pendingBufferCopies_.begin() + firstCopy,
+                                 pendingBufferCopies_.end());
+      return 0;
+    }
+
+    memcpy(static_cast<char*>(stagingAllocation_.mapped) + ringOffset,
+           bytes + done, chunk);
+
+    BufferCopy copy{};
+    copy.buffer = buffer;
+    copy.region.srcOffset = ringOffset;
+    copy.region.dstOffset = offset + done;
+    copy.region.size = chunk;
+    pendingBufferCopies_.push_back(copy);
+  }
+
+  uploadStats_.bytes += size;
+  uploadStats_.copies++;
+  return uploadNextValue_;
+}
+
+uint64_t JlVulkanUploader::uploadImage(VkImage image,
+                                       VkImageAspectFlags aspect,
+                                       VkExtent3D extent,
+                                       VkImageLayout finalLayout,
+                                       const void* data, VkDeviceSize size) {
+  if (stagingBuffer_ == VK_NULL_HANDLE || size == 0) return 0;
+
+  VkDeviceSize ringOffset;
+  try {
+    if (size > ringSize_ / 2)
+      throw runtime_error("Image upload is larger than the staging ring.");
+    if (!reserve(size, 16, ringOffset))
+      throw runtime_error("Failed to reserve staging memory.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return 0;
+  }
+
+  memcpy(static_cast<char*>(stagingAllocation_.mapped) + ringOffset, data,
+         size);
+
+  ImageCopy copy{};
+  copy.image = image;
+  copy.aspect = aspect;
+  copy.finalLayout = finalLayout;
+  copy.region.bufferOffset = ringOffset;
+  copy.region.imageSubresource.aspectMask = aspect;
+  copy.region.imageSubresource.layerCount = 1;
+  copy.region.imageExtent = extent;
+  pendingImageCopies_.push_back(copy);
+
+  uploadStats_.bytes += size;
+  uploadStats_.copies++;
+  return uploadNextValue_;
+}
+
+uint64_t JlVulkanUploader::flush() {
+  if (pendingBufferCopies_.empty() && pendingImageCopies_.empty()) return 0;
+
+  reclaim(false);
+
+  VkCommandBuffer commandBuffer = getCommandBuffer();
+  if (commandBuffer == VK_NULL_HANDLE) return 0;
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  vk_->vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+  bool transferOwnership = hasDedicatedQueue();
+
+  // Copies into the same buffer go out as one command. The sort is stable so
+  // repeated writes to a range keep their order.
+  stable_sort(pendingBufferCopies_.begin(), pendingBufferCopies_.end(),
+              [](const BufferCopy& a, const BufferCopy& b) {
+                return a.buffer < b.buffer;
+              });
+
+  // Acquires only become pending once the releases were submitted.
+  vector<VkBufferMemoryBarrier> bufferReleases;
+  vector<VkBufferMemoryBarrier> bufferAcquires;
+  vector<VkImageMemoryBarrier> imageAcquires;
+  vector<VkBufferCopy> regions;
+  for (size_t i = 0; i < pendingBufferCopies_.size();) {
+    VkBuffer buffer = pendingBufferCopies_[i].buffer;
+
+    regions.clear();
+    for (; i < pendingBufferCopies_.size() &&
+           pendingBufferCopies_[i].buffer == buffer;
+         i++) {
+      const VkBufferCopy& region = pendingBufferCopies_[i].region;
+
+      // Regions of one copy command must not overlap, split the command
+      // and order the writes when the same range is uploaded twice.
+      bool overlaps = any_of(regions.begin(), regions.end(),
+                             [&](const VkBufferCopy& other) {
+                               return region.dstOffset < other.dstOffset + other.size &&
+                                      other.dstOffset < region.dstOffset + region.size;
+                             });
+      if (overlaps) {
+        vk_->vkCmdCopyBuffer(commandBuffer, stagingBuffer_, buffer,
+                             static_cast<uint32_t>(regions.size()),
+                             regions.data());
+        regions.clear();
+
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vk_->vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                  VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1,
+                                  &barrier, 0, nullptr, 0, nullptr);
+      }
+
+      regions.push_back(region);
+    }
+
+    vk_->vkCmdCopyBuffer(commandBuffer, stagingBuffer_, buffer,
+                         static_cast<uint32_t>(regions.size()), regions.data());
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    if (transferOwnership) {
+      barrier.srcQueueFamilyIndex = uploadFamily_;
+      barrier.dstQueueFamilyIndex = uploadGraphicsFamily_;
+      bufferReleases.push_back(barrier);
+
+      VkBufferMemoryBarrier acquire = barrier;
+      acquire.srcAccessMask = 0;
+      acquire.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+      bufferAcquires.push_back(acquire);
+    }
+  }
+
+  vector<VkImageMemoryBarrier> imageBarriers;
+  for (const ImageCopy& copy : pendingImageCopies_) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = copy.image;
+    barrier.subresourceRange.aspectMask = copy.aspect;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    imageBarriers.push_back(barrier);
+  }
+
+  if (!imageBarriers.empty())
+    vk_->vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                              VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                              nullptr,
+                              static_cast<uint32_t>(imageBarriers.size()),
+                              imageBarriers.data());
+
+  imageBarriers.clear();
+  for (const ImageCopy& copy : pendingImageCopies_) {
+    vk_->vkCmdCopyBufferToImage(commandBuffer, stagingBuffer_, copy.image,
+                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                                &copy.region);
+
+    // The layout transition is part of the release and must be repeated
+    // identically by the acquire.
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = copy.finalLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = copy.image;
+    barrier.subresourceRange.aspectMask = copy.aspect;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+
+    if (transferOwnership) {
+      barrier.srcQueueFamilyIndex = uploadFamily_;
+      barrier.dstQueueFamilyIndex = uploadGraphicsFamily_;
+
+      VkImageMemoryBarrier acquire = barrier;
+      acquire.srcAccessMask = 0;
+      acquire.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+      imageAcquires.push_back(acquire);
+    } else {
+      barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    }
+    imageBarriers.push_back(barrier);
+  }
+
+  // Without a queue family change the graphics side still waits on the
+  // timeline, which provides the memory dependency for buffers.
+  if (!bufferReleases.empty() || !imageBarriers.empty())
+    vk_->vkCmdPipelineBarrier(
+      commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+      transferOwnership ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT
+                        : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+      0, 0, nullptr, static_cast<uint32_t>(bufferReleases.size()),
+      bufferReleases.data(), static_cast<uint32_t>(imageBarriers.size()),
+      imageBarriers.data());
+
+  vk_->vkEndCommandBuffer(commandBuffer);
+
+  uint64_t signalValue = uploadNextValue_;
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo{};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.signalSemaphoreValueCount = 1;
+  timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.pNext = &timelineInfo;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pSignalSemaphores = &uploadTimeline_;
+
+  try {
+    if (vk_->vkQueueSubmit(uploadQueue_, 1, &submitInfo, VK_NULL_HANDLE) !=
+        VK_SUCCESS)
+      throw runtime_error("Failed to submit uploads.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    // Nothing was released, the copies stay pending for the next flush.
+    freeUploadCommandBuffers_.push_back(commandBuffer);
+    return 0;
+  }
+
+  uploadNextValue_++;
+  pendingBufferAcquires_.insert(pendingBufferAcquires_.end(),
+                                bufferAcquires.begin(), bufferAcquires.end());
+  pendingImageAcquires_.insert(pendingImageAcquires_.end(),
+                               imageAcquires.begin(), imageAcquires.end());
+
+  Batch batch;
+  batch.commandBuffer = commandBuffer;
+  batch.ringEnd = ringHead_;
+  batch.value = signalValue;
+  inFlightBatches_.push_back(batch);
+
+  pendingBufferCopies_.clear();
+  pendingImageCopies_.clear();
+  pendingGraphicsWait_ = signalValue;
+  uploadStats_.submissions++;
+  return signalValue;
+}
+
+uint64_t JlVulkanUploader::recordGraphicsAcquire(
+  VkCommandBuffer commandBuffer) {
+  if (!pendingBufferAcquires_.empty() || !pendingImageAcquires_.empty())
+    vk_->vkCmdPipelineBarrier(
+      commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr,
+      static_cast<uint32_t>(pendingBufferAcquires_.size()),
+      pendingBufferAcquires_.data(),
+      static_cast<uint32_t>(pendingImageAcquires_.size()),
+      pendingImageAcquires_.data());
+
+  pendingBufferAcquires_.clear();
+  pendingImageAcquires_.clear();
+
+  uint64_t waitValue = pendingGraphicsWait_;
+  pendingGraphicsWait_ = 0;
+  return waitValue;
+}
+
+bool JlVulkanUploader::isComplete(uint64_t value) {
+  uint64_t completed = 0;
+  vk_->vkGetSemaphoreCounterValue(uploadDevice_, uploadTimeline_, &completed);
+  return completed >= value;
+}
+
+void JlVulkanUploader::wait(uint64_t value) {
+  VkSemaphoreWaitInfo waitInfo{};
+  waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  waitInfo.semaphoreCount = 1;
+  waitInfo.pSemaphores = &uploadTimeline_;
+  waitInfo.pValues = &value;
+
+  vk_->vkWaitSemaphores(uploadDevice_, &waitInfo, UINT64_MAX);
+}
+
+VkSemaphore JlVulkanUploader::getTimeline() { return uploadTimeline_; }
+
+bool JlVulkanUploader::hasDedicatedQueue() {
+  return uploadFamily_ != uploadGraphicsFamily_;
+}
+
+void JlVulkanUploader::reportStats() {
+  cout << JlEngineReports::jlGraphicsVulkan << "Uploads: "
+    << uploadStats_.copies << " copies / " << uploadStats_.bytes
+    << " bytes / " << uploadStats_.submissions << " submissions / "
+    << uploadStats_.ringStalls << " ring stalls." << endl;
+}
+
+bool JlVulkanUploader::reserve(VkDeviceSize size, VkDeviceSize alignment,
+                               VkDeviceSize& offset) {
+  if (size > ringSize_) return false;
+
+  for (int attempt = 0; attempt < 3; attempt++) {
+    reclaim(false);
+
+    VkDeviceSize start = (ringHead_ + alignment - 1) & ~(alignment - 1);
+
+    // Free space is [head, end) plus [0, tail) once the ring wrapped, or
+    // [head, tail) while the head is still behind the tail.
+    if (ringEmpty_ || ringHead_ > ringTail_) {
+      if (start + size <= ringSize_) {
+        offset = start;
+        ringHead_ = start + size;
+        ringEmpty_ = false;
+        return true;
+      }
+      if (size <= ringTail_) {
+        offset = 0;
+        ringHead_ = size;
+        ringEmpty_ = false;
+        return true;
+      }
+    } else if (start + size <= ringTail_) {
+      offset = start;
+      ringHead_ = start + size;
+      return true;
+    }
+
+    // Out of space, push what is pending and wait for the oldest batch.
+    uploadStats_.ringStalls++;
+    flush();
+    reclaim(true);
+  }
+
+  return false;
+}
+
+void JlVulkanUploader::reclaim(bool waitForOldest) {
+  if (waitForOldest && !inFlightBatches_.empty())
+    wait(inFlightBatches_.front().value);
+
+  uint64_t completed = 0;
+  vk_->vkGetSemaphoreCounterValue(uploadDevice_, uploadTimeline_, &completed);
+
+  while (!inFlightBatches_.empty() &&
+         inFlightBatches_.front().value <= completed) {
+    Batch& batch = inFlightBatches_.front();
+    ringTail_ = batch.ringEnd;
+    freeUploadCommandBuffers_.push_back(batch.commandBuffer);
+    inFlightBatches_.pop_front();
+  }
+
+  if (inFlightBatches_.empty() && pendingBufferCopies_.empty() &&
+      pendingImageCopies_.empty()) {
+    ringHead_ = ringTail_ = 0;
+    ringEmpty_ = true;
+  }
+}
+
+VkCommandBuffer JlVulkanUploader::getCommandBuffer() {
+  if (!freeUploadCommandBuffers_.empty()) {
+    VkCommandBuffer commandBuffer = freeUploadCommandBuffers_.back();
+    freeUploadCommandBuffers_.pop_back();
+    vk_->vkResetCommandBuffer(commandBuffer, 0);
+    return commandBuffer;
+  }
+
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = uploadCommandPool_;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = 1;
+
+  VkCommandBuffer commandBuffer;
+  try {
+    if (vk_->vkAllocateCommandBuffers(uploadDevice_, &allocInfo,
+                                      &commandBuffer) != VK_SUCCESS)
+      throw runtime_error("Failed to allocate upload command buffer.");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlGraphicsVulkan << e.what() << endl;
+    return VK_NULL_HANDLE;
+  }
+
+  return commandBuffer;
+}
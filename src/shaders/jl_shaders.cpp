@@ -2,11 +2,26 @@
 //-----------------------------------
 
 #include "shaders/jl_shaders.h"
+#include "engine/jl_hash.h"
+#include "engine/jl_worker_pool.h"
 
-#include <cstdlib>
+#include <glslang/Public/ResourceLimits.h>
+#include <glslang/Public/ShaderLang.h>
+#include <glslang/SPIRV/GlslangToSpv.h>
+#include <spirv-tools/libspirv.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
 #include <ostream>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -15,8 +30,522 @@
 
 using namespace std;
 
+// What spirv-val used to be run with. The SPIR-V itself targets Vulkan 1.0
+// like glslangValidator -V did, so the binaries don't change.
+const spv_target_env shaderValidationEnv_ = SPV_ENV_VULKAN_1_3;
+
+static EShLanguage getLanguage(JlVulkanShaders::Stage stage) {
+  switch (stage) {
+    case JlVulkanShaders::TessControl: return EShLangTessControl;
+    case JlVulkanShaders::TessEvaluation: return EShLangTessEvaluation;
+    case JlVulkanShaders::Geometry: return EShLangGeometry;
+    case JlVulkanShaders::Fragment: return EShLangFragment;
+    case JlVulkanShaders::Compute: return EShLangCompute;
+    default: return EShLangVertex;
+  }
+}
+
+// glslang logs one message per line, as "ERROR: name:line: message".
+// Anything else in the log is a summary of the lines before it.
+static void parseInfoLog(const char* log, const string& name,
+                         vector<JlVulkanShaders::Diagnostic>& diagnostics) {
+  istringstream stream(log != nullptr ? log : "");
+  string line;
+  while (getline(stream, line)) {
+    JlVulkanShaders::Diagnostic diagnostic;
+    size_t offset;
+    if (line.rfind("ERROR: ", 0) == 0) {
+      diagnostic.severity = JlVulkanShaders::Diagnostic::Error;
+      offset = 7;
+    } else if (line.rfind("WARNING: ", 0) == 0) {
+      diagnostic.severity = JlVulkanShaders::Diagnostic::Warning;
+      offset = 9;
+    } else
+      continue;
+
+    diagnostic.file = name;
+    diagnostic.message = line.substr(offset);
+
+    size_t fileEnd = line.find(':', offset);
+    size_t lineEnd =
+      fileEnd != string::npos ? line.find(':', fileEnd + 1) : string::npos;
+    if (lineEnd != string::npos && lineEnd > fileEnd + 1 &&
+        line.find_first_not_of("0123456789", fileEnd + 1) == lineEnd) {
+      diagnostic.file = line.substr(offset, fileEnd - offset);
+      diagnostic.line = static_cast<uint32_t>(
+        stoul(line.substr(fileEnd + 1, lineEnd - fileEnd - 1)));
+      size_t messageStart = line.find_first_not_of(' ', lineEnd + 1);
+      diagnostic.message =
+        messageStart != string::npos ? line.substr(messageStart) : "";
+    } else if (diagnostic.message.find("compilation errors") !=
+               string::npos)
+      continue;
+
+    diagnostics.push_back(diagnostic);
+  }
+}
+
+static bool hasErrors(const vector<JlVulkanShaders::Diagnostic>& diagnostics,
+                      size_t first) {
+  for (size_t i = first; i < diagnostics.size(); i++)
+    if (diagnostics[i].severity == JlVulkanShaders::Diagnostic::Error)
+      return true;
+  return false;
+}
+
+static bool readShaderFile(const path& file, string& source) {
+  ifstream stream(file, ios::binary);
+  if (!stream.is_open()) return false;
+
+  source.assign(istreambuf_iterator<char>(stream),
+                istreambuf_iterator<char>());
+  return true;
+}
+
+// Resolves #include "file" and #include <file> against the shaders
+// directory, relative to the file doing the include, and remembers what
+// it handed out.
+class ShaderIncluder : public glslang::TShader::Includer
+{
+public:
+  explicit ShaderIncluder(vector<string>& includes) : includes_(includes) {}
+
+  IncludeResult* includeLocal(const char* headerName,
+                              const char* includerName,
+                              size_t inclusionDepth) override {
+    // A rooted name would replace the base in the join below and reach
+    // outside the shaders directory, so would a leading "..".
+    path header(headerName);
+    if (header.has_root_path()) return nullptr;
+
+    path resolved =
+      (path(includerName).parent_path() / header).lexically_normal();
+    if (resolved.empty() || resolved.has_root_path() ||
+        *resolved.begin() == "..")
+      return nullptr;
+    string name = resolved.generic_string();
+
+    string* contents = new string();
+    if (!readShaderFile(JlEngineDirectories::shadersDir / name, *contents)) {
+      delete contents;
+      return nullptr;
+    }
+
+    includes_.push_back(name);
+    return new IncludeResult(name, contents->data(), contents->size(),
+                             contents);
+  }
+
+  IncludeResult* includeSystem(const char* headerName,
+                               const char* includerName,
+                               size_t inclusionDepth) override {
+    return includeLocal(headerName, "", inclusionDepth);
+  }
+
+  void releaseInclude(IncludeResult* result) override {
+    if (result == nullptr) return;
+    delete static_cast<string*>(result->userData);
+    delete result;
+  }
+
+private:
+  vector<string>& includes_;
+};
+
+bool JlVulkanShaders::compileSource(const string& source, const string& name,
+                                    Stage stage, vector<uint32_t>& spirv,
+                                    vector<Diagnostic>& diagnostics,
+                                    vector<string>* includes) {
+  size_t firstDiagnostic = diagnostics.size();
+  spirv.clear();
+
+  if (stage == UnknownStage) {
+    diagnostics.push_back(
+      { Diagnostic::Error, name, 0, "Unknown shader stage." });
+    return false;
+  }
+
+  // Reference counted, cheap when compile() already holds the process.
+  glslang::InitializeProcess();
+
+  EShLanguage language = getLanguage(stage);
+  EShMessages messages =
+    static_cast<EShMessages>(EShMsgSpvRules | EShMsgVulkanRules);
+
+  const char* text = source.c_str();
+  const int length = static_cast<int>(source.size());
+  const char* sourceName = name.c_str();
+
+  vector<string> included;
+  ShaderIncluder includer(included);
+
+  bool compiled = false;
+  {
+    glslang::TShader shader(language);
+    shader.setStringsWithLengthsAndNames(&text, &length, &sourceName, 1);
+    shader.setEnvInput(glslang::EShSourceGlsl, language,
+                       glslang::EShClientVulkan, 100);
+    shader.setEnvClient(glslang::EShClientVulkan,
+                        glslang::EShTargetVulkan_1_0);
+    shader.setEnvTarget(glslang::EShTargetSpv, glslang::EShTargetSpv_1_0);
+
+    bool parsed =
+      shader.parse(GetDefaultResources(), 100, false, messages, includer);
+    parseInfoLog(shader.getInfoLog(), name, diagnostics);
+
+    glslang::TProgram program;
+    program.addShader(&shader);
+    if (parsed && program.link(messages)) {
+      spv::SpvBuildLogger logger;
+      glslang::SpvOptions options;
+      options.validate = false;
+      glslang::GlslangToSpv(*program.getIntermediate(language), spirv,
+                            &logger, &options);
+
+      string spvMessages = logger.getAllMessages();
+      if (!spvMessages.empty())
+        diagnostics.push_back(
+          { Diagnostic::Warning, name, 0, spvMessages });
+      compiled = !spirv.empty();
+    } else if (parsed)
+      parseInfoLog(program.getInfoLog(), name, diagnostics);
+  }
+
+  glslang::FinalizeProcess();
+
+  if (includes != nullptr) {
+    sort(included.begin(), included.end());
+    included.erase(unique(included.begin(), included.end()), included.end());
+    *includes = included;
+  }
+
+  if (!compiled) {
+    if (!hasErrors(diagnostics, firstDiagnostic))
+      diagnostics.push_back(
+        { Diagnostic::Error, name, 0, "Failed to compile." });
+    spirv.clear();
+    return false;
+  }
+
+  return validate(spirv, name, diagnostics);
+}
+
+bool JlVulkanShaders::validate(const vector<uint32_t>& spirv,
+                               const string& name,
+                               vector<Diagnostic>& diagnostics) {
+  spvtools::SpirvTools tools(shaderValidationEnv_);
+  tools.SetMessageConsumer(
+    [&](spv_message_level_t level, const char*,
+        const spv_position_t& position, const char* message) {
+      if (level > SPV_MSG_WARNING) return;
+      diagnostics.push_back(
+        { level == SPV_MSG_WARNING ? Diagnostic::Warning : Diagnostic::Error,
+          name + ".spv", 0,
+          string(message) + " (word " + to_string(position.index) + ")" });
+    });
+
+  return tools.Validate(spirv);
+}
+
+JlVulkanShaders::Stage JlVulkanShaders::getStage(const path& file) {
+  string extension = file.extension().string();
+  if (extension == ".vert") return Vertex;
+  if (extension == ".tesc") return TessControl;
+  if (extension == ".tese") return TessEvaluation;
+  if (extension == ".geom") return Geometry;
+  if (extension == ".frag") return Fragment;
+  if (extension == ".comp") return Compute;
+  return UnknownStage;
+}
+
+void JlVulkanShaders::reportDiagnostics(
+  const vector<Diagnostic>& diagnostics) {
+  for (const Diagnostic& diagnostic : diagnostics) {
+    ostream& stream =
+      diagnostic.severity == Diagnostic::Error ? cerr : cout;
+    stream << JlEngineReports::jlShader
+      << (diagnostic.severity == Diagnostic::Error ? "Error " : "Warning ")
+      << diagnostic.file;
+    if (diagnostic.line != 0) stream << ":" << diagnostic.line;
+    stream << ": " << diagnostic.message << endl;
+  }
+}
+
+// One shader's outcome. Filled in on whichever worker picked it up and
+// reported afterwards, in order, so the output of a shader stays together.
+struct ShaderJob
+{
+  directory_entry entry;
+  string source;
+  vector<uint32_t> spirv;
+  vector<string> includes;
+  uint64_t inputHash = 0;
+  // Stamp of the binary that passed validation, 0 when it didn't.
+  uint64_t validatedHash = 0;
+  bool result = false;
+  vector<JlVulkanShaders::Diagnostic> diagnostics;
+  double ms = 0.0;
+};
+
+// What a compiled shader was built from and whether it was validated, by
+// source file name. The includes are what it pulled in last time it was
+// compiled, together they are the dependency graph of the shaders.
+struct ShaderManifestEntry
+{
+  uint64_t inputHash = 0;
+  uint64_t validatedHash = 0;
+  vector<string> includes;
+
+  bool operator==(const ShaderManifestEntry& other) const {
+    return inputHash == other.inputHash &&
+           validatedHash == other.validatedHash &&
+           includes == other.includes;
+  }
+};
+
+static uint64_t hashString(uint64_t hash, const string& text) {
+  uint64_t size = text.size();
+  hash = JlHash::bytes(hash, &size, sizeof(size));
+  return JlHash::bytes(hash, text.data(), text.size());
+}
+
+// Everything the SPIR-V depends on besides the source. Bumped with any
+// change to the settings compileSource() uses.
+static uint64_t getCompilerHash() {
+  glslang::Version version = glslang::GetVersion();
+  uint64_t hash = JlHash::offsetBasis;
+  hash = hashString(hash, "glsl100 vulkan1.0 spirv1.0 spv-rules vulkan-rules");
+  hash = JlHash::bytes(hash, &version.major, sizeof(version.major));
+  hash = JlHash::bytes(hash, &version.minor, sizeof(version.minor));
+  hash = JlHash::bytes(hash, &version.patch, sizeof(version.patch));
+  return hashString(hash, version.flavor != nullptr ? version.flavor : "");
+}
+
+// The source and everything it includes, so a changed header rebuilds
+// exactly the shaders that include it. Headers are read once per batch
+// through headerHashes. False when an include is gone.
+static bool getInputHash(uint64_t compilerHash, const string& source,
+                         const vector<string>& includes,
+                         map<string, uint64_t>& headerHashes,
+                         uint64_t& inputHash) {
+  inputHash = hashString(compilerHash, source);
+  for (const string& include : includes) {
+    auto found = headerHashes.find(include);
+    if (found == headerHashes.end()) {
+      string contents;
+      if (!readShaderFile(JlEngineDirectories::shadersDir / include,
+                          contents))
+        return false;
+      found = headerHashes
+                .emplace(include,
+                         hashString(JlHash::offsetBasis, contents))
+                .first;
+    }
+
+    inputHash = hashString(inputHash, include);
+    inputHash = JlHash::bytes(inputHash, &found->second, sizeof(found->second));
+  }
+  return true;
+}
+
+static uint64_t getValidationStamp(const vector<uint32_t>& spirv) {
+  uint64_t hash = JlHash::offsetBasis;
+  hash = hashString(hash, spvSoftwareVersionString());
+  hash = JlHash::value(hash, shaderValidationEnv_);
+  hash = JlHash::bytes(hash, spirv.data(), spirv.size() * sizeof(uint32_t));
+  // 0 marks an unvalidated binary.
+  return hash != 0 ? hash : 1;
+}
+
+static string getCompiledPath(const string& shName) {
+  return JlEngineDirectories::appDir.string() +
+         JlEngineDirectories::compiledShadersDir.string() + shName + ".spv";
+}
+
+static string getManifestPath() {
+  return JlEngineDirectories::appDir.string() +
+         JlEngineDirectories::compiledShadersDir.string() + "shaders.manifest";
+}
+
+// One line per compiled shader after a version line, tab separated, the
+// name, the input hash, the validated hash and then its includes. Anything
+// unreadable starts over from nothing.
+static bool loadManifest(map<string, ShaderManifestEntry>& manifest) {
+  ifstream file(getManifestPath());
+  string line;
+  if (!file.is_open() || !getline(file, line) || line != "JLSM 2")
+    return false;
+
+  while (getline(file, line)) {
+    vector<string> fields;
+    istringstream stream(line);
+    for (string field; getline(stream, field, '\t');)
+      fields.push_back(field);
+    if (fields.size() < 3) continue;
+
+    try {
+      ShaderManifestEntry entry;
+      entry.inputHash = stoull(fields[1], nullptr, 16);
+      entry.validatedHash = stoull(fields[2], nullptr, 16);
+      entry.includes.assign(fields.begin() + 3, fields.end());
+      manifest[fields[0]] = entry;
+    }
+    catch (const logic_error&) {
+      continue;
+    }
+  }
+  return true;
+}
+
+// Written next to the real file and swapped in, like the pipeline cache.
+static void saveManifest(const map<string, ShaderManifestEntry>& manifest) {
+  string manifestPath = getManifestPath();
+  string tempPath = manifestPath + ".tmp";
+  try {
+    {
+      ofstream file(tempPath, ios::trunc);
+      if (!file.is_open())
+        throw runtime_error("Failed to open \"" + tempPath + "\".");
+
+      file << "JLSM 2\n" << hex;
+      for (const auto& [name, entry] : manifest) {
+        file << name << '\t' << entry.inputHash << '\t'
+             << entry.validatedHash;
+        for (const string& include : entry.includes)
+          file << '\t' << include;
+        file << '\n';
+      }
+      if (!file.good())
+        throw runtime_error("Failed to write \"" + tempPath + "\".");
+    }
+
+    error_code ec;
+    rename(tempPath, manifestPath, ec);
+    if (ec)
+      throw runtime_error("Failed to replace \"" + manifestPath + "\".");
+  }
+  catch (runtime_error& e) {
+    cerr << JlEngineReports::jlShader << e.what() << endl;
+  }
+}
+
+static bool readSpirvFile(const string& file, vector<uint32_t>& spirv) {
+  string binary;
+  if (!readShaderFile(file, binary) || binary.empty() ||
+      binary.size() % sizeof(uint32_t) != 0)
+    return false;
+
+  spirv.resize(binary.size() / sizeof(uint32_t));
+  memcpy(spirv.data(), binary.data(), binary.size());
+  return true;
+}
+
+static bool compileShader(ShaderJob& job) {
+  string shName = job.entry.path().filename().string();
+  string cshPath = getCompiledPath(shName);
+
+  if (!JlVulkanShaders::compileSource(
+        job.source, shName, JlVulkanShaders::getStage(job.entry.path()),
+        job.spirv, job.diagnostics, &job.includes))
+    return false;
+
+  // Against what was actually included. A header that can't be read back
+  // leaves 0, which never matches, so the shader is tried again next time.
+  map<string, uint64_t> headerHashes;
+  if (!getInputHash(getCompilerHash(), job.source, job.includes,
+                    headerHashes, job.inputHash))
+    job.inputHash = 0;
+
+  ofstream file(cshPath, ios::binary | ios::trunc);
+  file.write(reinterpret_cast<const char*>(job.spirv.data()),
+             job.spirv.size() * sizeof(uint32_t));
+  if (!file.good()) {
+    job.diagnostics.push_back({ JlVulkanShaders::Diagnostic::Error, shName,
+                                0, "Failed to write \"" + cshPath + "\"." });
+    return false;
+  }
+
+  // compileSource() validated it already.
+  job.validatedHash = getValidationStamp(job.spirv);
+  return true;
+}
+
+static bool validateShader(ShaderJob& job) {
+  string shName = job.entry.path().filename().string();
+  if (!JlVulkanShaders::validate(job.spirv, shName, job.diagnostics))
+    return false;
+
+  job.validatedHash = getValidationStamp(job.spirv);
+  return true;
+}
+
+// Returns the wall time of the whole batch, every job keeps its own.
+static double runShaderJobs(JlWorkerPool& workers, vector<ShaderJob>& jobs,
+                            bool (*work)(ShaderJob&)) {
+  using clock = chrono::steady_clock;
+  clock::time_point start = clock::now();
+
+  workers.parallelFor(
+    static_cast<uint32_t>(jobs.size()),
+    [&](uint32_t index, uint32_t worker) {
+      ShaderJob& job = jobs[index];
+      clock::time_point jobStart = clock::now();
+      job.result = work(job);
+      job.ms =
+        chrono::duration<double, milli>(clock::now() - jobStart).count();
+    });
+
+  return chrono::duration<double, milli>(clock::now() - start).count();
+}
+
+// Shaders that failed to compile are left out so they are compiled again
+// next time, ones that failed validation keep their input hash. Sources
+// that are gone drop out with them.
+static void updateManifest(const map<string, ShaderManifestEntry>& manifest,
+                           const vector<ShaderJob>& compiled,
+                           const vector<ShaderJob>& validated,
+                           const vector<ShaderJob>& upToDate) {
+  map<string, ShaderManifestEntry> builtManifest;
+  for (const vector<ShaderJob>* jobs : { &compiled, &validated, &upToDate })
+    for (const ShaderJob& job : *jobs)
+      if (job.result || jobs == &validated)
+        builtManifest[job.entry.path().filename().string()] = {
+          job.inputHash, job.validatedHash, job.includes };
+
+  if (builtManifest != manifest) saveManifest(builtManifest);
+}
+
+// Returns how many failed.
+static int reportShaderJobs(const vector<ShaderJob>& jobs, const char* marker,
+                            const char* failure) {
+  int results = 0;
+  for (const ShaderJob& job : jobs) {
+    string shName = job.entry.path().filename().string();
+    if (marker != nullptr) cout << marker << shName << ".spv" << endl;
+
+    JlVulkanShaders::reportDiagnostics(job.diagnostics);
+    if (!job.result) {
+      cerr << JlEngineReports::jlShader << failure << shName << "\"."
+           << endl;
+      results++;
+    }
+  }
+  return results;
+}
+
+// Summed time is what the batch would have taken on one thread.
+static void reportShaderTimes(const char* what, const vector<ShaderJob>& jobs,
+                              double wallMs) {
+  double summedMs = 0.0;
+  for (const ShaderJob& job : jobs) summedMs += job.ms;
+
+  cout << JlEngineReports::jlShader << what << " " << jobs.size()
+       << " shaders in " << wallMs << " ms wall / " << summedMs
+       << " ms summed over the shaders / "
+       << (wallMs > 0.0 ? summedMs / wallMs : 0.0) << "x." << endl;
+}
+
 bool JlVulkanShaders::compile() {
-  system("cls");
   cout << ">> Directories ----" << endl;
   cout << "> " << JlEngineDirectories::toolsDir.string() << endl;
   cout << "> " << JlEngineDirectories::shadersDir.string() << endl;
@@ -33,14 +562,6 @@ bool JlVulkanShaders::compile() {
     return false;
   }
 
-  if (!exists(JlEngineDirectories::toolsDir)) {
-    cerr << JlEngineReports::jlShader
-         << "Shaders can't compile. Failed to open the tools folder... The "
-            "folder probably doesn't exist."
-         << endl;
-    return false;
-  }
-
   if (!exists(JlEngineDirectories::compiledShadersDir)) {
     cerr << JlEngineReports::jlShader
          << "CSH folders doesn't exist, creating one now..." << endl;
@@ -52,114 +573,140 @@ bool JlVulkanShaders::compile() {
 
   cout << JlEngineReports::jlShader << "Looking for shaders..." << endl;
 
-  int shaderCompiledCount = 0;
-  vector<directory_entry> shadersToCompile;
-  vector<directory_entry> shadersToValidate;
+  // Sorted, so the results are reported in the same order on every run
+  // and every platform.
+  vector<directory_entry> entries;
   for (const directory_entry entry :
-       directory_iterator(JlEngineDirectories::shadersDir)) {
-    if (!entry.is_regular_file()) continue;
+       directory_iterator(JlEngineDirectories::shadersDir))
+    if (entry.is_regular_file()) entries.push_back(entry);
+  sort(entries.begin(), entries.end(),
+       [](const directory_entry& a, const directory_entry& b) {
+         return a.path().filename() < b.path().filename();
+       });
+
+  map<string, ShaderManifestEntry> manifest;
+  loadManifest(manifest);
+  uint64_t compilerHash = getCompilerHash();
+  map<string, uint64_t> headerHashes;
 
+  // A shader is only compiled again when what it's built from changed,
+  // and only validated again when the binary isn't the one that passed.
+  // Its includes come from the manifest, unchanged sources include the
+  // same files they did last time.
+  int shaderCompiledCount = 0;
+  int headerCount = 0;
+  vector<ShaderJob> shadersToCompile;
+  vector<ShaderJob> shadersToValidate;
+  vector<ShaderJob> shadersUpToDate;
+  for (const directory_entry& entry : entries) {
     string shName = entry.path().filename().string();
-    path cshPath = JlEngineDirectories::appDir.string() +
-                   JlEngineDirectories::compiledShadersDir.string() + shName +
-                   ".spv";
-
-    if (exists(cshPath)) {
-      cout << " C > " << shName << endl;
-      shadersToValidate.push_back(entry);
-      shaderCompiledCount++;
+
+    if (getStage(entry.path()) == UnknownStage) {
+      cout << " H > " << shName << endl;
+      headerCount++;
       continue;
     }
 
-    cout << " X > " << shName << endl;
-    shadersToCompile.push_back(entry);
-    shadersToValidate.push_back(entry);
+    ShaderJob job{ entry };
+    if (!readShaderFile(entry.path(), job.source)) {
+      cerr << JlEngineReports::jlShader << "Failed to read \"" << shName
+           << "\"." << endl;
+      continue;
+    }
+
+    auto found = manifest.find(shName);
+    if (found == manifest.end() ||
+        !getInputHash(compilerHash, job.source, found->second.includes,
+                      headerHashes, job.inputHash) ||
+        found->second.inputHash != job.inputHash ||
+        !readSpirvFile(getCompiledPath(shName), job.spirv)) {
+      cout << " X > " << shName << endl;
+      shadersToCompile.push_back(move(job));
+      continue;
+    }
+
+    cout << " C > " << shName << endl;
+    shaderCompiledCount++;
+    job.source.clear();
+    job.includes = found->second.includes;
+    if (found->second.validatedHash == getValidationStamp(job.spirv)) {
+      job.validatedHash = found->second.validatedHash;
+      job.result = true;
+      shadersUpToDate.push_back(move(job));
+    } else
+      shadersToValidate.push_back(move(job));
   }
 
   cout << JlEngineReports::jlShader << "Completed." << endl;
   cout << JlEngineReports::jlShader << shadersToCompile.size()
        << " Shaders not compiled. / " << shaderCompiledCount
-       << " Shaders already compiled." << endl;
-
-  if (shadersToCompile.size() > 0) {
-    int results = 0;
-    cout << JlEngineReports::jlShader << "Compiling..." << endl;
-    for (const directory_entry entry : shadersToCompile) {
-      string shName = entry.path().filename().string();
-
-      int result =
-          system(("cd " + JlEngineDirectories::toolsDir.string()).c_str());
-      if (result != 0) {
-        cerr << JlEngineReports::jlShader
-             << "Failed to open the tools folder... The folder probably "
-                "doesn't exist."
-             << endl;
-        return false;
-      }
+       << " Shaders already compiled. / " << shadersUpToDate.size()
+       << " Shaders already validated. / " << headerCount << " Headers."
+       << endl;
 
-      string glslangValidatorCmd =
-          ("glslangValidator -V \"" + JlEngineDirectories::shadersDir.string() +
-           shName + "\" -o \"" + JlEngineDirectories::appDir.string() +
-           JlEngineDirectories::compiledShadersDir.string() + shName +
-           ".spv\"");
-
-      result = system(glslangValidatorCmd.c_str());
-      if (result != 0) {
-        cerr << JlEngineReports::jlShader << "Failed to compile \"" << shName
-             << "\"." << endl;
-        results++;
-      }
-    }
-
-    if (results > 0)
-      cout << JlEngineReports::jlShader << results
-           << " Shaders failed to compile. Proceed with caution..." << endl;
-    else
-      cout << JlEngineReports::jlShader << "All shaders were compiled." << endl;
-  } else
-    cout << JlEngineReports::jlShader
-         << "No shaders need to compile. ~If you need to force compile than "
-            "start with \"-forceShaderCompile\"."
+  if (shadersToCompile.empty() && shadersToValidate.empty()) {
+    cout << JlEngineReports::jlShader << "All shaders are up to date."
          << endl;
+    updateManifest(manifest, shadersToCompile, shadersToValidate,
+                   shadersUpToDate);
+    return true;
+  }
 
-  if (shadersToValidate.size() > 0) {
-    int results = 0;
-    cout << JlEngineReports::jlShader << "Validating..." << endl;
-    for (const directory_entry entry : shadersToValidate) {
-      string shName = entry.path().filename().string();
-      cout << " V > " + shName << ".spv" << endl;
-
-      int result =
-          system(("cd " + JlEngineDirectories::toolsDir.string()).c_str());
-      if (result != 0) {
-        cerr << JlEngineReports::jlShader
-             << "Failed to open the tools folder... The folder probably "
-                "doesn't exist."
-             << endl;
-        return false;
-      }
+  uint32_t workerCount = JlEngineSettings::shaderWorkers > 0
+                           ? JlEngineSettings::shaderWorkers
+                           : JlWorkerPool::getDefaultWorkerCount();
+  workerCount = max(1u, min(workerCount, static_cast<uint32_t>(max(
+    shadersToCompile.size(), shadersToValidate.size()))));
 
-      string glslangValidatorCmd =
-          ("spirv-val --target-env vulkan1.3 \"" +
-           JlEngineDirectories::appDir.string() +
-           JlEngineDirectories::compiledShadersDir.string() + shName +
-           ".spv\"");
-      result = system(glslangValidatorCmd.c_str());
-      if (result != 0) {
-        cerr << JlEngineReports::jlShader << "Validation failed! \"" << shName
-             << "\"." << endl;
-        results++;
-      }
-    }
+  // Held for the whole batch so every shader doesn't set glslang up again.
+  glslang::InitializeProcess();
 
-    if (results > 0)
-      cout << JlEngineReports::jlShader << results
-           << " Shaders failed to validate. Proceed with caution..." << endl;
-    else
-      cout << JlEngineReports::jlShader << "All shaders were validated."
+  {
+    JlWorkerPool workers(workerCount);
+
+    if (shadersToCompile.size() > 0) {
+      cout << JlEngineReports::jlShader << "Compiling on " << workerCount
+           << " workers..." << endl;
+      double wallMs = runShaderJobs(workers, shadersToCompile, compileShader);
+
+      int results = reportShaderJobs(shadersToCompile, nullptr,
+                                     "Failed to compile \"");
+      reportShaderTimes("Compiled", shadersToCompile, wallMs);
+      if (results > 0)
+        cout << JlEngineReports::jlShader << results
+             << " Shaders failed to compile. Proceed with caution..." << endl;
+      else
+        cout << JlEngineReports::jlShader << "All shaders were compiled."
+             << endl;
+    } else
+      cout << JlEngineReports::jlShader
+           << "No shaders need to compile. ~If you need to force compile "
+              "than start with \"-forceShaderCompile\"."
            << endl;
-  } else
-    cout << JlEngineReports::jlShader << "No shaders to validate." << endl;
 
+    // Freshly compiled shaders were validated as part of compiling.
+    if (shadersToValidate.size() > 0) {
+      cout << JlEngineReports::jlShader << "Validating..." << endl;
+      double wallMs =
+        runShaderJobs(workers, shadersToValidate, validateShader);
+
+      int results = reportShaderJobs(shadersToValidate, " V > ",
+                                     "Validation failed! \"");
+      reportShaderTimes("Validated", shadersToValidate, wallMs);
+      if (results > 0)
+        cout << JlEngineReports::jlShader << results
+             << " Shaders failed to validate. Proceed with caution..."
+             << endl;
+      else
+        cout << JlEngineReports::jlShader << "All shaders were validated."
+             << endl;
+    } else
+      cout << JlEngineReports::jlShader << "No shaders to validate." << endl;
+  }
+
+  glslang::FinalizeProcess();
+
+  updateManifest(manifest, shadersToCompile, shadersToValidate,
+                 shadersUpToDate);
   return true;
-}
\ No newline at end of file
+}